@@ -0,0 +1,29 @@
+#include "alloc_stats.hxx"
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Per thread, so counting needs neither atomics nor locks
+thread_local AllocationStats counters;
+
+void *allocate(std::size_t size) {
+  counters.allocations++;
+  counters.bytes += size;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+AllocationStats threadAllocationStats() { return counters; }
+
+// The array and nothrow forms of the standard library call these
+void *operator new(std::size_t size) { return allocate(size); }
+void *operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,19 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <cstdint>
+
+// Heap allocations made through operator new. alloc_stats.cxx counts them
+// by replacing the global operator new and delete, so it is left out of the
+// library: a program that wants the counts compiles it in and passes
+// threadAllocationStats as ConversionOptions::allocationStats.
+struct AllocationStats {
+  uint64_t allocations = 0; // Calls of operator new
+  uint64_t bytes = 0;       // Bytes requested from it
+};
+
+// Allocations the calling thread has made since it started; the difference
+// of two calls is what ran in between
+AllocationStats threadAllocationStats();
+
+#endif
@@ -0,0 +1,266 @@
+#include "batch.hxx"
+#include "fileio.hxx"
+#include "grammar_formats.hxx"
+#include "tmlanguage2vimsyntax.hxx"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory_resource>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+bool convertFile(const std::string &inputFile, const std::string &outputFile,
+                 std::string &error, const ConversionOptions &options,
+                 ConversionReport *report) {
+  // Reading and writing the files are timed here, the rest by the converter
+  ConversionStats fileStats;
+  ConversionStats *stats = options.stats ? &fileStats : nullptr;
+  AllocationStats allocationsBefore;
+  if (stats && options.allocationStats) {
+    allocationsBefore = options.allocationStats();
+  }
+
+  // Map input file, or decompress it into memory
+  InputFile input;
+  {
+    PhaseTimer timer(stats, ConversionPhase::Read);
+    if (!input.open(inputFile, error)) {
+      return false;
+    }
+  }
+  size_t bytesIn = input.storedSize();
+
+  // The parsed grammar and its include graph come from an arena sized after
+  // the input, released in one step when the conversion is done. The
+  // initial size must not be zero, which an empty file would give.
+  std::pmr::monotonic_buffer_resource arena(
+      std::max<size_t>(input.view().size(), 1));
+
+  // Parse TextMate grammar straight from the mapping or decompressed text
+  TmLanguage2VimSyntax parser(options, &arena);
+  if (!parser.parseGrammar(input.view())) {
+    error = "Failed to parse TextMate grammar: " + parser.lastError();
+    return false;
+  }
+  input.close();
+
+  // Generate Vim syntax into the output file, replaced only when complete
+  FileSink sink;
+  if (!sink.open(outputFile, error)) {
+    return false;
+  }
+  std::ostream out(&sink);
+  parser.generateVimSyntax(out);
+  bool committed;
+  {
+    // Flushing and compressing the rest of the output is part of writing
+    PhaseTimer timer(stats, ConversionPhase::Write);
+    out.flush();
+    committed = sink.commit(error);
+  }
+  if (report) {
+    report->reachability = parser.reachability();
+    report->cacheHit = parser.cacheHit();
+    report->passes = parser.passReports();
+  }
+  if (report && stats) {
+    ConversionStats &total = report->stats;
+    total = parser.stats();
+    total[ConversionPhase::Read] += fileStats[ConversionPhase::Read];
+    total[ConversionPhase::Write] += fileStats[ConversionPhase::Write];
+    total.bytesIn = bytesIn;
+    total.bytesOut = sink.bytes();
+    total.bytesWritten = sink.bytesWritten();
+    if (options.allocationStats) {
+      AllocationStats allocationsAfter = options.allocationStats();
+      total.allocations =
+          allocationsAfter.allocations - allocationsBefore.allocations;
+      total.allocatedBytes = allocationsAfter.bytes - allocationsBefore.bytes;
+    }
+    total.peakRssKiB = peakResidentKiB();
+  }
+  return committed;
+}
+
+static bool collectDirectoryJobs(const fs::path &dir, const fs::path &outDir,
+                                 Compression compression,
+                                 std::vector<BatchJob> &jobs,
+                                 std::string &error) {
+  std::error_code ec;
+  std::vector<fs::path> inputs;
+  for (const auto &entry : fs::directory_iterator(dir, ec)) {
+    if (!entry.is_regular_file(ec)) {
+      continue;
+    }
+    std::string name = entry.path().filename().string();
+    if (grammarFileStem(name).empty()) {
+      continue;
+    }
+    // package.json, tsconfig.json and the like sit next to grammars in
+    // editor extensions; a plain .json file is a grammar if it has a scope
+    if (hasGenericGrammarExtension(name)) {
+      InputFile file;
+      std::string message;
+      if (!file.open(entry.path().string(), message) ||
+          grammarScopeName(file.view()).empty()) {
+        continue;
+      }
+    }
+    inputs.push_back(entry.path());
+  }
+  if (ec) {
+    error = "Cannot read directory: " + dir.string() + ": " + ec.message();
+    return false;
+  }
+
+  // Keep job order independent of directory iteration order
+  std::sort(inputs.begin(), inputs.end());
+
+  std::map<std::string, std::string> outputs;
+  for (const auto &input : inputs) {
+    std::string stem = grammarFileStem(input.filename().string());
+    std::string output =
+        (outDir / (stem + ".vim" + compressionExtension(compression)))
+            .string();
+    auto [it, inserted] = outputs.emplace(output, input.string());
+    if (!inserted) {
+      error = "Both " + it->second + " and " + input.string() +
+              " would be written to " + output;
+      return false;
+    }
+    jobs.push_back({input.string(), output});
+  }
+  return true;
+}
+
+static bool collectManifestJobs(const fs::path &manifest,
+                                std::vector<BatchJob> &jobs,
+                                std::string &error) {
+  std::ifstream file(manifest);
+  if (!file.is_open()) {
+    error = "Cannot open manifest: " + manifest.string();
+    return false;
+  }
+
+  fs::path base = manifest.parent_path();
+  std::string line;
+  size_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    size_t first = line.find_first_not_of(" \t");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+
+    // Tab-separated lines allow spaces inside paths
+    std::string input, output, rest;
+    if (line.find('\t') != std::string::npos) {
+      std::istringstream fields(line);
+      std::getline(fields, input, '\t');
+      std::getline(fields, output, '\t');
+      std::getline(fields, rest);
+      input.erase(0, input.find_first_not_of(' '));
+    } else {
+      std::istringstream fields(line);
+      fields >> input >> output >> rest;
+    }
+    if (input.empty() || output.empty() || !rest.empty()) {
+      error = manifest.string() + ":" + std::to_string(lineNumber) +
+              ": expected \"<input> <output>\"";
+      return false;
+    }
+
+    fs::path inputPath(input), outputPath(output);
+    if (inputPath.is_relative()) {
+      inputPath = base / inputPath;
+    }
+    if (outputPath.is_relative()) {
+      outputPath = base / outputPath;
+    }
+    jobs.push_back({inputPath.string(), outputPath.string()});
+  }
+  return true;
+}
+
+bool collectBatchJobs(const std::string &source, const std::string &outputDir,
+                      std::vector<BatchJob> &jobs, std::string &error,
+                      Compression compression) {
+  std::error_code ec;
+  if (fs::is_directory(source, ec)) {
+    fs::path outDir = outputDir.empty() ? fs::path(source) : fs::path(outputDir);
+    return collectDirectoryJobs(source, outDir, compression, jobs, error);
+  }
+  if (!outputDir.empty()) {
+    error = "An output directory can only be given with an input directory";
+    return false;
+  }
+  return collectManifestJobs(source, jobs, error);
+}
+
+std::vector<BatchFailure> runBatch(const std::vector<BatchJob> &jobs,
+                                   unsigned threads,
+                                   const ConversionOptions &options,
+                                   std::vector<ConversionReport> *reports) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<unsigned>(
+      std::min<size_t>(threads, std::max<size_t>(1, jobs.size())));
+
+  // Each slot is written by exactly one worker, so no locking is needed
+  std::vector<std::string> errors(jobs.size());
+  std::vector<char> failed(jobs.size(), 0);
+  if (reports) {
+    reports->assign(jobs.size(), {});
+  }
+  std::atomic<size_t> next{0};
+
+  auto worker = [&]() {
+    for (;;) {
+      size_t index = next.fetch_add(1, std::memory_order_relaxed);
+      if (index >= jobs.size()) {
+        break;
+      }
+      // An exception fails its job only; escaping the thread it would end
+      // the process and lose every other result
+      try {
+        if (!convertFile(jobs[index].input, jobs[index].output,
+                         errors[index], options,
+                         reports ? &(*reports)[index] : nullptr)) {
+          failed[index] = 1;
+        }
+      } catch (const std::exception &e) {
+        errors[index] = e.what();
+        failed[index] = 1;
+      } catch (...) {
+        errors[index] = "Unknown error";
+        failed[index] = 1;
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  std::vector<BatchFailure> failures;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (failed[i]) {
+      failures.push_back({jobs[i], errors[i]});
+    }
+  }
+  return failures;
+}
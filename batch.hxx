@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "compression.hxx"
+#include "tmlanguage2vimsyntax.hxx"
+#include <string>
+#include <vector>
+
+// One input grammar and the Vim syntax file generated from it
+struct BatchJob {
+  std::string input;  // Path to the TextMate grammar
+  std::string output; // Path to the generated Vim syntax file
+};
+
+// A job that could not be converted, with the reason
+struct BatchFailure {
+  BatchJob job;
+  std::string message;
+};
+
+// What a conversion did besides writing the file
+struct ConversionReport {
+  ReachabilityStats reachability; // With ConversionOptions::reachableOnly
+  bool cacheHit = false;          // Grammar loaded from the cache
+  std::vector<SyntaxPassReport> passes;
+  ConversionStats stats; // With ConversionOptions::stats
+};
+
+// Convert a single grammar file into a Vim syntax file, describing the
+// conversion in `report` if given
+bool convertFile(const std::string &inputFile, const std::string &outputFile,
+                 std::string &error, const ConversionOptions &options = {},
+                 ConversionReport *report = nullptr);
+
+// Collect jobs from a directory of grammars or from a manifest file.
+// A directory yields one job per grammar file (see grammarFileStem()),
+// written to outputDir (or the directory itself) as <name>.vim, with the
+// extension of `compression` appended. A manifest lists one
+// "<input> <output>" pair per line; relative paths are resolved against the
+// manifest's directory, blank lines and lines starting with '#' are skipped.
+bool collectBatchJobs(const std::string &source, const std::string &outputDir,
+                      std::vector<BatchJob> &jobs, std::string &error,
+                      Compression compression = Compression::None);
+
+// Convert all jobs on a pool of worker threads (0 = one per hardware thread)
+// and return the jobs that failed, in job order. If `reports` is given, it
+// receives the report of every job, in job order.
+std::vector<BatchFailure>
+runBatch(const std::vector<BatchJob> &jobs, unsigned threads = 0,
+         const ConversionOptions &options = {},
+         std::vector<ConversionReport> *reports = nullptr);
+
+#endif
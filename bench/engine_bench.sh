@@ -0,0 +1,55 @@
+#!/bin/sh
+# Compare Vim regex engine choices on sample source files.
+#
+#   bench/engine_bench.sh <tmlanguage2vimsyntax> <grammar.json> <source>...
+#
+# The grammar is converted once per --regex-engine setting (engines chosen
+# per pattern, none, backtracking, NFA) and each source file is highlighted
+# from the first to the last line in a headless Vim. Runs taking longer than
+# $TIMEOUT seconds (default 60) are reported as such.
+
+if [ $# -lt 3 ]; then
+  echo "Usage: $0 <tmlanguage2vimsyntax> <grammar.json> <source>..." >&2
+  exit 1
+fi
+converter=$1
+grammar=$2
+shift 2
+timeout=${TIMEOUT:-60}
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+cat >"$work/time.vim" <<'EOF'
+execute 'source ' . fnameescape(g:syntax_file)
+let s:start = reltime()
+for s:line in range(1, line('$'))
+  call synID(s:line, max([1, col([s:line, '$']) - 1]), 1)
+endfor
+call writefile([printf('%.3f', reltimefloat(reltime(s:start)))], g:result_file)
+qa!
+EOF
+
+"$converter" "$grammar" "$work/pattern.vim" >/dev/null || exit 1
+for engine in 0 1 2; do
+  "$converter" --regex-engine "$engine" "$grammar" "$work/$engine.vim" \
+    >/dev/null || exit 1
+done
+
+printf '%-24s %12s %12s %12s %12s\n' source per-pattern auto backtrack nfa
+for source in "$@"; do
+  printf '%-24s' "$(basename "$source")"
+  for engine in pattern 0 1 2; do
+    rm -f "$work/result"
+    timeout "$timeout" vim -Nu NONE -i NONE -es \
+      --cmd "let g:syntax_file = '$work/$engine.vim'" \
+      --cmd "let g:result_file = '$work/result'" \
+      -S "$work/time.vim" "$source" </dev/null >/dev/null 2>&1
+    if [ -s "$work/result" ]; then
+      printf ' %11ss' "$(cat "$work/result")"
+    else
+      printf ' %12s' timeout
+    fi
+  done
+  printf '\n'
+done
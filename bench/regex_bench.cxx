@@ -0,0 +1,185 @@
+// Measures regex translation time against nesting depth. With a single pass
+// over the pattern the time per input byte should stay flat as depth grows.
+//
+// Also compares flat and trie-factored output for large literal
+// alternations. With "--vim FILE" a Vim script is written that times both
+// forms on the same text: vim -Nu NONE -es -S FILE
+#include "vim_regex.hxx"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static std::string nestedPattern(int depth) {
+  // (?:a(?:b(?=c ... )))+ with a lookaround every third level
+  std::string pattern;
+  for (int i = 0; i < depth; ++i) {
+    pattern += i % 3 == 2 ? "(?=" : "(?:";
+    pattern += static_cast<char>('a' + i % 26);
+    pattern += "\\b";
+  }
+  pattern += "[\\w.]+";
+  for (int i = 0; i < depth; ++i) {
+    pattern += i % 2 ? ")?" : ")";
+  }
+  return pattern;
+}
+
+// Deterministic pseudo-random numbers, so every run measures the same input
+static uint32_t nextRandom(uint32_t &state) {
+  state = state * 1103515245 + 12345;
+  return state >> 8;
+}
+
+// Identifiers with shared prefixes and non-word characters, which keep them
+// from becoming keywords
+static std::vector<std::string> literalWords(size_t count) {
+  static const char *const prefixes[] = {"get", "set", "is",   "has",
+                                         "to",  "on",  "make", "read"};
+  static const char *const stems[] = {"Name", "Value", "Item", "Line",
+                                      "Path", "Size",  "Mode", "Time"};
+  uint32_t state = 1;
+  std::vector<std::string> words;
+  while (words.size() < count) {
+    std::string word = prefixes[nextRandom(state) % 8];
+    word += stems[nextRandom(state) % 8];
+    word += std::to_string(nextRandom(state) % 100);
+    if (nextRandom(state) % 2) {
+      word += "!";
+    }
+    if (std::find(words.begin(), words.end(), word) == words.end()) {
+      words.push_back(word);
+    }
+  }
+  return words;
+}
+
+// Branches of the widest alternation, which Vim may try one by one at every
+// column
+static size_t widestAlternation(const std::string &pattern) {
+  std::vector<size_t> branches = {1};
+  size_t widest = 1;
+  for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+    if (pattern[i] != '\\') {
+      continue;
+    }
+    char next = pattern[++i];
+    if (next == '(' || (next == '%' && i + 1 < pattern.size() &&
+                        pattern[i + 1] == '(')) {
+      branches.push_back(1);
+    } else if (next == ')' && branches.size() > 1) {
+      widest = std::max(widest, branches.back());
+      branches.pop_back();
+    } else if (next == '|') {
+      branches.back()++;
+    }
+  }
+  return std::max(widest, branches.front());
+}
+
+static std::string vimString(const std::string &text) {
+  std::string quoted = "'";
+  for (char c : text) {
+    quoted += c;
+    if (c == '\'') {
+      quoted += '\'';
+    }
+  }
+  return quoted + "'";
+}
+
+static void benchAlternations(const char *vimScript) {
+  VimRegexTranslator flat;
+  flat.setFactorAlternations(false);
+  VimRegexTranslator factored;
+
+  std::ofstream script;
+  if (vimScript) {
+    script.open(vimScript);
+    script << "let results = []\n";
+  }
+
+  std::printf("\n%8s %14s %14s %12s\n", "words", "flat widest",
+              "trie widest", "trie bytes");
+  for (size_t count : {50, 200, 800}) {
+    std::vector<std::string> words = literalWords(count);
+    std::string regex;
+    for (const auto &word : words) {
+      regex += (regex.empty() ? "" : "|") + word;
+    }
+    std::string flatPattern = flat.translate(regex);
+    std::string triePattern = factored.translate(regex);
+    std::printf("%8zu %14zu %14zu %12zu\n", count,
+                widestAlternation(flatPattern), widestAlternation(triePattern),
+                triePattern.size());
+
+    if (script.is_open()) {
+      // 2000 lines of words, half of them from the list. The pattern is
+      // compiled once per :substitute, so the time is spent matching.
+      uint32_t state = 7;
+      script << "enew!\n";
+      for (int line = 0; line < 2000; ++line) {
+        std::string text;
+        for (int i = 0; i < 8; ++i) {
+          text += nextRandom(state) % 2 ? words[nextRandom(state) % count]
+                                        : "other" + std::to_string(i);
+          text += ' ';
+        }
+        script << "call setline(" << (line + 1) << ", " << vimString(text)
+               << ")\n";
+      }
+      for (const auto &[name, pattern] :
+           {std::pair{"flat", flatPattern}, std::pair{"trie", triePattern}}) {
+        script << "let start = reltime()\n"
+               << "execute 'silent %s/' . escape(" << vimString(pattern)
+               << ", '/') . '//gne'\n"
+               << "call add(results, '" << count << " words " << name
+               << ": ' . reltimestr(reltime(start)))\n";
+      }
+    }
+  }
+
+  if (script.is_open()) {
+    // Ex mode only shows :print output
+    script << "enew!\n"
+           << "call setline(1, results)\n"
+           << "%print\n"
+           << "qa!\n";
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *vimScript = nullptr;
+  if (argc == 3 && std::strcmp(argv[1], "--vim") == 0) {
+    vimScript = argv[2];
+  }
+
+  VimRegexTranslator translator;
+  std::printf("%8s %10s %12s %12s\n", "depth", "bytes", "us/pattern",
+              "ns/byte");
+  for (int depth : {1, 10, 100, 500, 900}) {
+    std::string pattern = nestedPattern(depth);
+    int iterations = std::max(10, 200000 / static_cast<int>(pattern.size()));
+
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      sink += translator.translate(pattern).size();
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    double perPattern = elapsed.count() / iterations;
+    std::printf("%8d %10zu %12.2f %12.2f\n", depth, pattern.size(),
+                perPattern / 1000, perPattern / pattern.size());
+    if (sink == 0) {
+      return 1;
+    }
+  }
+
+  benchAlternations(vimScript);
+  return 0;
+}
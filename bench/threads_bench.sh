@@ -0,0 +1,52 @@
+#!/bin/sh
+# Time the conversion of one grammar on different numbers of threads.
+#
+#   bench/threads_bench.sh <tmlanguage2vimsyntax> <grammar.json> [threads]...
+#
+# The grammar is converted $RUNS times (default 5) per --threads setting
+# (default 1 2 4 8) and the fastest wall time is reported, with the speedup
+# over the first setting. Every output is checked against that of the first
+# setting, since the thread count must not change it.
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <tmlanguage2vimsyntax> <grammar.json> [threads]..." >&2
+  exit 1
+fi
+converter=$1
+grammar=$2
+shift 2
+[ $# -gt 0 ] || set -- 1 2 4 8
+runs=${RUNS:-5}
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+# Milliseconds since the epoch
+now() {
+  date +%s%N | cut -c1-13
+}
+
+printf '%8s %10s %8s\n' threads ms speedup
+base=
+reference=
+for threads in "$@"; do
+  best=
+  for run in $(seq "$runs"); do
+    start=$(now)
+    "$converter" --threads "$threads" "$grammar" "$work/$threads.vim" \
+      >/dev/null || exit 1
+    elapsed=$(($(now) - start))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+      best=$elapsed
+    fi
+  done
+  if [ -z "$reference" ]; then
+    reference=$work/$threads.vim
+    base=$best
+  elif ! cmp -s "$reference" "$work/$threads.vim"; then
+    echo "Output with --threads $threads differs" >&2
+    exit 1
+  fi
+  printf '%8s %10s %8s\n' "$threads" "$best" \
+    "$(awk "BEGIN { printf \"%.2fx\", $base / ($best ? $best : 1) }")"
+done
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Check that Vim loads the syntax files generated from grammars.
+#
+#   bench/vim_check.sh <tmlanguage2vimsyntax> [grammar]...
+#
+# Each grammar (by default those in bench/samples) is converted with every
+# -O level and the result is sourced in a headless Vim, then used to highlight
+# the grammar file itself so the patterns are compiled. Any Vim error fails
+# the check.
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <tmlanguage2vimsyntax> [grammar]..." >&2
+  exit 1
+fi
+converter=$1
+shift
+[ $# -gt 0 ] || set -- "$(dirname "$0")"/samples/*.tmLanguage.json
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+cat >"$work/check.vim" <<'VIM'
+try
+  execute 'source ' . fnameescape(g:syntax_file)
+  for s:line in range(1, line('$'))
+    call synID(s:line, max([1, col([s:line, '$']) - 1]), 1)
+  endfor
+  call writefile(['ok'], g:result_file)
+catch
+  call writefile([v:exception], g:result_file)
+endtry
+qa!
+VIM
+
+failed=0
+for grammar in "$@"; do
+  for level in 0 1 2; do
+    "$converter" -O$level "$grammar" "$work/syntax.vim" >/dev/null || {
+      failed=1
+      continue
+    }
+    rm -f "$work/result"
+    vim -Nu NONE -i NONE -es \
+      --cmd "let g:syntax_file = '$work/syntax.vim'" \
+      --cmd "let g:result_file = '$work/result'" \
+      -S "$work/check.vim" "$grammar" </dev/null >/dev/null 2>&1
+    result=$(cat "$work/result" 2>/dev/null)
+    if [ "$result" != ok ]; then
+      echo "$(basename "$grammar") -O$level: ${result:-Vim did not finish}"
+      failed=1
+    fi
+  done
+done
+[ $failed -eq 0 ] && echo "All syntax files loaded"
+exit $failed
@@ -0,0 +1,364 @@
+#include "compression.hxx"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#ifdef TM2VIM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TM2VIM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Output is produced in pieces of this size
+constexpr size_t kChunkSize = 64 * 1024;
+
+// zlib counts its buffers in unsigned ints
+constexpr size_t kMaxZlibPiece = UINT_MAX / 2;
+
+std::string unsupported(Compression compression) {
+  return std::string("Reading ") + compressionName(compression) +
+         " files is not supported by this build";
+}
+
+bool endsWith(const std::string &text, std::string_view suffix) {
+  return text.size() > suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+#ifdef TM2VIM_HAVE_ZLIB
+bool gunzip(std::string_view data, std::string &out, std::string &error) {
+  // A gzip member ends with its size modulo 2^32, and deflate cannot expand
+  // data more than 1032 times; a bogus size is no more than a bad guess
+  size_t expected = kChunkSize;
+  if (data.size() >= 4) {
+    const auto *tail =
+        reinterpret_cast<const unsigned char *>(data.data() + data.size() - 4);
+    uint32_t size = tail[0] | (tail[1] << 8) | (tail[2] << 16) |
+                    (static_cast<uint32_t>(tail[3]) << 24);
+    expected = std::max(expected, std::min<size_t>(size, data.size() * 1032));
+  }
+
+  z_stream stream{};
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+    error = "Cannot start gzip decompression";
+    return false;
+  }
+  size_t consumed = 0;
+  size_t produced = out.size();
+  out.resize(produced + expected);
+  for (;;) {
+    if (stream.avail_in == 0 && consumed < data.size()) {
+      size_t piece = std::min(data.size() - consumed, kMaxZlibPiece);
+      stream.next_in = reinterpret_cast<Bytef *>(
+          const_cast<char *>(data.data() + consumed));
+      stream.avail_in = static_cast<uInt>(piece);
+      consumed += piece;
+    }
+    if (produced == out.size()) {
+      out.resize(out.size() * 2);
+    }
+    size_t room = std::min(out.size() - produced, kMaxZlibPiece);
+    stream.next_out = reinterpret_cast<Bytef *>(&out[produced]);
+    stream.avail_out = static_cast<uInt>(room);
+    int status = inflate(&stream, Z_NO_FLUSH);
+    produced += room - stream.avail_out;
+
+    if (status == Z_STREAM_END) {
+      if (stream.avail_in == 0 && consumed == data.size()) {
+        break;
+      }
+      // Another member follows
+      inflateReset(&stream);
+    } else if (status != Z_OK) {
+      // With room left for output, Z_BUF_ERROR means the input ran out
+      error = status == Z_BUF_ERROR ? "Truncated gzip data"
+              : stream.msg          ? std::string("Corrupt gzip data: ") +
+                                          stream.msg
+                                    : "Corrupt gzip data";
+      inflateEnd(&stream);
+      return false;
+    }
+  }
+  inflateEnd(&stream);
+  out.resize(produced);
+  return true;
+}
+#endif
+
+#ifdef TM2VIM_HAVE_ZSTD
+bool unzstd(std::string_view data, std::string &out, std::string &error) {
+  // The frame header usually records the size of its content
+  unsigned long long size = ZSTD_getFrameContentSize(data.data(), data.size());
+  size_t expected = kChunkSize;
+  if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR) {
+    expected = std::max<size_t>(expected, size);
+  }
+
+  ZSTD_DCtx *context = ZSTD_createDCtx();
+  if (!context) {
+    error = "Cannot start zstd decompression";
+    return false;
+  }
+  ZSTD_inBuffer input = {data.data(), data.size(), 0};
+  size_t produced = out.size();
+  out.resize(produced + expected);
+  size_t status = 1;
+  while (input.pos < input.size || status != 0) {
+    if (produced == out.size()) {
+      out.resize(out.size() * 2);
+    }
+    ZSTD_outBuffer output = {&out[0], out.size(), produced};
+    status = ZSTD_decompressStream(context, &output, &input);
+    produced = output.pos;
+    if (ZSTD_isError(status)) {
+      error = std::string("Corrupt zstd data: ") + ZSTD_getErrorName(status);
+      ZSTD_freeDCtx(context);
+      return false;
+    }
+    // An unfinished frame with room left for output needs more input
+    if (status != 0 && input.pos == input.size && output.pos < output.size) {
+      error = "Truncated zstd data";
+      ZSTD_freeDCtx(context);
+      return false;
+    }
+  }
+  ZSTD_freeDCtx(context);
+  out.resize(produced);
+  return true;
+}
+#endif
+
+} // namespace
+
+Compression detectCompression(std::string_view data) {
+  if (data.size() >= 2 && data[0] == '\x1F' && data[1] == '\x8B') {
+    return Compression::Gzip;
+  }
+  if (data.size() >= 4 && data.compare(0, 4, "\x28\xB5\x2F\xFD") == 0) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+Compression compressionForPath(const std::string &path) {
+  if (endsWith(path, ".gz")) {
+    return Compression::Gzip;
+  }
+  if (endsWith(path, ".zst")) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+bool compressionSupported(Compression compression) {
+  switch (compression) {
+  case Compression::None:
+    return true;
+  case Compression::Gzip:
+#ifdef TM2VIM_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case Compression::Zstd:
+#ifdef TM2VIM_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+const char *compressionName(Compression compression) {
+  switch (compression) {
+  case Compression::None:
+    return "none";
+  case Compression::Gzip:
+    return "gzip";
+  case Compression::Zstd:
+    return "zstd";
+  }
+  return "none";
+}
+
+const char *compressionExtension(Compression compression) {
+  switch (compression) {
+  case Compression::None:
+    return "";
+  case Compression::Gzip:
+    return ".gz";
+  case Compression::Zstd:
+    return ".zst";
+  }
+  return "";
+}
+
+bool parseCompression(const std::string &name, Compression &compression) {
+  if (name == "none") {
+    compression = Compression::None;
+  } else if (name == "gzip" || name == "gz") {
+    compression = Compression::Gzip;
+  } else if (name == "zstd" || name == "zst") {
+    compression = Compression::Zstd;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool decompress(std::string_view data, Compression compression,
+                std::string &out, std::string &error) {
+  switch (compression) {
+  case Compression::None:
+    out.append(data);
+    return true;
+  case Compression::Gzip:
+#ifdef TM2VIM_HAVE_ZLIB
+    return gunzip(data, out, error);
+#else
+    break;
+#endif
+  case Compression::Zstd:
+#ifdef TM2VIM_HAVE_ZSTD
+    return unzstd(data, out, error);
+#else
+    break;
+#endif
+  }
+  error = unsupported(compression);
+  return false;
+}
+
+struct Compressor::State {
+#ifdef TM2VIM_HAVE_ZLIB
+  z_stream gzip{};
+#endif
+#ifdef TM2VIM_HAVE_ZSTD
+  ZSTD_CCtx *zstd = nullptr;
+#endif
+};
+
+Compressor::Compressor() : state_(std::make_unique<State>()) {}
+
+Compressor::~Compressor() { end(); }
+
+bool Compressor::start(Compression compression, std::string &error) {
+  end();
+  switch (compression) {
+  case Compression::None:
+    return true;
+  case Compression::Gzip:
+#ifdef TM2VIM_HAVE_ZLIB
+    state_->gzip = z_stream{};
+    if (deflateInit2(&state_->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      error = "Cannot start gzip compression";
+      return false;
+    }
+    compression_ = compression;
+    return true;
+#else
+    break;
+#endif
+  case Compression::Zstd:
+#ifdef TM2VIM_HAVE_ZSTD
+    state_->zstd = ZSTD_createCCtx();
+    if (!state_->zstd) {
+      error = "Cannot start zstd compression";
+      return false;
+    }
+    compression_ = compression;
+    return true;
+#else
+    break;
+#endif
+  }
+  error = std::string("Writing ") + compressionName(compression) +
+          " files is not supported by this build";
+  return false;
+}
+
+bool Compressor::compress(std::string_view data, [[maybe_unused]] bool finish,
+                          std::string &out) {
+  switch (compression_) {
+  case Compression::None:
+    out.append(data);
+    return true;
+  case Compression::Gzip: {
+#ifdef TM2VIM_HAVE_ZLIB
+    z_stream &stream = state_->gzip;
+    for (;;) {
+      size_t piece = std::min(data.size(), kMaxZlibPiece);
+      stream.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+      stream.avail_in = static_cast<uInt>(piece);
+      data.remove_prefix(piece);
+      bool last = data.empty();
+      int flush = finish && last ? Z_FINISH : Z_NO_FLUSH;
+      int status;
+      // Without Z_FINISH, deflate() has taken all the input once it leaves
+      // room in the output
+      do {
+        size_t used = out.size();
+        out.resize(used + kChunkSize);
+        stream.next_out = reinterpret_cast<Bytef *>(&out[used]);
+        stream.avail_out = static_cast<uInt>(kChunkSize);
+        status = deflate(&stream, flush);
+        out.resize(used + kChunkSize - stream.avail_out);
+        if (status == Z_STREAM_ERROR) {
+          return false;
+        }
+      } while (stream.avail_out == 0 ||
+               (flush == Z_FINISH && status != Z_STREAM_END));
+      if (last) {
+        return true;
+      }
+    }
+#else
+    return false;
+#endif
+  }
+  case Compression::Zstd: {
+#ifdef TM2VIM_HAVE_ZSTD
+    ZSTD_inBuffer input = {data.data(), data.size(), 0};
+    ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+    size_t remaining;
+    do {
+      size_t used = out.size();
+      out.resize(used + kChunkSize);
+      ZSTD_outBuffer output = {&out[used], kChunkSize, 0};
+      remaining = ZSTD_compressStream2(state_->zstd, &output, &input, mode);
+      out.resize(used + output.pos);
+      if (ZSTD_isError(remaining)) {
+        return false;
+      }
+      // ZSTD_e_end reports what is left to flush; ZSTD_e_continue is done
+      // once it has taken all the input
+    } while (finish ? remaining != 0 : input.pos < input.size);
+    return true;
+#else
+    return false;
+#endif
+  }
+  }
+  return false;
+}
+
+void Compressor::end() {
+#ifdef TM2VIM_HAVE_ZLIB
+  if (compression_ == Compression::Gzip) {
+    deflateEnd(&state_->gzip);
+  }
+#endif
+#ifdef TM2VIM_HAVE_ZSTD
+  if (state_->zstd) {
+    ZSTD_freeCCtx(state_->zstd);
+    state_->zstd = nullptr;
+  }
+#endif
+  compression_ = Compression::None;
+}
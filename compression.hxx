@@ -0,0 +1,67 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Compression of an input or output file
+enum class Compression {
+  None,
+  Gzip, // .gz (zlib)
+  Zstd  // .zst (libzstd)
+};
+
+// Compression of data, told from its magic bytes
+Compression detectCompression(std::string_view data);
+
+// Compression of an output path, told from its extension (.gz, .zst)
+Compression compressionForPath(const std::string &path);
+
+// Whether this build can read and write a compression (None always can)
+bool compressionSupported(Compression compression);
+
+// Name of a compression: "none", "gzip" or "zstd"
+const char *compressionName(Compression compression);
+
+// File name extension of a compression: "", ".gz" or ".zst"
+const char *compressionExtension(Compression compression);
+
+// Compression of a name given on the command line ("gzip", "gz", "zstd",
+// "zst" or "none"); returns false for any other name
+bool parseCompression(const std::string &name, Compression &compression);
+
+// Decompress the whole of `data` into `out`. Concatenated gzip members or
+// zstd frames decompress to the concatenation of their contents.
+bool decompress(std::string_view data, Compression compression,
+                std::string &out, std::string &error);
+
+// Compresses a stream written in pieces
+class Compressor {
+public:
+  Compressor();
+  ~Compressor();
+
+  Compressor(const Compressor &) = delete;
+  Compressor &operator=(const Compressor &) = delete;
+
+  // Start a new stream; any previous one is dropped
+  bool start(Compression compression, std::string &error);
+
+  // Compress the next piece of the stream, appending what is ready to `out`;
+  // `finish` ends the stream. Returns false if the compressor fails.
+  bool compress(std::string_view data, bool finish, std::string &out);
+
+  // Drop the stream
+  void end();
+
+  bool active() const { return compression_ != Compression::None; }
+
+private:
+  struct State;
+
+  Compression compression_ = Compression::None;
+  std::unique_ptr<State> state_;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "conversion_stats.hxx"
+#include <algorithm>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include <nlohmann/json.hpp>
+
+const char *conversionPhaseName(ConversionPhase phase) {
+  switch (phase) {
+  case ConversionPhase::Read:
+    return "read";
+  case ConversionPhase::Parse:
+    return "parse";
+  case ConversionPhase::Translate:
+    return "translate";
+  case ConversionPhase::Generate:
+    return "generate";
+  case ConversionPhase::Passes:
+    return "passes";
+  case ConversionPhase::Highlight:
+    return "highlight";
+  case ConversionPhase::Write:
+    return "write";
+  }
+  return "";
+}
+
+double ConversionStats::totalMilliseconds() const {
+  double total = 0;
+  for (double ms : milliseconds) {
+    total += ms;
+  }
+  return total;
+}
+
+void ConversionStats::add(const ConversionStats &other) {
+  for (size_t i = 0; i < kConversionPhases; ++i) {
+    milliseconds[i] += other.milliseconds[i];
+  }
+  rules += other.rules;
+  patterns += other.patterns;
+  regexes += other.regexes;
+  syntaxItems += other.syntaxItems;
+  highlightLinks += other.highlightLinks;
+  bytesIn += other.bytesIn;
+  grammarBytes += other.grammarBytes;
+  bytesOut += other.bytesOut;
+  bytesWritten += other.bytesWritten;
+  allocations += other.allocations;
+  allocatedBytes += other.allocatedBytes;
+  peakRssKiB = std::max(peakRssKiB, other.peakRssKiB);
+}
+
+size_t peakResidentKiB() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  // Bytes there, KiB on Linux and the BSDs
+  return static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+  return static_cast<size_t>(usage.ru_maxrss);
+#endif
+}
+
+void writeConversionStats(std::ostream &os, const ConversionStats &stats) {
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  double total = stats.totalMilliseconds();
+  os << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < kConversionPhases; ++i) {
+    double ms = stats.milliseconds[i];
+    os << std::left << std::setw(10)
+       << conversionPhaseName(static_cast<ConversionPhase>(i)) << std::right
+       << std::setw(10) << ms << " ms " << std::setprecision(1)
+       << std::setw(6) << (total > 0 ? 100 * ms / total : 0) << "%\n"
+       << std::setprecision(3);
+  }
+  os << std::left << std::setw(10) << "total" << std::right << std::setw(10)
+     << total << " ms\n";
+  os << "Rules " << stats.rules << ", patterns " << stats.patterns
+     << ", regexes " << stats.regexes << ", syntax items "
+     << stats.syntaxItems << ", highlight links " << stats.highlightLinks
+     << "\n";
+  os << "Bytes in " << stats.bytesIn << " (" << stats.grammarBytes
+     << " grammar), out " << stats.bytesOut << " (" << stats.bytesWritten
+     << " written)\n";
+  os << "Heap allocations " << stats.allocations << ", "
+     << stats.allocatedBytes << " bytes; peak RSS " << stats.peakRssKiB
+     << " KiB\n";
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void writeConversionStatsJson(std::ostream &os, const ConversionStats &stats,
+                              const std::string &input,
+                              const std::string &output) {
+  // Keys in the order of the table rather than sorted
+  nlohmann::ordered_json json;
+  if (!input.empty()) {
+    json["input"] = input;
+  }
+  if (!output.empty()) {
+    json["output"] = output;
+  }
+  nlohmann::ordered_json &phases = json["milliseconds"];
+  for (size_t i = 0; i < kConversionPhases; ++i) {
+    phases[conversionPhaseName(static_cast<ConversionPhase>(i))] =
+        stats.milliseconds[i];
+  }
+  phases["total"] = stats.totalMilliseconds();
+  json["rules"] = stats.rules;
+  json["patterns"] = stats.patterns;
+  json["regexes"] = stats.regexes;
+  json["syntaxItems"] = stats.syntaxItems;
+  json["highlightLinks"] = stats.highlightLinks;
+  json["bytesIn"] = stats.bytesIn;
+  json["grammarBytes"] = stats.grammarBytes;
+  json["bytesOut"] = stats.bytesOut;
+  json["bytesWritten"] = stats.bytesWritten;
+  json["allocations"] = stats.allocations;
+  json["allocatedBytes"] = stats.allocatedBytes;
+  json["peakRssKiB"] = stats.peakRssKiB;
+  os << json.dump();
+}
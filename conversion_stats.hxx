@@ -0,0 +1,97 @@
+#ifndef CONVERSION_STATS_H
+#define CONVERSION_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Steps of a conversion, in the order they run
+enum class ConversionPhase {
+  Read,      // Mapping or decompressing the input file
+  Parse,     // Reading the grammar, or loading it from the cache
+  Translate, // Translating the regexes to Vim
+  Generate,  // Building the syntax items, embedded grammars included
+  Passes,    // Running the syntax passes
+  Highlight, // Mapping scopes to highlight groups and linking them
+  Write      // Writing the items and the output file
+};
+constexpr size_t kConversionPhases = 7;
+
+// Name of a phase ("read", "parse", ...)
+const char *conversionPhaseName(ConversionPhase phase);
+
+// Where a conversion spent its time and what it produced, collected with
+// ConversionOptions::stats
+struct ConversionStats {
+  double milliseconds[kConversionPhases] = {};
+  size_t rules = 0;           // Repository rules
+  size_t patterns = 0;        // Patterns of the grammar, rules included
+  size_t regexes = 0;         // match, begin and end regexes translated
+  size_t syntaxItems = 0;     // Items written, after the passes
+  size_t highlightLinks = 0;
+  size_t bytesIn = 0;         // Size of the input file
+  size_t grammarBytes = 0;    // Size of the grammar text, decompressed
+  size_t bytesOut = 0;        // Size of the Vim syntax generated
+  size_t bytesWritten = 0;    // Size of the output file, compressed
+  uint64_t allocations = 0;   // Heap allocations of the converting thread
+  uint64_t allocatedBytes = 0;
+  size_t peakRssKiB = 0;      // Peak resident set size of the process
+
+  double &operator[](ConversionPhase phase) {
+    return milliseconds[static_cast<size_t>(phase)];
+  }
+  double operator[](ConversionPhase phase) const {
+    return milliseconds[static_cast<size_t>(phase)];
+  }
+  double totalMilliseconds() const;
+
+  // Add the times and counts of another conversion; the peak RSS is the
+  // larger of the two
+  void add(const ConversionStats &other);
+};
+
+// Adds the time between its construction and its destruction to a phase of
+// `stats`; does nothing if `stats` is null, so it can stay in place when no
+// statistics are collected
+class PhaseTimer {
+public:
+  PhaseTimer(ConversionStats *stats, ConversionPhase phase)
+      : stats_(stats), phase_(phase) {
+    if (stats_) {
+      start_ = Clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (stats_) {
+      (*stats_)[phase_] +=
+          std::chrono::duration<double, std::milli>(Clock::now() - start_)
+              .count();
+    }
+  }
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  ConversionStats *stats_;
+  ConversionPhase phase_;
+  Clock::time_point start_;
+};
+
+// Peak resident set size of the process so far, in KiB
+size_t peakResidentKiB();
+
+// Print the phases with their times and shares, then the counts
+void writeConversionStats(std::ostream &os, const ConversionStats &stats);
+
+// Print the statistics as a JSON object on one line, with the paths of the
+// input and output files if they are given
+void writeConversionStatsJson(std::ostream &os, const ConversionStats &stats,
+                              const std::string &input = {},
+                              const std::string &output = {});
+
+#endif
@@ -0,0 +1,305 @@
+#include "fileio.hxx"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string errnoMessage(const std::string &what,
+                                const std::string &path, int err) {
+  return what + ": " + path + ": " + std::strerror(err);
+}
+
+// Read from a descriptor until the end of its data
+static bool readAll(int fd, std::string &out) {
+  constexpr size_t kChunk = 64 * 1024;
+  size_t size = 0;
+  for (;;) {
+    out.resize(size + kChunk);
+    ssize_t n = ::read(fd, &out[size], kChunk);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    size += static_cast<size_t>(n);
+  }
+  out.resize(size);
+  return true;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &path, std::string &error) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = errnoMessage("Cannot open input file", path, errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error = errnoMessage("Cannot stat input file", path, errno);
+    ::close(fd);
+    return false;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    // Pipes, process substitutions and devices are read to their end
+    bool ok = readAll(fd, contents_);
+    int err = errno;
+    ::close(fd);
+    if (!ok) {
+      error = errnoMessage("Cannot read input file", path, err);
+      contents_.clear();
+      return false;
+    }
+    data_ = contents_.data();
+    size_ = contents_.size();
+    return true;
+  }
+
+  // mmap() rejects zero-length mappings; an empty file is an empty view
+  if (st.st_size > 0) {
+    void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      error = errnoMessage("Cannot map input file", path, errno);
+      ::close(fd);
+      return false;
+    }
+    madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(data);
+    size_ = static_cast<size_t>(st.st_size);
+    mapped_ = true;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+  return true;
+}
+
+void MappedFile::close() {
+  if (mapped_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+  contents_.clear();
+  contents_.shrink_to_fit();
+}
+
+bool InputFile::open(const std::string &path, std::string &error) {
+  close();
+  if (!file_.open(path, error)) {
+    return false;
+  }
+  storedSize_ = file_.view().size();
+  compression_ = detectCompression(file_.view());
+  if (compression_ == Compression::None) {
+    return true;
+  }
+  // Only the decompressed contents are kept
+  bool ok = decompress(file_.view(), compression_, contents_, error);
+  file_.close();
+  if (!ok) {
+    error += ": " + path;
+    close();
+  }
+  return ok;
+}
+
+void InputFile::close() {
+  file_.close();
+  contents_.clear();
+  contents_.shrink_to_fit();
+  compression_ = Compression::None;
+  storedSize_ = 0;
+}
+
+FileSink::~FileSink() { discard(); }
+
+bool FileSink::open(const std::string &path, std::string &error) {
+  discard();
+  path_ = path;
+  failed_ = false;
+  errno_ = 0;
+  bytes_ = 0;
+  bytesWritten_ = 0;
+
+  // Devices and pipes cannot be replaced by renaming, so they are written
+  // to as they are
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      error = errnoMessage("Cannot open output file", path, errno);
+      return false;
+    }
+  }
+
+  // O_EXCL with a process-unique name instead of mkstemp() keeps the usual
+  // umask-derived permissions of the final file
+  static std::atomic<unsigned> counter{0};
+  for (int attempt = 0; fd_ < 0 && attempt < 100; ++attempt) {
+    tempPath_ = path + ".tmp." + std::to_string(getpid()) + "." +
+                std::to_string(counter.fetch_add(1));
+    fd_ = ::open(tempPath_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                 0666);
+    if (fd_ >= 0 || errno != EEXIST) {
+      break;
+    }
+  }
+  if (fd_ < 0) {
+    error = errnoMessage("Cannot open output file", path, errno);
+    tempPath_.clear();
+    return false;
+  }
+  if (!compressor_.start(compressionForPath(path), error)) {
+    error += ": " + path;
+    discard();
+    return false;
+  }
+
+  setp(buffer_, buffer_ + kBufferSize);
+  return true;
+}
+
+bool FileSink::commit(std::string &error) {
+  if (fd_ < 0) {
+    error = "Output file is not open: " + path_;
+    return false;
+  }
+  flushBuffer();
+  if (compressor_.active()) {
+    // End the compressed stream
+    writeOut(nullptr, 0, true);
+    compressor_.end();
+  }
+  if (::close(fd_) != 0 && !failed_) {
+    failed_ = true;
+    errno_ = errno;
+  }
+  fd_ = -1;
+
+  if (failed_) {
+    error = errnoMessage("Failed to write output file", path_, errno_);
+    discard();
+    return false;
+  }
+  if (!tempPath_.empty() &&
+      std::rename(tempPath_.c_str(), path_.c_str()) != 0) {
+    error = errnoMessage("Cannot replace output file", path_, errno);
+    discard();
+    return false;
+  }
+  tempPath_.clear();
+  return true;
+}
+
+void FileSink::discard() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  if (!tempPath_.empty()) {
+    ::unlink(tempPath_.c_str());
+    tempPath_.clear();
+  }
+  compressor_.end();
+  compressed_.clear();
+  setp(nullptr, nullptr);
+}
+
+FileSink::int_type FileSink::overflow(int_type ch) {
+  if (fd_ < 0 || !flushBuffer()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+std::streamsize FileSink::xsputn(const char *s, std::streamsize n) {
+  if (fd_ < 0) {
+    return 0;
+  }
+  size_t size = static_cast<size_t>(n);
+  size_t room = static_cast<size_t>(epptr() - pptr());
+  if (size <= room) {
+    std::memcpy(pptr(), s, size);
+    pbump(static_cast<int>(size));
+    return n;
+  }
+  // Large writes bypass the buffer instead of being copied through it
+  if (!flushBuffer()) {
+    return 0;
+  }
+  if (size >= kBufferSize) {
+    return writeOut(s, size) ? n : 0;
+  }
+  std::memcpy(pptr(), s, size);
+  pbump(static_cast<int>(size));
+  return n;
+}
+
+int FileSink::sync() { return flushBuffer() ? 0 : -1; }
+
+bool FileSink::flushBuffer() {
+  size_t pending = static_cast<size_t>(pptr() - pbase());
+  if (pending == 0) {
+    return !failed_;
+  }
+  bool ok = writeOut(pbase(), pending);
+  setp(buffer_, buffer_ + kBufferSize);
+  return ok;
+}
+
+bool FileSink::writeOut(const char *data, size_t size, bool finish) {
+  bytes_ += size;
+  if (!compressor_.active()) {
+    return writeAll(data, size);
+  }
+  if (failed_) {
+    return false;
+  }
+  compressed_.clear();
+  if (!compressor_.compress({data, size}, finish, compressed_)) {
+    failed_ = true;
+    errno_ = ENOMEM;
+    return false;
+  }
+  return writeAll(compressed_.data(), compressed_.size());
+}
+
+bool FileSink::writeAll(const char *data, size_t size) {
+  if (failed_) {
+    return false;
+  }
+  while (size > 0) {
+    ssize_t written = ::write(fd_, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      failed_ = true;
+      errno_ = errno;
+      return false;
+    }
+    bytesWritten_ += static_cast<size_t>(written);
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
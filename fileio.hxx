@@ -0,0 +1,116 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include "compression.hxx"
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole input file. Pipes and devices, which
+// cannot be mapped, are read into memory instead.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Map the file; any previous mapping is released first
+  bool open(const std::string &path, std::string &error);
+
+  // Release the mapping
+  void close();
+
+  // Contents of the mapped file (valid until close())
+  std::string_view view() const { return {data_, size_}; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string contents_; // Contents of an input that is not a regular file
+};
+
+// Whole input file: mapped as it is, or decompressed into memory if it
+// starts with the magic bytes of gzip or zstd data
+class InputFile {
+public:
+  // Read the file; any previous one is released first
+  bool open(const std::string &path, std::string &error);
+
+  // Release the file
+  void close();
+
+  // Contents of the file, decompressed (valid until close())
+  std::string_view view() const {
+    return compression_ == Compression::None ? file_.view()
+                                             : std::string_view(contents_);
+  }
+
+  // Compression the file was stored with
+  Compression compression() const { return compression_; }
+
+  // Size of the file as stored, compressed or not
+  size_t storedSize() const { return storedSize_; }
+
+private:
+  MappedFile file_;
+  std::string contents_; // Decompressed contents
+  Compression compression_ = Compression::None;
+  size_t storedSize_ = 0;
+};
+
+// Buffered output file written to a temporary file next to the target and
+// renamed over it on commit(), so readers never see a partial file. A target
+// that exists and is not a regular file, such as /dev/stdout or a pipe, is
+// written directly. A target ending in .gz or .zst is compressed as it is
+// written.
+class FileSink : public std::streambuf {
+public:
+  FileSink() = default;
+  ~FileSink() override;
+
+  FileSink(const FileSink &) = delete;
+  FileSink &operator=(const FileSink &) = delete;
+
+  // Create the temporary file for the given target path, or open the target
+  // itself if it is not a regular file
+  bool open(const std::string &path, std::string &error);
+
+  // Flush, close and move the temporary file into place
+  bool commit(std::string &error);
+
+  // Remove the temporary file without touching the target
+  void discard();
+
+  // Bytes written to the sink, and to the file after compression
+  size_t bytes() const { return bytes_; }
+  size_t bytesWritten() const { return bytesWritten_; }
+
+protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+  int sync() override;
+
+private:
+  static constexpr size_t kBufferSize = 64 * 1024;
+
+  bool flushBuffer();
+  bool writeOut(const char *data, size_t size, bool finish = false);
+  bool writeAll(const char *data, size_t size);
+
+  int fd_ = -1;
+  bool failed_ = false;
+  size_t bytes_ = 0;
+  size_t bytesWritten_ = 0;
+  int errno_ = 0;
+  std::string path_;
+  std::string tempPath_; // Empty when writing the target directly
+  Compressor compressor_;
+  std::string compressed_; // Output of the compressor, until written
+  char buffer_[kBufferSize];
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "grammar_cache.hxx"
+#include "fileio.hxx"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+#ifndef TM2VIM_VERSION
+#define TM2VIM_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Raise whenever the layout or the translation of regexes changes
+constexpr uint32_t kCacheFormat = 1;
+
+constexpr char kCacheMagic[8] = {'T', 'M', '2', 'V', 'G', 'C', '\0', '\0'};
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+static_assert(std::is_trivially_copyable_v<PatternRecord> &&
+                  std::is_trivially_copyable_v<CaptureRecord> &&
+                  std::is_trivially_copyable_v<RuleRecord> &&
+                  std::is_trivially_copyable_v<TranslatedRegex>,
+              "cached arrays are copied as bytes");
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t format;
+  uint32_t byteOrder;
+  uint64_t key;
+  uint64_t rulesSkipped;
+  uint64_t bytesSkipped;
+  IndexRange patterns;
+  uint32_t nameLength;
+  uint32_t scopeNameLength;
+  uint32_t records;
+  uint32_t children;
+  uint32_t captures;
+  uint32_t rules;
+  uint32_t translations;
+  uint32_t reserved;
+  uint64_t strings;
+};
+
+// Sections follow the header in this order, each aligned to 8 bytes
+enum Section {
+  kSectionName,
+  kSectionScopeName,
+  kSectionRecords,
+  kSectionChildren,
+  kSectionCaptures,
+  kSectionRules,
+  kSectionTranslations,
+  kSectionStrings,
+  kSectionCount
+};
+
+struct Layout {
+  size_t offset[kSectionCount];
+  size_t size[kSectionCount];
+  size_t total;
+};
+
+size_t align(size_t offset) { return (offset + 7) & ~size_t(7); }
+
+Layout layoutOf(const CacheHeader &header) {
+  Layout layout;
+  layout.size[kSectionName] = header.nameLength;
+  layout.size[kSectionScopeName] = header.scopeNameLength;
+  layout.size[kSectionRecords] =
+      size_t(header.records) * sizeof(PatternRecord);
+  layout.size[kSectionChildren] = size_t(header.children) * sizeof(uint32_t);
+  layout.size[kSectionCaptures] =
+      size_t(header.captures) * sizeof(CaptureRecord);
+  layout.size[kSectionRules] = size_t(header.rules) * sizeof(RuleRecord);
+  layout.size[kSectionTranslations] =
+      size_t(header.translations) * sizeof(TranslatedRegex);
+  layout.size[kSectionStrings] = header.strings;
+  size_t offset = align(sizeof(CacheHeader));
+  for (int i = 0; i < kSectionCount; ++i) {
+    layout.offset[i] = offset;
+    offset = align(offset + layout.size[i]);
+  }
+  layout.total = offset;
+  return layout;
+}
+
+uint64_t fnv1a(uint64_t hash, std::string_view bytes) {
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string_view sectionOf(std::string_view data, const Layout &layout,
+                           Section section) {
+  return data.substr(layout.offset[section], layout.size[section]);
+}
+
+template <typename T>
+void copySection(std::pmr::vector<T> &out, std::string_view data,
+                 const Layout &layout, Section section) {
+  out.resize(layout.size[section] / sizeof(T));
+  if (!out.empty()) {
+    std::memcpy(out.data(), data.data() + layout.offset[section],
+                layout.size[section]);
+  }
+}
+
+// Whether every index and string span of a loaded grammar is in bounds, so
+// a damaged entry cannot make the converter read outside the arrays
+bool validGrammar(const TextMateGrammar &grammar) {
+  const PatternStore &store = grammar.store;
+  auto validString = [&store](StringRef ref) {
+    return size_t(ref.offset) + ref.length <= store.strings.size();
+  };
+  auto validRange = [](IndexRange range, size_t size) {
+    return size_t(range.first) + range.count <= size;
+  };
+  if (!validRange(grammar.patterns, store.children.size())) {
+    return false;
+  }
+  for (uint32_t child : store.children) {
+    if (child >= store.records.size()) {
+      return false;
+    }
+  }
+  for (const PatternRecord &record : store.records) {
+    for (StringRef ref : {record.name, record.match, record.begin, record.end,
+                          record.include}) {
+      if (!validString(ref)) {
+        return false;
+      }
+    }
+    if (!validRange(record.children, store.children.size())) {
+      return false;
+    }
+    for (const IndexRange &range : record.captures) {
+      if (!validRange(range, store.captures.size())) {
+        return false;
+      }
+    }
+  }
+  for (const CaptureRecord &capture : store.captures) {
+    if (!validString(capture.key) || !validString(capture.name)) {
+      return false;
+    }
+  }
+  for (const RuleRecord &rule : grammar.repository.rules) {
+    if (!validString(rule.name) || rule.pattern >= store.records.size()) {
+      return false;
+    }
+  }
+  if (store.translations.size() != store.records.size() * kRegexFields) {
+    return false;
+  }
+  for (const TranslatedRegex &translation : store.translations) {
+    if (!validString(translation.vim) ||
+        static_cast<uint8_t>(translation.engine) > 2) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+uint64_t grammarCacheKey(std::string_view input, bool reachableOnly) {
+  uint64_t hash = fnv1a(0xcbf29ce484222325ULL, input);
+  hash = fnv1a(hash, TM2VIM_VERSION);
+  char options[] = {static_cast<char>(kCacheFormat),
+                    static_cast<char>(reachableOnly)};
+  return fnv1a(hash, std::string_view(options, sizeof(options)));
+}
+
+std::string grammarCachePath(const std::string &dir, uint64_t key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tm2vc",
+                static_cast<unsigned long long>(key));
+  return (fs::path(dir) / name).string();
+}
+
+bool loadGrammarCache(const std::string &path, uint64_t key,
+                      TextMateGrammar &grammar, ReachabilityStats &stats) {
+  MappedFile file;
+  std::string error;
+  if (!file.open(path, error)) {
+    return false;
+  }
+  std::string_view data = file.view();
+  CacheHeader header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.format != kCacheFormat || header.byteOrder != kByteOrderMark ||
+      header.key != key) {
+    return false;
+  }
+  Layout layout = layoutOf(header);
+  if (layout.total != data.size()) {
+    return false;
+  }
+
+  PatternStore &store = grammar.store;
+  grammar.name.assign(sectionOf(data, layout, kSectionName));
+  grammar.scopeName.assign(sectionOf(data, layout, kSectionScopeName));
+  grammar.patterns = header.patterns;
+  copySection(store.records, data, layout, kSectionRecords);
+  copySection(store.children, data, layout, kSectionChildren);
+  copySection(store.captures, data, layout, kSectionCaptures);
+  copySection(grammar.repository.rules, data, layout, kSectionRules);
+  copySection(store.translations, data, layout, kSectionTranslations);
+  store.strings.assign(sectionOf(data, layout, kSectionStrings));
+
+  if (!validGrammar(grammar)) {
+    grammar.clear();
+    return false;
+  }
+  stats.rulesSkipped = header.rulesSkipped;
+  stats.bytesSkipped = header.bytesSkipped;
+  return true;
+}
+
+bool saveGrammarCache(const std::string &path, uint64_t key,
+                      const TextMateGrammar &grammar,
+                      const ReachabilityStats &stats, std::string &error) {
+  const PatternStore &store = grammar.store;
+  CacheHeader header{};
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.format = kCacheFormat;
+  header.byteOrder = kByteOrderMark;
+  header.key = key;
+  header.rulesSkipped = stats.rulesSkipped;
+  header.bytesSkipped = stats.bytesSkipped;
+  header.patterns = grammar.patterns;
+  header.nameLength = static_cast<uint32_t>(grammar.name.size());
+  header.scopeNameLength = static_cast<uint32_t>(grammar.scopeName.size());
+  header.records = static_cast<uint32_t>(store.records.size());
+  header.children = static_cast<uint32_t>(store.children.size());
+  header.captures = static_cast<uint32_t>(store.captures.size());
+  header.rules = static_cast<uint32_t>(grammar.repository.rules.size());
+  header.translations = static_cast<uint32_t>(store.translations.size());
+  header.strings = store.strings.size();
+  Layout layout = layoutOf(header);
+
+  const void *sections[kSectionCount] = {
+      grammar.name.data(),       grammar.scopeName.data(),
+      store.records.data(),      store.children.data(),
+      store.captures.data(),     grammar.repository.rules.data(),
+      store.translations.data(), store.strings.data()};
+
+  std::error_code ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+  FileSink sink;
+  if (!sink.open(path, error)) {
+    return false;
+  }
+  static const char padding[8] = {};
+  size_t written = 0;
+  auto write = [&](const void *bytes, size_t size) {
+    if (size == 0) {
+      return;
+    }
+    sink.sputn(static_cast<const char *>(bytes),
+               static_cast<std::streamsize>(size));
+    written += size;
+  };
+  write(&header, sizeof(header));
+  for (int i = 0; i < kSectionCount; ++i) {
+    write(padding, layout.offset[i] - written);
+    write(sections[i], layout.size[i]);
+  }
+  write(padding, layout.total - written);
+  return sink.commit(error);
+}
@@ -0,0 +1,34 @@
+#ifndef GRAMMAR_CACHE_H
+#define GRAMMAR_CACHE_H
+
+#include "tmlanguage2vimsyntax.hxx"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// On-disk cache of parsed grammars. An entry holds the flat PatternStore of
+// a grammar, with the Vim translation of every regex, in the layout of the
+// in-memory arrays, so a warm run maps the file and copies the arrays out
+// instead of parsing JSON. Entries are native-endian and only read by the
+// build that wrote them.
+
+// Key of the entry for a grammar: a hash of the input bytes, the tool
+// version, the cache format and the options the parse depends on
+uint64_t grammarCacheKey(std::string_view input, bool reachableOnly);
+
+// Path of the entry for a key in a cache directory
+std::string grammarCachePath(const std::string &dir, uint64_t key);
+
+// Load an entry into an empty grammar. Returns false if there is no usable
+// entry; the grammar is then left empty.
+bool loadGrammarCache(const std::string &path, uint64_t key,
+                      TextMateGrammar &grammar, ReachabilityStats &stats);
+
+// Write an entry for a grammar whose regexes have all been translated,
+// creating the directory if needed; an existing entry is replaced
+// atomically
+bool saveGrammarCache(const std::string &path, uint64_t key,
+                      const TextMateGrammar &grammar,
+                      const ReachabilityStats &stats, std::string &error);
+
+#endif
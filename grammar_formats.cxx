@@ -0,0 +1,170 @@
+#include "grammar_formats.hxx"
+#include "plist_reader.hxx"
+#include "yaml_reader.hxx"
+
+namespace {
+
+// SAX handler that reads the top-level "scopeName" of a grammar and stops
+// reading as soon as it has it
+class ScopeNameReader final : public GrammarSax {
+public:
+  using json = nlohmann::json;
+
+  const std::string &scopeName() const { return scopeName_; }
+
+  bool null() override { return value(); }
+  bool boolean(bool) override { return value(); }
+  bool number_integer(json::number_integer_t) override { return value(); }
+  bool number_unsigned(json::number_unsigned_t) override { return value(); }
+  bool number_float(json::number_float_t, const json::string_t &) override {
+    return value();
+  }
+  bool string(json::string_t &value) override {
+    if (inScopeName_) {
+      scopeName_ = std::move(value);
+      return false;
+    }
+    return true;
+  }
+  bool binary(json::binary_t &) override { return value(); }
+  bool start_object(std::size_t) override {
+    depth_++;
+    return value();
+  }
+  bool key(json::string_t &key) override {
+    inScopeName_ = depth_ == 1 && key == "scopeName";
+    return true;
+  }
+  bool end_object() override {
+    depth_--;
+    return true;
+  }
+  bool start_array(std::size_t) override {
+    depth_++;
+    return value();
+  }
+  bool end_array() override {
+    depth_--;
+    return true;
+  }
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &) override {
+    return false;
+  }
+
+private:
+  std::string scopeName_;
+  int depth_ = 0;
+  bool inScopeName_ = false; // The next value is that of "scopeName"
+
+  // A value other than a string ends a "scopeName" key
+  bool value() {
+    inScopeName_ = false;
+    return true;
+  }
+};
+
+size_t skipSpace(std::string_view text, size_t pos) {
+  while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                               text[pos] == '\n' || text[pos] == '\r')) {
+    pos++;
+  }
+  return pos;
+}
+
+// File name without its grammar extension and any .gz or .zst after it,
+// with the grammar extension it had
+std::string splitGrammarFileName(const std::string &fileName,
+                                 std::string_view &extension) {
+  // Compressed grammars are read like the others
+  std::string name = fileName;
+  for (const char *ext : {".gz", ".zst"}) {
+    std::string suffix = ext;
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      name.resize(name.size() - suffix.size());
+      break;
+    }
+  }
+
+  // Longer extensions first, so that ".json" does not cut
+  // "Go.tmLanguage.json" short
+  for (std::string_view suffix :
+       {".tmLanguage.json", ".tmGrammar.json", ".tmLanguage.yaml",
+        ".tmLanguage.yml", ".YAML-tmLanguage", ".tmLanguage", ".json"}) {
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      extension = suffix;
+      return name.substr(0, name.size() - suffix.size());
+    }
+  }
+  return "";
+}
+
+} // namespace
+
+GrammarFormat detectGrammarFormat(std::string_view text) {
+  size_t pos = skipSpace(text, text.substr(0, 3) == "\xEF\xBB\xBF" ? 3 : 0);
+  if (pos < text.size() && text[pos] == '<') {
+    return GrammarFormat::Plist;
+  }
+  if (pos < text.size() && text[pos] == '[') {
+    return GrammarFormat::Json;
+  }
+  // A YAML flow mapping starts with '{' too, but its keys are rarely quoted
+  if (pos < text.size() && text[pos] == '{') {
+    size_t next = skipSpace(text, pos + 1);
+    if (next >= text.size() || text[next] == '"' || text[next] == '}') {
+      return GrammarFormat::Json;
+    }
+  }
+  return GrammarFormat::Yaml;
+}
+
+bool readGrammar(std::string_view text, GrammarSax &sax, std::string &error) {
+  switch (detectGrammarFormat(text)) {
+  case GrammarFormat::Json:
+    return nlohmann::json::sax_parse(text.begin(), text.end(), &sax);
+  case GrammarFormat::Plist:
+    return readPlist(text, sax, error);
+  case GrammarFormat::Yaml:
+    return readYaml(text, sax, error);
+  }
+  return false;
+}
+
+std::string grammarScopeName(std::string_view text) {
+  ScopeNameReader reader;
+  std::string error;
+  readGrammar(text, reader, error);
+  return reader.scopeName();
+}
+
+std::string grammarFileStem(const std::string &fileName) {
+  std::string_view extension;
+  return splitGrammarFileName(fileName, extension);
+}
+
+bool hasGenericGrammarExtension(const std::string &fileName) {
+  std::string_view extension;
+  return !splitGrammarFileName(fileName, extension).empty() &&
+         extension == ".json";
+}
+
+void appendUtf8(std::string &out, uint32_t codePoint) {
+  if (codePoint < 0x80) {
+    out += static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    out += static_cast<char>(0xC0 | (codePoint >> 6));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    out += static_cast<char>(0xE0 | (codePoint >> 12));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (codePoint >> 18));
+    out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+}
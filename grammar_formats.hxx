@@ -0,0 +1,46 @@
+#ifndef GRAMMAR_FORMATS_H
+#define GRAMMAR_FORMATS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+// Receives the values of a grammar as nlohmann::json SAX events, whatever
+// the format it is read from
+using GrammarSax = nlohmann::json_sax<nlohmann::json>;
+
+// Formats a TextMate grammar can be written in
+enum class GrammarFormat {
+  Json,  // .tmLanguage.json
+  Plist, // .tmLanguage (XML property list)
+  Yaml   // .tmLanguage.yaml, .YAML-tmLanguage
+};
+
+// Format of a grammar, told from how it starts: '<' for a property list,
+// '[' or '{' followed by a quoted key for JSON, anything else for YAML
+GrammarFormat detectGrammarFormat(std::string_view text);
+
+// Read a grammar in any format, reporting its values to `sax` as they are
+// read. Returns false if the handler stops reading, or with `error` set if
+// the input is malformed; JSON syntax errors go to the handler's
+// parse_error() instead, as with nlohmann::json::sax_parse().
+bool readGrammar(std::string_view text, GrammarSax &sax, std::string &error);
+
+// Top-level "scopeName" of a grammar, read only as far as needed (empty if
+// it has none or is malformed)
+std::string grammarScopeName(std::string_view text);
+
+// File name without its grammar extension and any .gz or .zst after it
+// ("Go.tmLanguage.json.gz" -> "Go"), or "" if it does not have one
+std::string grammarFileStem(const std::string &fileName);
+
+// Whether a grammar file name has no extension but ".json", which it shares
+// with package.json and the other JSON files of an editor extension
+bool hasGenericGrammarExtension(const std::string &fileName);
+
+// Append a code point to a string as UTF-8
+void appendUtf8(std::string &out, uint32_t codePoint);
+
+#endif
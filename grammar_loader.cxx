@@ -0,0 +1,635 @@
+#include "grammar_loader.hxx"
+#include <algorithm>
+#include <string>
+
+GrammarSaxHandler::GrammarSaxHandler(TextMateGrammar &grammar,
+                                     bool deferRepository)
+    : grammar_(grammar), deferRepository_(deferRepository),
+      initialPatterns_(grammar.patterns) {}
+
+void GrammarSaxHandler::beginRule(std::string_view name) {
+  // The rule is parsed as if it were the next key of a repository object
+  stack_.assign(1, {Frame::Repository});
+  skipDepth_ = 0;
+  field_ = Field::RepositoryRule;
+  fieldKey_ = name;
+}
+
+bool GrammarSaxHandler::null() { return scalar(nullptr, "null"); }
+
+bool GrammarSaxHandler::boolean(bool) { return scalar(nullptr, "boolean"); }
+
+bool GrammarSaxHandler::number_integer(json::number_integer_t) {
+  return scalar(nullptr, "number");
+}
+
+bool GrammarSaxHandler::number_unsigned(json::number_unsigned_t) {
+  return scalar(nullptr, "number");
+}
+
+bool GrammarSaxHandler::number_float(json::number_float_t,
+                                     const json::string_t &) {
+  return scalar(nullptr, "number");
+}
+
+bool GrammarSaxHandler::string(json::string_t &value) {
+  return scalar(&value, "string");
+}
+
+bool GrammarSaxHandler::binary(json::binary_t &) {
+  return scalar(nullptr, "binary");
+}
+
+bool GrammarSaxHandler::start_object(std::size_t) { return open(true); }
+
+bool GrammarSaxHandler::start_array(std::size_t) { return open(false); }
+
+bool GrammarSaxHandler::end_object() { return close(); }
+
+bool GrammarSaxHandler::end_array() { return close(); }
+
+bool GrammarSaxHandler::key(json::string_t &key) {
+  if (skipDepth_ > 0 || stack_.empty()) {
+    return true;
+  }
+
+  field_ = Field::None;
+  switch (stack_.back().frame) {
+  case Frame::Root:
+    if (key == "name") {
+      field_ = Field::GrammarName;
+    } else if (key == "scopeName") {
+      field_ = Field::ScopeName;
+    } else if (key == "patterns") {
+      field_ = Field::Patterns;
+    } else if (key == "repository") {
+      field_ = Field::Repository;
+    }
+    break;
+  case Frame::Pattern:
+    if (key == "name") {
+      field_ = Field::Name;
+    } else if (key == "match") {
+      field_ = Field::Match;
+    } else if (key == "begin") {
+      field_ = Field::Begin;
+    } else if (key == "end") {
+      field_ = Field::End;
+    } else if (key == "include") {
+      field_ = Field::Include;
+    } else if (key == "patterns") {
+      field_ = Field::Patterns;
+    } else if (key == "captures") {
+      field_ = Field::Captures;
+    } else if (key == "beginCaptures") {
+      field_ = Field::BeginCaptures;
+    } else if (key == "endCaptures") {
+      field_ = Field::EndCaptures;
+    }
+    break;
+  case Frame::Repository:
+    field_ = Field::RepositoryRule;
+    break;
+  case Frame::CaptureTable:
+    field_ = Field::CaptureEntry;
+    break;
+  case Frame::Capture:
+    if (key == "name") {
+      field_ = Field::CaptureName;
+    }
+    break;
+  case Frame::PatternList:
+    break;
+  }
+  fieldKey_ = std::move(key);
+  return true;
+}
+
+bool GrammarSaxHandler::parse_error(std::size_t, const std::string &,
+                                    const nlohmann::detail::exception &ex) {
+  error_ = "JSON parse error: " + std::string(ex.what());
+  return false;
+}
+
+bool GrammarSaxHandler::scalar(json::string_t *value, const char *type) {
+  if (skipDepth_ > 0 || stack_.empty()) {
+    return true;
+  }
+
+  Field field = field_;
+  field_ = Field::None;
+  Context &top = stack_.back();
+  if (top.frame == Frame::CaptureTable && top.isArray) {
+    top.index++;
+  }
+
+  PatternStore &store = grammar_.store;
+  std::string *target = nullptr;
+  StringRef *ref = nullptr;
+  switch (field) {
+  case Field::GrammarName:
+    target = &grammar_.name;
+    break;
+  case Field::ScopeName:
+    target = &grammar_.scopeName;
+    break;
+  case Field::Name:
+    ref = &store.records[top.pattern].name;
+    break;
+  case Field::Match:
+    ref = &store.records[top.pattern].match;
+    break;
+  case Field::Begin:
+    ref = &store.records[top.pattern].begin;
+    break;
+  case Field::End:
+    ref = &store.records[top.pattern].end;
+    break;
+  case Field::Include:
+    ref = &store.records[top.pattern].include;
+    break;
+  case Field::CaptureName:
+    if (value) {
+      store.captures.push_back(
+          {store.addString(captureKey_), store.addString(*value)});
+      return true;
+    }
+    break;
+  case Field::RepositoryRule:
+    grammar_.repository.rules.push_back(
+        {store.addString(fieldKey_), addRecord()});
+    return true;
+  default:
+    // Scalars where a list or table is expected carry nothing to convert
+    return true;
+  }
+
+  if (!value) {
+    error_ = "Invalid grammar: \"" + fieldKey_ + "\" must be a string, but is " +
+             type;
+    return false;
+  }
+  if (target) {
+    *target = std::move(*value);
+  } else {
+    *ref = store.addString(*value);
+  }
+  return true;
+}
+
+bool GrammarSaxHandler::open(bool isObject) {
+  if (skipDepth_ > 0) {
+    skipDepth_++;
+    return true;
+  }
+
+  Field field = field_;
+  field_ = Field::None;
+
+  // The top-level value has to be the grammar object
+  if (stack_.empty()) {
+    if (isObject) {
+      stack_.push_back({Frame::Root});
+    } else {
+      skipDepth_++;
+    }
+    return true;
+  }
+
+  PatternStore &store = grammar_.store;
+  Context top = stack_.back();
+  Context next{Frame::Root};
+  bool used = false;
+
+  switch (top.frame) {
+  case Frame::PatternList:
+    if (isObject) {
+      next = {Frame::Pattern, addRecord()};
+      pendingChildren_.push_back(next.pattern);
+      used = true;
+    }
+    break;
+  case Frame::Repository:
+    if (field == Field::RepositoryRule) {
+      // Rules that are not objects still exist, just without patterns
+      uint32_t rule = addRecord();
+      grammar_.repository.rules.push_back({store.addString(fieldKey_), rule});
+      if (isObject) {
+        next = {Frame::Pattern, rule};
+        used = true;
+      }
+    }
+    break;
+  case Frame::CaptureTable:
+    if (top.isArray) {
+      captureKey_ = std::to_string(stack_.back().index++);
+    } else {
+      captureKey_ = fieldKey_;
+    }
+    if (isObject) {
+      next = {Frame::Capture, top.pattern};
+      next.table = top.table;
+      used = true;
+    }
+    break;
+  case Frame::Root:
+  case Frame::Pattern:
+  case Frame::Capture:
+    if (field == Field::Patterns && !isObject) {
+      next = {Frame::PatternList, top.pattern, pendingChildren_.size()};
+      used = true;
+    } else if (field == Field::Repository && isObject && !deferRepository_) {
+      next = {Frame::Repository};
+      used = true;
+    } else if (field == Field::Captures || field == Field::BeginCaptures ||
+               field == Field::EndCaptures) {
+      next = {Frame::CaptureTable, top.pattern, store.captures.size()};
+      next.table = field == Field::Captures        ? kCaptures
+                   : field == Field::BeginCaptures ? kBeginCaptures
+                                                   : kEndCaptures;
+      next.isArray = !isObject;
+      used = true;
+    }
+    break;
+  }
+
+  if (used) {
+    stack_.push_back(next);
+  } else {
+    skipDepth_++;
+  }
+  return true;
+}
+
+bool GrammarSaxHandler::close() {
+  if (skipDepth_ > 0) {
+    skipDepth_--;
+    return true;
+  }
+  if (stack_.empty()) {
+    return true;
+  }
+
+  Context context = stack_.back();
+  stack_.pop_back();
+  switch (context.frame) {
+  case Frame::PatternList:
+    finishPatternList(context);
+    break;
+  case Frame::CaptureTable:
+    finishCaptureTable(context);
+    break;
+  case Frame::Repository:
+    finishRepository();
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+uint32_t GrammarSaxHandler::addRecord() {
+  auto &records = grammar_.store.records;
+  records.emplace_back();
+  return static_cast<uint32_t>(records.size() - 1);
+}
+
+void GrammarSaxHandler::finishPatternList(const Context &context) {
+  PatternStore &store = grammar_.store;
+  auto &children = store.children;
+  // Children of one list have to be contiguous. A repeated "patterns" key
+  // replaces the earlier list, but top-level patterns of a previously parsed
+  // grammar are kept in front.
+  IndexRange previous =
+      context.pattern == kRoot ? initialPatterns_ : IndexRange{};
+  IndexRange replaced = context.pattern == kRoot
+                            ? grammar_.patterns
+                            : store.records[context.pattern].children;
+  for (uint32_t i = previous.count; i < replaced.count; ++i) {
+    markDead(children[replaced.first + i]);
+  }
+
+  uint32_t first = static_cast<uint32_t>(children.size());
+  for (uint32_t i = 0; i < previous.count; ++i) {
+    uint32_t child = children[previous.first + i];
+    children.push_back(child);
+  }
+  children.insert(children.end(), pendingChildren_.begin() + context.start,
+                  pendingChildren_.end());
+  pendingChildren_.resize(context.start);
+
+  IndexRange range{first, static_cast<uint32_t>(children.size()) - first};
+  if (context.pattern == kRoot) {
+    grammar_.patterns = range;
+  } else {
+    store.records[context.pattern].children = range;
+  }
+}
+
+void GrammarSaxHandler::finishCaptureTable(const Context &context) {
+  PatternStore &store = grammar_.store;
+  auto &captures = store.captures;
+  auto keyLess = [&store](const CaptureRecord &a, const CaptureRecord &b) {
+    return store.str(a.key) < store.str(b.key);
+  };
+  std::stable_sort(captures.begin() + context.start, captures.end(), keyLess);
+
+  // Keep the last entry for each group number, as a JSON object would
+  size_t out = context.start;
+  for (size_t i = context.start; i < captures.size(); ++i) {
+    if (i + 1 < captures.size() &&
+        store.str(captures[i].key) == store.str(captures[i + 1].key)) {
+      continue;
+    }
+    captures[out++] = captures[i];
+  }
+  captures.resize(out);
+
+  store.records[context.pattern].captures[context.table] = {
+      static_cast<uint32_t>(context.start),
+      static_cast<uint32_t>(out - context.start)};
+}
+
+void GrammarSaxHandler::finishRepository() {
+  PatternStore &store = grammar_.store;
+  auto &rules = grammar_.repository.rules;
+  std::stable_sort(rules.begin(), rules.end(),
+                   [&store](const RuleRecord &a, const RuleRecord &b) {
+                     return store.str(a.name) < store.str(b.name);
+                   });
+
+  size_t out = 0;
+  std::vector<uint32_t> dead;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (i + 1 < rules.size() &&
+        store.str(rules[i].name) == store.str(rules[i + 1].name)) {
+      dead.push_back(rules[i].pattern);
+      continue;
+    }
+    rules[out++] = rules[i];
+  }
+  rules.resize(out);
+
+  // Replaced rules stay in the store but must not contribute syntax groups
+  for (uint32_t pattern : dead) {
+    markDead(pattern);
+  }
+}
+
+void GrammarSaxHandler::dropUnreachableRules(ReachabilityStats &stats) {
+  PatternStore &store = grammar_.store;
+  auto &rules = grammar_.repository.rules;
+  std::vector<bool> reached(rules.size(), false);
+  std::vector<uint32_t> pending;
+  for (uint32_t i = 0; i < grammar_.patterns.count; ++i) {
+    pending.push_back(store.children[grammar_.patterns.first + i]);
+  }
+  while (!pending.empty()) {
+    const PatternRecord &record = store.records[pending.back()];
+    pending.pop_back();
+    if (!record.live) {
+      continue;
+    }
+    for (uint32_t i = 0; i < record.children.count; ++i) {
+      pending.push_back(store.children[record.children.first + i]);
+    }
+    std::string_view include = store.str(record.include);
+    if (include.size() < 2 || include[0] != '#') {
+      continue;
+    }
+    const RuleRecord *rule = grammar_.findRule(include.substr(1));
+    if (rule && !reached[rule - rules.data()]) {
+      reached[rule - rules.data()] = true;
+      pending.push_back(rule->pattern);
+    }
+  }
+
+  size_t out = 0;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (reached[i]) {
+      rules[out++] = rules[i];
+    } else {
+      markDead(rules[i].pattern);
+      stats.rulesSkipped++;
+    }
+  }
+  rules.resize(out);
+}
+
+void GrammarSaxHandler::markDead(uint32_t pattern) {
+  PatternStore &store = grammar_.store;
+  std::vector<uint32_t> pending{pattern};
+  while (!pending.empty()) {
+    PatternRecord &record = store.records[pending.back()];
+    pending.pop_back();
+    record.live = false;
+    for (uint32_t i = 0; i < record.children.count; ++i) {
+      pending.push_back(store.children[record.children.first + i]);
+    }
+  }
+}
+
+namespace {
+
+size_t skipSpace(std::string_view json, size_t pos) {
+  while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\t' ||
+                               json[pos] == '\n' || json[pos] == '\r')) {
+    pos++;
+  }
+  return pos;
+}
+
+// Position after the string starting at pos
+size_t skipString(std::string_view json, size_t pos) {
+  for (pos++; pos < json.size() && json[pos] != '"'; pos++) {
+    if (json[pos] == '\\') {
+      pos++;
+    }
+  }
+  return std::min(pos + 1, json.size());
+}
+
+// Position after the value starting at pos
+size_t skipValue(std::string_view json, size_t pos) {
+  if (pos >= json.size()) {
+    return pos;
+  }
+  if (json[pos] == '"') {
+    return skipString(json, pos);
+  }
+  if (json[pos] != '{' && json[pos] != '[') {
+    while (pos < json.size() && json[pos] != ',' && json[pos] != '}' &&
+           json[pos] != ']' && json[pos] != ' ' && json[pos] != '\t' &&
+           json[pos] != '\n' && json[pos] != '\r') {
+      pos++;
+    }
+    return pos;
+  }
+  size_t depth = 0;
+  while (pos < json.size()) {
+    char c = json[pos];
+    if (c == '"') {
+      pos = skipString(json, pos);
+      continue;
+    }
+    pos++;
+    if (c == '{' || c == '[') {
+      depth++;
+    } else if ((c == '}' || c == ']') && --depth == 0) {
+      break;
+    }
+  }
+  return pos;
+}
+
+// Decoded text of the string token json[pos, end)
+std::string decodeString(std::string_view json, size_t pos, size_t end) {
+  std::string_view token = json.substr(pos, end - pos);
+  if (token.find('\\') == std::string_view::npos) {
+    return std::string(token.substr(1, token.size() - 2));
+  }
+  return nlohmann::json::parse(token).get<std::string>();
+}
+
+// Call visit(key, valueOffset) for every member of the object at pos and
+// return the position after it
+template <typename Visit>
+size_t forEachMember(std::string_view json, size_t pos, Visit visit) {
+  pos = skipSpace(json, pos + 1);
+  while (pos < json.size() && json[pos] == '"') {
+    size_t keyEnd = skipString(json, pos);
+    std::string key = decodeString(json, pos, keyEnd);
+    pos = skipSpace(json, keyEnd);
+    pos = skipSpace(json, pos + 1); // ':'
+    size_t valueEnd = skipValue(json, pos);
+    visit(key, pos, valueEnd);
+    pos = skipSpace(json, valueEnd);
+    if (pos < json.size() && json[pos] == ',') {
+      pos = skipSpace(json, pos + 1);
+    }
+  }
+  return pos + 1;
+}
+
+// Read a grammar in any format into a handler
+bool readInto(GrammarSaxHandler &handler, std::string_view text,
+              std::string &error) {
+  if (readGrammar(text, handler, error)) {
+    return true;
+  }
+  // Errors of the JSON parser and of the grammar itself are the handler's
+  if (!handler.error().empty()) {
+    error = handler.error();
+  }
+  return false;
+}
+
+} // namespace
+
+std::vector<RuleSpan> findRepositoryRules(std::string_view json) {
+  std::vector<RuleSpan> rules;
+  size_t pos = skipSpace(json, json.substr(0, 3) == "\xEF\xBB\xBF" ? 3 : 0);
+  if (pos >= json.size() || json[pos] != '{') {
+    return rules;
+  }
+  forEachMember(json, pos, [&](const std::string &key, size_t value, size_t) {
+    if (key != "repository" || json[value] != '{') {
+      return;
+    }
+    forEachMember(json, value,
+                  [&](const std::string &name, size_t rule, size_t end) {
+                    rules.push_back({name, rule, end - rule});
+                  });
+  });
+
+  // Later rules replace earlier ones, as when the grammar is parsed
+  std::stable_sort(rules.begin(), rules.end(),
+                   [](const RuleSpan &a, const RuleSpan &b) {
+                     return a.name < b.name;
+                   });
+  size_t out = 0;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (i + 1 < rules.size() && rules[i].name == rules[i + 1].name) {
+      continue;
+    }
+    if (out != i) {
+      rules[out] = std::move(rules[i]);
+    }
+    out++;
+  }
+  rules.resize(out);
+  return rules;
+}
+
+bool parseGrammar(TextMateGrammar &grammar, std::string_view text,
+                  std::string &error) {
+  GrammarSaxHandler handler(grammar);
+  return readInto(handler, text, error);
+}
+
+bool parseReachableGrammar(TextMateGrammar &grammar, std::string_view text,
+                           ReachabilityStats &stats, std::string &error) {
+  using json_t = nlohmann::json;
+
+  // Only JSON text can be split into rules without parsing it
+  if (detectGrammarFormat(text) != GrammarFormat::Json) {
+    GrammarSaxHandler handler(grammar);
+    if (!readInto(handler, text, error)) {
+      return false;
+    }
+    handler.dropUnreachableRules(stats);
+    return true;
+  }
+  std::string_view json = text;
+
+  // Everything but the repository; this also validates the whole input
+  PatternStore &store = grammar.store;
+  size_t scanned = store.records.size();
+  GrammarSaxHandler handler(grammar, true);
+  if (!json_t::sax_parse(json.begin(), json.end(), &handler)) {
+    error = handler.error();
+    return false;
+  }
+
+  std::vector<RuleSpan> spans = findRepositoryRules(json);
+  std::vector<bool> loaded(spans.size(), false);
+  auto findSpan = [&spans](std::string_view name) {
+    auto it = std::lower_bound(
+        spans.begin(), spans.end(), name,
+        [](const RuleSpan &span, std::string_view key) {
+          return span.name < key;
+        });
+    return it != spans.end() && it->name == name ? it - spans.begin() : -1;
+  };
+
+  // Records are appended in parse order, so the includes still to follow
+  // are those of the records after `scanned`
+  while (scanned < store.records.size()) {
+    const PatternRecord &record = store.records[scanned++];
+    std::string_view include = store.str(record.include);
+    if (!record.live || include.size() < 2 || include[0] != '#') {
+      continue;
+    }
+    auto index = findSpan(include.substr(1));
+    if (index < 0 || loaded[index]) {
+      continue;
+    }
+    loaded[index] = true;
+    const RuleSpan &span = spans[index];
+    handler.beginRule(span.name);
+    std::string_view text = json.substr(span.offset, span.length);
+    if (!json_t::sax_parse(text.begin(), text.end(), &handler)) {
+      error = handler.error();
+      return false;
+    }
+  }
+  handler.finishRules();
+
+  for (size_t i = 0; i < spans.size(); ++i) {
+    if (!loaded[i]) {
+      stats.rulesSkipped++;
+      stats.bytesSkipped += spans[i].length;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,161 @@
+#ifndef GRAMMAR_LOADER_H
+#define GRAMMAR_LOADER_H
+
+#include "grammar_formats.hxx"
+#include "tmlanguage2vimsyntax.hxx"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// SAX handler that fills a TextMateGrammar while the input is being parsed,
+// so no document is ever built. Patterns are appended to the grammar's flat
+// PatternStore as they are opened; keys the converter does not use are
+// skipped without storing them. The plist and YAML readers drive it with the
+// same events as the JSON parser.
+class GrammarSaxHandler final : public GrammarSax {
+public:
+  using json = nlohmann::json;
+
+  // With deferRepository, the "repository" object is skipped; its rules can
+  // then be parsed one at a time with beginRule()
+  explicit GrammarSaxHandler(TextMateGrammar &grammar,
+                             bool deferRepository = false);
+
+  // Parse the next value as the repository rule `name`
+  void beginRule(std::string_view name);
+
+  // Sort the rules parsed after beginRule() into the repository
+  void finishRules() { finishRepository(); }
+
+  // Drop the repository rules no include reaches from the top-level
+  // patterns, once the whole grammar has been parsed
+  void dropUnreachableRules(ReachabilityStats &stats);
+
+  // nlohmann::json SAX interface
+  bool null() override;
+  bool boolean(bool value) override;
+  bool number_integer(json::number_integer_t value) override;
+  bool number_unsigned(json::number_unsigned_t value) override;
+  bool number_float(json::number_float_t value,
+                    const json::string_t &text) override;
+  bool string(json::string_t &value) override;
+  bool binary(json::binary_t &value) override;
+  bool start_object(std::size_t elements) override;
+  bool key(json::string_t &key) override;
+  bool end_object() override;
+  bool start_array(std::size_t elements) override;
+  bool end_array() override;
+  bool parse_error(std::size_t position, const std::string &lastToken,
+                   const nlohmann::detail::exception &ex) override;
+
+  // Description of the error that stopped parsing
+  const std::string &error() const { return error_; }
+
+private:
+  // What the object or array currently being filled represents
+  enum class Frame {
+    Root,         // Grammar object
+    PatternList,  // "patterns" array
+    Pattern,      // Pattern object
+    Repository,   // "repository" object
+    CaptureTable, // "captures" / "beginCaptures" / "endCaptures"
+    Capture       // Single capture object
+  };
+
+  // What the next value is stored into
+  enum class Field {
+    None,
+    GrammarName,
+    ScopeName,
+    Name,
+    Match,
+    Begin,
+    End,
+    Include,
+    Patterns,
+    Repository,
+    Captures,
+    BeginCaptures,
+    EndCaptures,
+    RepositoryRule,
+    CaptureEntry,
+    CaptureName
+  };
+
+  // Owner of the top-level pattern list
+  static constexpr uint32_t kRoot = UINT32_MAX;
+
+  struct Context {
+    Frame frame;
+    uint32_t pattern = kRoot; // Record being filled or owning the list/table
+    size_t start = 0; // First pending child or capture of a list/table
+    CaptureTable table = kCaptures; // Table filled by CaptureTable/Capture
+    bool isArray = false; // Capture table given as an array
+    size_t index = 0;     // Next element index of an array capture table
+  };
+
+  // Store a scalar value into the pending field (value is null for
+  // non-string scalars)
+  bool scalar(json::string_t *value, const char *type);
+
+  // Begin an object or array for the pending field
+  bool open(bool isObject);
+
+  // Finish the innermost object or array
+  bool close();
+
+  // Add a new empty pattern record and return its index
+  uint32_t addRecord();
+
+  // Move the pending children of a finished list into the store
+  void finishPatternList(const Context &context);
+
+  // Sort a finished capture table by group number, dropping duplicates
+  void finishCaptureTable(const Context &context);
+
+  // Sort repository rules by name; a later duplicate replaces the earlier
+  void finishRepository();
+
+  // Exclude a replaced pattern and its nested patterns from the grammar
+  void markDead(uint32_t pattern);
+
+  TextMateGrammar &grammar_;
+  bool deferRepository_;
+  IndexRange initialPatterns_; // Top-level patterns from earlier parses
+  std::vector<Context> stack_;
+  std::vector<uint32_t> pendingChildren_; // Children of open pattern lists
+  Field field_ = Field::None;
+  std::string fieldKey_;   // Key that selected field_
+  std::string captureKey_; // Key of the capture being filled
+  size_t skipDepth_ = 0;   // Nesting depth inside an unused value
+  std::string error_;
+};
+
+// JSON text of a repository rule
+struct RuleSpan {
+  std::string name;
+  size_t offset = 0;
+  size_t length = 0;
+};
+
+// Locate the repository rules of a well-formed grammar without parsing
+// them, sorted by name; for a duplicate name only the last one is kept
+std::vector<RuleSpan> findRepositoryRules(std::string_view json);
+
+// Parse a grammar in any format into `grammar`. Returns false with `error`
+// set if parsing fails.
+bool parseGrammar(TextMateGrammar &grammar, std::string_view text,
+                  std::string &error);
+
+// Parse a grammar, converting only the repository rules reachable through
+// includes from its top-level patterns. The rules of a JSON grammar are
+// parsed as they are found to be included; other formats are parsed whole
+// and the unreachable rules dropped. Returns false with `error` set if
+// parsing fails.
+bool parseReachableGrammar(TextMateGrammar &grammar, std::string_view text,
+                           ReachabilityStats &stats, std::string &error);
+
+#endif
@@ -0,0 +1,140 @@
+#include "grammar_registry.hxx"
+#include "fileio.hxx"
+#include "grammar_formats.hxx"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <sstream>
+
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Scope name of a grammar file (empty if it has none or cannot be read)
+std::string readScopeName(const std::string &path) {
+  InputFile file;
+  std::string error;
+  if (!file.open(path, error)) {
+    return {};
+  }
+  return grammarScopeName(file.view());
+}
+
+} // namespace
+
+std::string embeddedGrammarPrefix(std::string_view scopeName) {
+  std::string prefix(scopeName);
+  for (char &c : prefix) {
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      c = '_';
+    }
+  }
+  return prefix + "_";
+}
+
+bool GrammarRegistry::add(const std::string &path, std::string &error) {
+  std::error_code ec;
+  std::vector<std::string> files;
+  if (fs::is_directory(path, ec)) {
+    for (const auto &entry : fs::directory_iterator(path, ec)) {
+      if (entry.is_regular_file(ec) &&
+          !grammarFileStem(entry.path().filename().string()).empty()) {
+        files.push_back(entry.path().string());
+      }
+    }
+    if (ec) {
+      error = "Cannot read directory: " + path + ": " + ec.message();
+      return false;
+    }
+    // Keep the choice between files of one scope independent of the
+    // directory order
+    std::sort(files.begin(), files.end());
+  } else if (fs::is_regular_file(path, ec)) {
+    files.push_back(path);
+  } else {
+    error = "No such grammar file or directory: " + path;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.insert(pending_.end(), files.begin(), files.end());
+  return true;
+}
+
+std::shared_ptr<const EmbeddedGrammar>
+GrammarRegistry::find(std::string_view scopeName,
+                      const ConversionOptions &options) {
+  Entry *entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    indexPending();
+    auto it = entries_.find(scopeName);
+    if (it == entries_.end()) {
+      return nullptr;
+    }
+    entry = it->second.get();
+  }
+  // Other scopes can be looked up while this one loads
+  std::call_once(entry->loaded, [&]() {
+    entry->grammar = load(entry->path, scopeName, options);
+  });
+  return entry->grammar;
+}
+
+bool GrammarRegistry::has(std::string_view scopeName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  indexPending();
+  return entries_.find(scopeName) != entries_.end();
+}
+
+std::vector<std::string> GrammarRegistry::unindexed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  indexPending();
+  return unindexed_;
+}
+
+void GrammarRegistry::indexPending() {
+  for (const std::string &path : pending_) {
+    std::string scopeName = readScopeName(path);
+    if (scopeName.empty()) {
+      // A plain .json file without a scope is not a grammar at all
+      if (!hasGenericGrammarExtension(
+              std::filesystem::path(path).filename().string())) {
+        unindexed_.push_back(path);
+      }
+    } else if (entries_.count(scopeName) == 0) {
+      auto entry = std::make_unique<Entry>();
+      entry->path = path;
+      entries_.emplace(std::move(scopeName), std::move(entry));
+    }
+  }
+  pending_.clear();
+}
+
+std::shared_ptr<const EmbeddedGrammar>
+GrammarRegistry::load(const std::string &path, std::string_view scopeName,
+                      const ConversionOptions &options) {
+  InputFile input;
+  std::string error;
+  if (!input.open(path, error)) {
+    return nullptr;
+  }
+  ConversionOptions embeddedOptions = options;
+  embeddedOptions.regexCache = nullptr;
+  TmLanguage2VimSyntax converter(embeddedOptions);
+  if (!converter.parseGrammar(input.view())) {
+    return nullptr;
+  }
+
+  auto grammar = std::make_shared<EmbeddedGrammar>();
+  grammar->scopeName = scopeName;
+  grammar->prefix = embeddedGrammarPrefix(scopeName);
+  converter.setEmbedded(grammar->prefix);
+  std::ostringstream os;
+  converter.generateEmbeddedSyntax(os);
+  grammar->syntax = os.str();
+  grammar->includes = converter.embeddedScopes();
+  return grammar;
+}
@@ -0,0 +1,73 @@
+#ifndef GRAMMAR_REGISTRY_H
+#define GRAMMAR_REGISTRY_H
+
+#include "tmlanguage2vimsyntax.hxx"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Vim syntax of a grammar for embedding in the files of other grammars, the
+// way ":syntax include" would: every item is contained and the top-level
+// groups form the cluster "<prefix>top"
+struct EmbeddedGrammar {
+  std::string scopeName;
+  std::string prefix; // Start of its group and cluster names
+  std::string syntax; // Its syntax items and highlight links
+  std::vector<std::string> includes; // Scopes of the grammars it refers to
+};
+
+// Prefix of the names of an embedded grammar ("source.js" -> "source_js_")
+std::string embeddedGrammarPrefix(std::string_view scopeName);
+
+// Grammars that other grammars include by scope name ("source.js",
+// "source.js#rule"). Grammar files are indexed by their scopeName when a
+// scope is first looked up; each grammar is then loaded, translated and
+// generated at most once per process and shared by every grammar that
+// embeds it. Safe to use from several threads.
+//
+// An embedded grammar that includes other grammars only refers to their
+// clusters; the file embedding it embeds them as well. Loading never waits
+// on another grammar, so grammars that include each other cannot deadlock.
+class GrammarRegistry {
+public:
+  // Register a grammar file, or every grammar file of a directory. When
+  // several files declare one scope name, the first registered is used.
+  bool add(const std::string &path, std::string &error);
+
+  // Embedded syntax of the grammar with a scope name (nullptr if no
+  // registered grammar has it or it cannot be converted). The first lookup
+  // of a scope generates it with `options`.
+  std::shared_ptr<const EmbeddedGrammar>
+  find(std::string_view scopeName, const ConversionOptions &options);
+
+  // Whether a registered grammar has a scope name, without loading it
+  bool has(std::string_view scopeName);
+
+  // Registered files that could not be indexed because they have no
+  // scopeName or cannot be read; indexes the pending files first
+  std::vector<std::string> unindexed();
+
+private:
+  struct Entry {
+    std::string path;
+    std::once_flag loaded;
+    std::shared_ptr<const EmbeddedGrammar> grammar;
+  };
+
+  std::mutex mutex_; // Guards pending_, unindexed_ and entries_
+  std::vector<std::string> pending_; // Registered files not indexed yet
+  std::vector<std::string> unindexed_; // Files without a scope name
+  std::map<std::string, std::unique_ptr<Entry>, std::less<>> entries_;
+
+  // Index the pending files by their scope names; called with mutex_ held
+  void indexPending();
+
+  static std::shared_ptr<const EmbeddedGrammar>
+  load(const std::string &path, std::string_view scopeName,
+       const ConversionOptions &options);
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "include_graph.hxx"
+#include "tmlanguage2vimsyntax.hxx"
+#include <algorithm>
+
+void IncludeGraph::build(const TextMateGrammar &grammar) {
+  grammar_ = &grammar;
+  const auto &rules = grammar.repository.rules;
+  const uint32_t count = static_cast<uint32_t>(rules.size()) + 1;
+  own_.assign(count, {});
+  edges_.assign(count, {});
+  ownExternals_.assign(count, {});
+  for (uint32_t i = 0; i < rules.size(); ++i) {
+    collect(i, grammar.rulePattern(rules[i]));
+  }
+  for (Pattern pattern : grammar.topLevelPatterns()) {
+    collect(selfNode(), pattern);
+  }
+
+  referenced_.assign(count, false);
+  const PatternStore &store = grammar.store;
+  for (const auto &record : store.records) {
+    if (record.live && record.include.length > 0) {
+      uint32_t node = resolve(store.str(record.include));
+      if (node != kNoNode) {
+        referenced_[node] = true;
+      }
+    }
+  }
+
+  reachable_.assign(count, false);
+  reachable_[selfNode()] = true;
+  std::vector<uint32_t> pending{selfNode()};
+  while (!pending.empty()) {
+    uint32_t node = pending.back();
+    pending.pop_back();
+    for (uint32_t target : edges_[node]) {
+      if (!reachable_[target]) {
+        reachable_[target] = true;
+        pending.push_back(target);
+      }
+    }
+  }
+
+  findComponents();
+}
+
+uint32_t IncludeGraph::resolve(std::string_view include) const {
+  if (include == "$self" || include == "$base" ||
+      include == grammar_->scopeName) {
+    return selfNode();
+  }
+  // "source.go#rule" in the grammar of source.go names its own rule
+  std::string_view scope = grammar_->scopeName;
+  if (!scope.empty() && include.size() > scope.size() + 1 &&
+      include.compare(0, scope.size(), scope) == 0 &&
+      include[scope.size()] == '#') {
+    include.remove_prefix(scope.size());
+  }
+  if (include.size() > 1 && include[0] == '#') {
+    const RuleRecord *rule = grammar_->findRule(include.substr(1));
+    if (rule) {
+      return static_cast<uint32_t>(rule - grammar_->repository.rules.data());
+    }
+  }
+  return kNoNode;
+}
+
+void IncludeGraph::collect(uint32_t node, const Pattern &pattern) {
+  if (!pattern.include().empty()) {
+    uint32_t target = resolve(pattern.include());
+    if (target != kNoNode) {
+      edges_[node].push_back(target);
+    } else if (isExternal(pattern.include())) {
+      ownExternals_[node].push_back(pattern.index());
+    }
+  } else if (!pattern.match().empty() || !pattern.begin().empty()) {
+    own_[node].push_back(pattern.index());
+  } else {
+    // A pattern with only nested patterns stands for them
+    for (Pattern child : pattern.patterns()) {
+      collect(node, child);
+    }
+  }
+}
+
+// Tarjan's algorithm without recursion. Components are completed after
+// every component they include, so their members can be merged right away.
+void IncludeGraph::findComponents() {
+  const uint32_t count = static_cast<uint32_t>(own_.size());
+  std::vector<uint32_t> order(count, kNoNode);
+  std::vector<uint32_t> low(count, 0);
+  std::vector<bool> onStack(count, false);
+  std::vector<uint32_t> stack;
+  struct Frame {
+    uint32_t node;
+    size_t edge;
+  };
+  std::vector<Frame> frames;
+  std::vector<uint32_t> nodes; // Nodes of the component being completed
+  uint32_t next = 0;
+
+  // Component that last took each pattern, to merge without duplicates
+  std::vector<uint32_t> taken(grammar_->store.records.size(), kNoNode);
+
+  scc_.assign(count, kNoNode);
+  sccMembers_.clear();
+  sccExternals_.clear();
+  auto visit = [&](uint32_t node) {
+    order[node] = low[node] = next++;
+    stack.push_back(node);
+    onStack[node] = true;
+    frames.push_back({node, 0});
+  };
+
+  for (uint32_t root = 0; root < count; ++root) {
+    if (order[root] != kNoNode) {
+      continue;
+    }
+    visit(root);
+    while (!frames.empty()) {
+      Frame &frame = frames.back();
+      if (frame.edge < edges_[frame.node].size()) {
+        uint32_t target = edges_[frame.node][frame.edge++];
+        if (order[target] == kNoNode) {
+          visit(target);
+        } else if (onStack[target]) {
+          low[frame.node] = std::min(low[frame.node], order[target]);
+        }
+        continue;
+      }
+
+      uint32_t node = frame.node;
+      frames.pop_back();
+      if (!frames.empty()) {
+        uint32_t parent = frames.back().node;
+        low[parent] = std::min(low[parent], low[node]);
+      }
+      if (low[node] != order[node]) {
+        continue;
+      }
+
+      const uint32_t component = static_cast<uint32_t>(sccMembers_.size());
+      nodes.clear();
+      uint32_t top;
+      do {
+        top = stack.back();
+        stack.pop_back();
+        onStack[top] = false;
+        scc_[top] = component;
+        nodes.push_back(top);
+      } while (top != node);
+      std::sort(nodes.begin(), nodes.end());
+
+      // Include patterns are never members, so one marker serves both lists
+      std::pmr::vector<uint32_t> members(sccMembers_.get_allocator());
+      std::pmr::vector<uint32_t> externals(sccMembers_.get_allocator());
+      auto take = [&](std::pmr::vector<uint32_t> &list, uint32_t pattern) {
+        if (taken[pattern] != component) {
+          taken[pattern] = component;
+          list.push_back(pattern);
+        }
+      };
+      for (uint32_t member : nodes) {
+        for (uint32_t pattern : own_[member]) {
+          take(members, pattern);
+        }
+        for (uint32_t pattern : ownExternals_[member]) {
+          take(externals, pattern);
+        }
+      }
+      for (uint32_t member : nodes) {
+        for (uint32_t target : edges_[member]) {
+          if (scc_[target] != component) {
+            for (uint32_t pattern : sccMembers_[scc_[target]]) {
+              take(members, pattern);
+            }
+            for (uint32_t pattern : sccExternals_[scc_[target]]) {
+              take(externals, pattern);
+            }
+          }
+        }
+      }
+      sccMembers_.push_back(std::move(members));
+      sccExternals_.push_back(std::move(externals));
+    }
+  }
+}
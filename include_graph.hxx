@@ -0,0 +1,78 @@
+#ifndef INCLUDE_GRAPH_H
+#define INCLUDE_GRAPH_H
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+class Pattern;
+struct TextMateGrammar;
+
+// Include references of a grammar resolved against its repository. The
+// nodes are the repository rules (by index in Repository::rules) and the
+// top-level pattern list, which "$self", "$base" and the grammar's own
+// scope name refer to. Rules that include each other in a cycle share one
+// member list. The node lists are allocated from one memory resource.
+class IncludeGraph {
+public:
+  static constexpr uint32_t kNoNode = UINT32_MAX;
+
+  explicit IncludeGraph(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : own_(resource), edges_(resource), ownExternals_(resource),
+        referenced_(resource), reachable_(resource), scc_(resource),
+        sccMembers_(resource), sccExternals_(resource) {}
+
+  // Resolve every include of a grammar; the grammar must outlive the graph
+  void build(const TextMateGrammar &grammar);
+
+  // Node of the top-level pattern list
+  uint32_t selfNode() const { return static_cast<uint32_t>(own_.size()) - 1; }
+
+  // Node an include reference names (kNoNode for unknown rules and other
+  // grammars)
+  uint32_t resolve(std::string_view include) const;
+
+  // Whether any include in the grammar names the node
+  bool referenced(uint32_t node) const { return referenced_[node]; }
+
+  // Whether the top-level patterns reach the node through includes
+  bool reachableFromTop(uint32_t node) const { return reachable_[node]; }
+
+  // Patterns with a match or begin that apply where the node is included:
+  // its own patterns, with pattern-only containers inlined and includes
+  // followed transitively; no duplicates
+  const std::pmr::vector<uint32_t> &members(uint32_t node) const {
+    return sccMembers_[scc_[node]];
+  }
+
+  // Include patterns naming other grammars ("source.js", "source.js#rule")
+  // that apply where the node is included, followed like members()
+  const std::pmr::vector<uint32_t> &externals(uint32_t node) const {
+    return sccExternals_[scc_[node]];
+  }
+
+  // Whether an include names another grammar
+  static bool isExternal(std::string_view include) {
+    return !include.empty() && include[0] != '#' && include[0] != '$';
+  }
+
+private:
+  void collect(uint32_t node, const Pattern &pattern);
+  void findComponents();
+
+  const TextMateGrammar *grammar_ = nullptr;
+  using NodeLists = std::pmr::vector<std::pmr::vector<uint32_t>>;
+
+  NodeLists own_;   // Patterns of each node
+  NodeLists edges_; // Nodes each node includes
+  NodeLists ownExternals_;
+  std::pmr::vector<bool> referenced_;
+  std::pmr::vector<bool> reachable_;
+  std::pmr::vector<uint32_t> scc_; // Strongly connected component of each node
+  NodeLists sccMembers_;
+  NodeLists sccExternals_;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "keyword_lowering.hxx"
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+const char *const kSyntaxIsKeyword = "@,48-57,_,192-255";
+
+namespace {
+
+// Upper bound on the number of words a regex may expand to
+constexpr size_t kMaxWords = 1000;
+
+// Words that ":syntax keyword" takes as options instead of keywords
+constexpr std::string_view kKeywordOptions[] = {
+    "cchar",     "conceal",  "concealends", "contained", "containedin",
+    "contains",  "display",  "extend",      "fold",      "nextgroup",
+    "oneline",   "skipempty", "skipnl",     "skipwhite", "transparent"};
+
+bool isKeywordChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Expands a regex without unbounded parts into the strings it matches
+class WordExpander {
+public:
+  explicit WordExpander(const RegexTree &tree) : tree_(tree) {}
+
+  bool expand(uint32_t index, std::vector<std::string> &out) {
+    const RegexNode &node = tree_.nodes[index];
+    switch (node.kind) {
+    case RegexNodeKind::Literal:
+      out = {std::string(1, node.ch)};
+      return true;
+    case RegexNodeKind::Sequence:
+      return expandSequence(node, 0, node.count, out);
+    case RegexNodeKind::Alternation:
+      out.clear();
+      for (uint32_t i = 0; i < node.count; ++i) {
+        std::vector<std::string> branch;
+        if (!expand(tree_.child(node, i), branch)) {
+          return false;
+        }
+        out.insert(out.end(), branch.begin(), branch.end());
+        if (out.size() > kMaxWords) {
+          return false;
+        }
+      }
+      return true;
+    case RegexNodeKind::Group:
+      return (node.group == RegexGroupKind::Capture ||
+              node.group == RegexGroupKind::NonCapture) &&
+             expand(node.first, out);
+    case RegexNodeKind::Repeat:
+      return expandRepeat(node, out);
+    case RegexNodeKind::CharClass:
+      return expandClass(tree_.nodeText(node), out);
+    case RegexNodeKind::Escape:
+      return tree_.nodeText(node) == "\\d" && expandClass("[0-9]", out);
+    default:
+      return false;
+    }
+  }
+
+  // Product of the children [first, last) of a sequence
+  bool expandSequence(const RegexNode &node, uint32_t first, uint32_t last,
+                      std::vector<std::string> &out) {
+    out = {std::string()};
+    for (uint32_t i = first; i < last; ++i) {
+      std::vector<std::string> part;
+      if (!expand(tree_.child(node, i), part) || !product(out, part)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  bool product(std::vector<std::string> &prefixes,
+               const std::vector<std::string> &suffixes) {
+    if (prefixes.size() * suffixes.size() > kMaxWords) {
+      return false;
+    }
+    std::vector<std::string> result;
+    result.reserve(prefixes.size() * suffixes.size());
+    for (const auto &prefix : prefixes) {
+      for (const auto &suffix : suffixes) {
+        result.push_back(prefix + suffix);
+      }
+    }
+    prefixes = std::move(result);
+    return true;
+  }
+
+  // x?, x{n}, x{n,m}; possessive repeats may refuse to give back and are
+  // left alone
+  bool expandRepeat(const RegexNode &node, std::vector<std::string> &out) {
+    if (node.max < 0 || node.mode == RegexRepeatMode::Possessive) {
+      return false;
+    }
+    std::vector<std::string> item;
+    if (!expand(node.first, item)) {
+      return false;
+    }
+    out.clear();
+    std::vector<std::string> repeated = {std::string()};
+    for (int32_t count = 0; count <= node.max; ++count) {
+      if (count > 0 && !product(repeated, item)) {
+        return false;
+      }
+      if (count >= node.min) {
+        out.insert(out.end(), repeated.begin(), repeated.end());
+        if (out.size() > kMaxWords) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Plain Vim collections such as [xX] or [0-9]
+  bool expandClass(std::string_view text, std::vector<std::string> &out) {
+    if (text.size() < 3 || text[1] == '^') {
+      return false;
+    }
+    out.clear();
+    for (size_t i = 1; i + 1 < text.size(); ++i) {
+      char from = text[i];
+      char to = from;
+      if (from == '\\' || from == '[') {
+        return false;
+      }
+      if (i + 3 < text.size() && text[i + 1] == '-') {
+        to = text[i + 2];
+        i += 2;
+      }
+      for (int c = static_cast<unsigned char>(from);
+           c <= static_cast<unsigned char>(to); ++c) {
+        out.push_back(std::string(1, static_cast<char>(c)));
+      }
+      if (out.size() > kMaxWords) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const RegexTree &tree_;
+};
+
+} // namespace
+
+bool extractKeywords(const RegexTree &tree, std::vector<std::string> &words) {
+  words.clear();
+  if (tree.truncated) {
+    return false;
+  }
+
+  // \b <finite set of words> \b
+  const RegexNode &root = tree.nodes[tree.root];
+  if (root.kind != RegexNodeKind::Sequence || root.count < 3 ||
+      tree.nodes[tree.child(root, 0)].kind != RegexNodeKind::WordBoundary ||
+      tree.nodes[tree.child(root, root.count - 1)].kind !=
+          RegexNodeKind::WordBoundary) {
+    return false;
+  }
+  std::vector<std::string> expanded;
+  if (!WordExpander(tree).expandSequence(root, 1, root.count - 1, expanded)) {
+    return false;
+  }
+
+  // With a word boundary on both sides every alternative that is a whole
+  // word can match, whatever order the alternation tries them in
+  for (auto &word : expanded) {
+    if (word.empty() || !std::all_of(word.begin(), word.end(), isKeywordChar) ||
+        std::find(std::begin(kKeywordOptions), std::end(kKeywordOptions),
+                  word) != std::end(kKeywordOptions)) {
+      words.clear();
+      return false;
+    }
+    if (std::find(words.begin(), words.end(), word) == words.end()) {
+      words.push_back(std::move(word));
+    }
+  }
+  return true;
+}
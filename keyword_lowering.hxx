@@ -0,0 +1,20 @@
+#ifndef KEYWORD_LOWERING_H
+#define KEYWORD_LOWERING_H
+
+#include "vim_regex.hxx"
+#include <string>
+#include <vector>
+
+// Keyword characters the lowered keywords are checked against, pinned in
+// generated files with ":syntax iskeyword" so 'iskeyword' of the buffer
+// cannot change what they match
+extern const char *const kSyntaxIsKeyword;
+
+// Find the words of a regex that provably matches exactly a finite set of
+// whole words, such as \b(if|else)\b, \bfunc\b or \b(?:u?int(?:8|16)?)\b,
+// so it can be emitted as ":syntax keyword". The words are returned in
+// match order without duplicates. Fails for any other regex, for words with
+// non-keyword characters and for words Vim would read as keyword options.
+bool extractKeywords(const RegexTree &tree, std::vector<std::string> &words);
+
+#endif
@@ -1,50 +1,473 @@
+#include "alloc_stats.hxx"
+#include "batch.hxx"
+#include "fileio.hxx"
+#include "grammar_registry.hxx"
+#include "regex_cache.hxx"
 #include "tmlanguage2vimsyntax.hxx"
+#include "watch.hxx"
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
 
-int main(int argc, char *argv[]) {
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <input.tmLanguage> <output.vim>"
-              << std::endl;
+static void usage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [options] <input.tmLanguage> <output.vim>\n"
+            << "       " << program
+            << " --batch <directory|manifest> [output-directory] [-j N]"
+               " [--compress gzip|zstd] [options]\n"
+            << "       " << program << " --analyze <input.tmLanguage> [-n N]\n"
+            << "Options:\n"
+            << "  --scope-map FILE      Scope to highlight group mappings\n"
+            << "  --sync METHOD         auto, fromstart, ccomment, match or"
+               " lines\n"
+            << "  --sync-minlines N     Override the computed minlines\n"
+            << "  --sync-maxlines N     Override the computed maxlines\n"
+            << "  --regex-engine N      Prefix every pattern with \\%#=N (0 = none)"
+               " instead\n"
+            << "                        of choosing the engine per pattern\n"
+            << "  --reachable-only      Convert only the repository rules the"
+               " top-level\n"
+            << "                        patterns include\n"
+            << "  -O0, -O1, -O2         Passes run before writing: none, keywords,"
+               " dedupe\n"
+            << "                        and sync, or all (default)\n"
+            << "  --no-pass NAME        Skip a pass: keywords, factor, dedupe,"
+               " merge or sync\n"
+            << "  --threads N           Threads translating and generating the"
+               " rules of a\n"
+            << "                        grammar (0 = one per CPU, default 1)\n"
+            << "  --cache DIR           Keep parsed grammars in DIR, keyed by their"
+               " content\n"
+            << "  --grammar-path PATH   Grammar file or directory to embed where"
+               " an include\n"
+            << "                        names its scope (source.js, ...)\n"
+            << "  --pass-stats          Print the time and changes of every pass\n"
+            << "  --alloc-stats         Print the heap allocations of the"
+               " conversion\n"
+            << "  --stats               Print the time of every phase, counts,"
+               " sizes and\n"
+            << "                        memory use\n"
+            << "  --stats-json FILE     Write the same as JSON to FILE (- for"
+               " stdout)\n"
+            << "  --watch               Convert again whenever an input grammar"
+               " is saved"
+            << std::endl;
+}
+
+// Read the scope mappings of --scope-map into the options
+static bool loadScopeMap(const std::string &path, ConversionOptions &options) {
+  auto scopeMap = std::make_shared<ScopeMap>();
+  std::string error;
+  if (!scopeMap->load(path, error)) {
+    std::cerr << "Error: " << error << std::endl;
+    return false;
+  }
+  options.scopeMap = std::move(scopeMap);
+  return true;
+}
+
+// Parse a conversion option at argv[i], moving i past its argument.
+// Returns false if argv[i] is not one; `error` is set if it is invalid.
+static bool parseConversionOption(int argc, char *argv[], int &i,
+                                  ConversionOptions &options, bool &error) {
+  std::string arg = argv[i];
+  if (arg == "--reachable-only") {
+    options.reachableOnly = true;
+    return true;
+  }
+  if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' &&
+      arg[2] <= '9') {
+    options.passes = syntaxPassesForLevel(arg[2] - '0');
+    return true;
+  }
+  if (i + 1 >= argc) {
+    return false;
+  }
+  if (arg == "--scope-map") {
+    error = !loadScopeMap(argv[++i], options);
+  } else if (arg == "--sync") {
+    error = !parseSyncMethod(argv[++i], options.sync.method);
+    if (error) {
+      std::cerr << "Error: Unknown sync method: " << argv[i] << std::endl;
+    }
+  } else if (arg == "--sync-minlines") {
+    options.sync.minLines = std::atoi(argv[++i]);
+  } else if (arg == "--sync-maxlines") {
+    options.sync.maxLines = std::atoi(argv[++i]);
+  } else if (arg == "--threads") {
+    options.threads =
+        static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+  } else if (arg == "--cache") {
+    options.cacheDir = argv[++i];
+  } else if (arg == "--grammar-path") {
+    if (!options.registry) {
+      options.registry = std::make_shared<GrammarRegistry>();
+    }
+    std::string message;
+    error = !options.registry->add(argv[++i], message);
+    if (error) {
+      std::cerr << "Error: " << message << std::endl;
+    }
+  } else if (arg == "--no-pass") {
+    SyntaxPass pass;
+    error = !parseSyntaxPass(argv[++i], pass);
+    if (error) {
+      std::cerr << "Error: Unknown pass: " << argv[i] << std::endl;
+    } else {
+      options.passes &= ~syntaxPassBit(pass);
+    }
+  } else if (arg == "--regex-engine") {
+    std::string engine = argv[++i];
+    error = engine != "0" && engine != "1" && engine != "2";
+    if (error) {
+      std::cerr << "Error: Regex engine must be 0, 1 or 2: " << engine
+                << std::endl;
+    } else {
+      options.regexEngine = static_cast<VimRegexEngine>(engine[0] - '0');
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Where the statistics of --stats and --stats-json go
+struct StatsOutput {
+  bool table = false;
+  std::string jsonPath; // Empty = no JSON
+
+  bool enabled() const { return table || !jsonPath.empty(); }
+
+  // Stream for the other messages, which must not mix with JSON on stdout
+  std::ostream &messages() const {
+    return jsonPath == "-" ? std::cerr : std::cout;
+  }
+};
+
+// Parse a statistics option at argv[i], moving i past its argument.
+// Returns false if argv[i] is not one.
+static bool parseStatsOption(int argc, char *argv[], int &i,
+                             StatsOutput &stats) {
+  std::string arg = argv[i];
+  if (arg == "--stats") {
+    stats.table = true;
+    return true;
+  }
+  if (arg == "--stats-json" && i + 1 < argc) {
+    stats.jsonPath = argv[++i];
+    return true;
+  }
+  return false;
+}
+
+// Write the JSON of --stats-json to its file, or to stdout for "-"
+static bool writeStatsJson(const std::string &path, const std::string &json) {
+  if (path == "-") {
+    std::cout << json << std::flush;
+    return true;
+  }
+  std::ofstream file(path, std::ios::binary);
+  if (!(file << json) || !file.flush()) {
+    std::cerr << "Error: Cannot write statistics: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static int runBatchMode(int argc, char *argv[]) {
+  std::string source;
+  std::string outputDir;
+  unsigned threads = 0;
+  bool watch = false;
+  Compression compression = Compression::None;
+  StatsOutput statsOutput;
+  ConversionOptions options;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool error = false;
+    if (parseConversionOption(argc, argv, i, options, error)) {
+      if (error) {
+        return 1;
+      }
+    } else if (parseStatsOption(argc, argv, i, statsOutput)) {
+      options.stats = true;
+      options.allocationStats = threadAllocationStats;
+    } else if (arg == "--watch") {
+      watch = true;
+    } else if (arg == "--compress" && i + 1 < argc) {
+      if (!parseCompression(argv[++i], compression)) {
+        std::cerr << "Error: Compression must be gzip, zstd or none: "
+                  << argv[i] << std::endl;
+        return 1;
+      }
+      if (!compressionSupported(compression)) {
+        std::cerr << "Error: " << compressionName(compression)
+                  << " is not supported by this build" << std::endl;
+        return 1;
+      }
+    } else if (arg == "-j" && i + 1 < argc) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg.compare(0, 2, "-j") == 0 && arg.size() > 2) {
+      threads = static_cast<unsigned>(std::strtoul(arg.c_str() + 2, nullptr, 10));
+    } else if (source.empty()) {
+      source = arg;
+    } else if (outputDir.empty()) {
+      outputDir = arg;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (source.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::string error;
+  if (watch) {
+    if (!watchGrammars(source, outputDir, true, options, error, compression)) {
+      std::cerr << "Error: " << error << std::endl;
+    }
+    return 1;
+  }
+
+  std::vector<BatchJob> jobs;
+  if (!collectBatchJobs(source, outputDir, jobs, error, compression)) {
+    std::cerr << "Error: " << error << std::endl;
+    return 1;
+  }
+
+  // Grammars of a batch can embed each other
+  if (!options.registry) {
+    options.registry = std::make_shared<GrammarRegistry>();
+  }
+  for (const BatchJob &job : jobs) {
+    std::string message;
+    if (!options.registry->add(job.input, message)) {
+      std::cerr << "Warning: " << message
+                << "; other grammars cannot embed it" << std::endl;
+    }
+  }
+  for (const std::string &path : options.registry->unindexed()) {
+    std::cerr << "Warning: No scopeName in " << path
+              << "; other grammars cannot embed it" << std::endl;
+  }
+
+  // Regexes recur from one grammar to the next; translate each one once
+  auto regexCache = std::make_shared<RegexTranslationCache>();
+  options.regexCache = regexCache;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<ConversionReport> reports;
+  std::vector<BatchFailure> failures = runBatch(
+      jobs, threads, options, statsOutput.enabled() ? &reports : nullptr);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::ostream &out = statsOutput.messages();
+  out << "Converted " << (jobs.size() - failures.size()) << " of "
+      << jobs.size() << " grammars";
+  // Grammars loaded from --cache translate nothing
+  if (regexCache->lookups() > 0) {
+    out << ", translated " << regexCache->misses() << " of "
+        << regexCache->lookups() << " regexes";
+  }
+  out << std::endl;
+
+  if (statsOutput.enabled()) {
+    // Phases of all grammars added up, next to the time the batch took
+    ConversionStats total;
+    std::ostringstream json;
+    json << "{\"grammars\": [";
+    size_t failure = 0;
+    bool first = true;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      // Failures are in job order
+      if (failure < failures.size() &&
+          failures[failure].job.input == jobs[i].input &&
+          failures[failure].job.output == jobs[i].output) {
+        failure++;
+        continue;
+      }
+      total.add(reports[i].stats);
+      json << (first ? "\n" : ",\n");
+      writeConversionStatsJson(json, reports[i].stats, jobs[i].input,
+                               jobs[i].output);
+      first = false;
+    }
+    total.peakRssKiB = peakResidentKiB();
+    json << "\n],\n\"wallMilliseconds\": " << elapsed.count()
+         << ",\n\"total\": ";
+    writeConversionStatsJson(json, total);
+    json << "}\n";
+
+    if (statsOutput.table) {
+      out << "Statistics of all grammars, "
+          << static_cast<long long>(elapsed.count() + 0.5) << " ms in all:"
+          << std::endl;
+      writeConversionStats(out, total);
+    }
+    if (!statsOutput.jsonPath.empty() &&
+        !writeStatsJson(statsOutput.jsonPath, json.str())) {
+      return 1;
+    }
+  }
+
+  if (!failures.empty()) {
+    std::cerr << failures.size() << " grammar(s) failed:" << std::endl;
+    for (const auto &failure : failures) {
+      std::cerr << "  " << failure.job.input << ": " << failure.message
+                << std::endl;
+    }
     return 1;
   }
+  return 0;
+}
 
-  std::string inputFile = argv[1];
-  std::string outputFile = argv[2];
+static int runAnalyzeMode(int argc, char *argv[]) {
+  std::string inputFile;
+  size_t limit = 20;
 
-  // Read input file
-  std::ifstream file(inputFile);
-  if (!file.is_open()) {
-    std::cerr << "Error: Cannot open input file: " << inputFile << std::endl;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-n" && i + 1 < argc) {
+      limit = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg.compare(0, 2, "-n") == 0 && arg.size() > 2) {
+      limit = std::strtoul(arg.c_str() + 2, nullptr, 10);
+    } else if (inputFile.empty()) {
+      inputFile = arg;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (inputFile.empty()) {
+    usage(argv[0]);
     return 1;
   }
 
-  std::string jsonContent((std::istreambuf_iterator<char>(file)),
-                          std::istreambuf_iterator<char>());
-  file.close();
+  InputFile input;
+  std::string error;
+  if (!input.open(inputFile, error)) {
+    std::cerr << "Error: " << error << std::endl;
+    return 1;
+  }
 
-  // Parse TextMate grammar
   TmLanguage2VimSyntax parser;
-  if (!parser.parseJson(jsonContent)) {
-    std::cerr << "Error: Failed to parse TextMate grammar" << std::endl;
+  if (!parser.parseGrammar(input.view())) {
+    std::cerr << "Error: Failed to parse TextMate grammar: "
+              << parser.lastError() << std::endl;
     return 1;
   }
 
-  // Generate Vim syntax
-  std::string vimSyntax = parser.generateVimSyntax();
+  writeRegexReport(std::cout, parser.analyzeRegexes(), limit);
+  return 0;
+}
 
-  // Write output file
-  std::ofstream outFile(outputFile);
-  if (!outFile.is_open()) {
-    std::cerr << "Error: Cannot open output file: " << outputFile << std::endl;
+int main(int argc, char *argv[]) {
+  if (argc >= 2 && std::string(argv[1]) == "--batch") {
+    return runBatchMode(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--analyze") {
+    return runAnalyzeMode(argc, argv);
+  }
+
+  ConversionOptions options;
+  std::vector<std::string> files;
+  bool passStats = false;
+  bool allocStats = false;
+  bool watch = false;
+  StatsOutput statsOutput;
+  for (int i = 1; i < argc; ++i) {
+    bool error = false;
+    if (parseConversionOption(argc, argv, i, options, error)) {
+      if (error) {
+        return 1;
+      }
+    } else if (parseStatsOption(argc, argv, i, statsOutput)) {
+      options.stats = true;
+      options.allocationStats = threadAllocationStats;
+    } else if (std::string(argv[i]) == "--pass-stats") {
+      passStats = true;
+      options.passSizes = true;
+    } else if (std::string(argv[i]) == "--alloc-stats") {
+      allocStats = true;
+    } else if (std::string(argv[i]) == "--watch") {
+      watch = true;
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.size() != 2) {
+    usage(argv[0]);
     return 1;
   }
 
-  outFile << vimSyntax;
-  outFile.close();
+  std::string inputFile = files[0];
+  std::string outputFile = files[1];
 
-  std::cout << "Successfully generated Vim syntax file: " << outputFile
-            << std::endl;
+  std::string error;
+  if (watch) {
+    if (!watchGrammars(inputFile, outputFile, false, options, error)) {
+      std::cerr << "Error: " << error << std::endl;
+    }
+    return 1;
+  }
+
+  ConversionReport report;
+  AllocationStats before = threadAllocationStats();
+  if (!convertFile(inputFile, outputFile, error, options, &report)) {
+    std::cerr << "Error: " << error << std::endl;
+    return 1;
+  }
+  AllocationStats after = threadAllocationStats();
+
+  std::ostream &out = statsOutput.messages();
+  out << "Successfully generated Vim syntax file: " << outputFile
+      << std::endl;
+  if (report.cacheHit) {
+    out << "Loaded the parsed grammar from the cache" << std::endl;
+  }
+  if (options.reachableOnly) {
+    out << "Skipped " << report.reachability.rulesSkipped
+        << " unreachable rule(s), " << report.reachability.bytesSkipped
+        << " bytes" << std::endl;
+  }
+  size_t duplicates = 0;
+  size_t merged = 0;
+  for (const SyntaxPassReport &pass : report.passes) {
+    if (pass.pass == SyntaxPass::Dedupe) {
+      duplicates = pass.changed;
+    } else if (pass.pass == SyntaxPass::Merge) {
+      merged = pass.changed;
+    }
+  }
+  if (duplicates + merged > 0) {
+    out << "Removed " << (duplicates + merged) << " redundant syntax rule(s): "
+        << duplicates << " duplicate(s), " << merged << " merged" << std::endl;
+  }
+  if (passStats) {
+    writeSyntaxPassReport(out, report.passes);
+  }
+  if (allocStats) {
+    out << "Heap allocations: " << (after.allocations - before.allocations)
+        << ", " << (after.bytes - before.bytes) << " bytes" << std::endl;
+  }
+  if (statsOutput.table) {
+    writeConversionStats(out, report.stats);
+  }
+  if (!statsOutput.jsonPath.empty()) {
+    std::ostringstream json;
+    writeConversionStatsJson(json, report.stats, inputFile, outputFile);
+    json << "\n";
+    if (!writeStatsJson(statsOutput.jsonPath, json.str())) {
+      return 1;
+    }
+  }
   return 0;
 }
@@ -0,0 +1,137 @@
+#include "parallel.hxx"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Indices [next, end) a thread still has to run
+struct Share {
+  std::mutex mutex;
+  size_t next = 0;
+  size_t end = 0;
+};
+
+class Scheduler {
+public:
+  Scheduler(size_t count, unsigned threads, size_t grain)
+      : shares_(new Share[threads]), threads_(threads), grain_(grain) {
+    for (unsigned i = 0; i < threads; ++i) {
+      shares_[i].next = count * i / threads;
+      shares_[i].end = count * (i + 1) / threads;
+    }
+  }
+
+  // Next chunk for a thread from its own share, or stolen from another
+  bool take(unsigned worker, size_t &first, size_t &last) {
+    return takeOwn(worker, first, last) || steal(worker, first, last);
+  }
+
+private:
+  std::unique_ptr<Share[]> shares_;
+  unsigned threads_;
+  size_t grain_;
+
+  bool takeOwn(unsigned worker, size_t &first, size_t &last) {
+    Share &share = shares_[worker];
+    std::lock_guard<std::mutex> lock(share.mutex);
+    if (share.next == share.end) {
+      return false;
+    }
+    first = share.next;
+    last = std::min(share.end, first + grain_);
+    share.next = last;
+    return true;
+  }
+
+  bool steal(unsigned worker, size_t &first, size_t &last) {
+    for (;;) {
+      // Largest share left; sizes can change before it is locked again
+      unsigned victim = worker;
+      size_t largest = 0;
+      for (unsigned i = 0; i < threads_; ++i) {
+        std::lock_guard<std::mutex> lock(shares_[i].mutex);
+        if (shares_[i].end - shares_[i].next > largest) {
+          largest = shares_[i].end - shares_[i].next;
+          victim = i;
+        }
+      }
+      if (largest == 0) {
+        return false;
+      }
+
+      size_t mid, end;
+      {
+        std::lock_guard<std::mutex> lock(shares_[victim].mutex);
+        Share &share = shares_[victim];
+        if (share.next == share.end) {
+          continue;
+        }
+        end = share.end;
+        mid = share.next + (share.end - share.next) / 2;
+        share.end = mid;
+      }
+      // Only the owner refills its own share, and it is empty here
+      {
+        std::lock_guard<std::mutex> lock(shares_[worker].mutex);
+        shares_[worker].next = mid;
+        shares_[worker].end = end;
+      }
+      if (takeOwn(worker, first, last)) {
+        return true;
+      }
+    }
+  }
+};
+
+} // namespace
+
+unsigned resolveThreads(unsigned threads) {
+  return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallelFor(size_t count, unsigned threads, size_t grain,
+                 const ParallelBody &body) {
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunks = std::max<size_t>(1, (count + grain - 1) / grain);
+  threads =
+      static_cast<unsigned>(std::min<size_t>(resolveThreads(threads), chunks));
+  if (threads == 1) {
+    if (count > 0) {
+      body(0, count, 0);
+    }
+    return;
+  }
+
+  Scheduler scheduler(count, threads, grain);
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  auto worker = [&](unsigned index) {
+    size_t first, last;
+    while (scheduler.take(index, first, last)) {
+      try {
+        body(first, last, index);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i) {
+    pool.emplace_back(worker, i);
+  }
+  worker(0);
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
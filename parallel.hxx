@@ -0,0 +1,24 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Chunk of a parallelFor() range and the thread running it (0 is the
+// calling thread)
+using ParallelBody =
+    std::function<void(size_t first, size_t last, unsigned worker)>;
+
+// Run `body` over [0, count) in chunks of at most `grain` indices on
+// `threads` threads, the calling thread included. Every thread starts on an
+// equal contiguous share of the range; a thread that finishes its share
+// steals the back half of the largest share left, so uneven chunks balance
+// out. Returns when every index is done; the first exception thrown by the
+// body is rethrown then.
+void parallelFor(size_t count, unsigned threads, size_t grain,
+                 const ParallelBody &body);
+
+// Threads for a requested count (0 = one per hardware thread)
+unsigned resolveThreads(unsigned threads);
+
+#endif
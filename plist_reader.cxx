@@ -0,0 +1,383 @@
+#include "plist_reader.hxx"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Start or end tag of an element
+struct Tag {
+  std::string_view name;
+  bool closing = false;     // </name>
+  bool selfClosing = false; // <name/>
+};
+
+class PlistReader {
+public:
+  PlistReader(std::string_view xml, GrammarSax &sax, std::string &error)
+      : xml_(xml), sax_(sax), error_(error) {}
+
+  bool read();
+
+private:
+  // Collection being read
+  struct Level {
+    bool dict;
+    bool keyRead = false; // A key of the dict waits for its value
+  };
+
+  std::string_view xml_;
+  size_t pos_ = 0;
+  GrammarSax &sax_;
+  std::string &error_;
+  std::vector<Level> stack_; // Open collections, innermost last
+  std::string text_;         // Text of the last key or value
+
+  bool fail(const std::string &message);
+
+  bool startsWith(std::string_view prefix) const {
+    return xml_.compare(pos_, prefix.size(), prefix) == 0;
+  }
+
+  // Skip white space, comments, processing instructions and DOCTYPE
+  bool skipMarkup();
+
+  // Read the tag starting at pos_
+  bool readTag(Tag &tag);
+
+  // Read the text of an element up to its end tag into text_
+  bool readText(std::string_view element);
+
+  // Append character data to text_, decoding entities if `entities`
+  bool appendText(std::string_view chars, bool entities);
+  bool appendEntity(std::string_view name);
+
+  // Report a string, number or boolean element
+  bool scalar(const Tag &tag);
+};
+
+bool PlistReader::read() {
+  if (startsWith("\xEF\xBB\xBF")) {
+    pos_ = 3;
+  }
+  bool inPlist = false; // Inside <plist>
+  bool done = false;    // The top-level value has been read
+  for (;;) {
+    if (!skipMarkup()) {
+      return false;
+    }
+    if (pos_ >= xml_.size()) {
+      if (!done || !stack_.empty()) {
+        return fail("unexpected end of input");
+      }
+      return inPlist ? fail("missing </plist>") : true;
+    }
+    if (xml_[pos_] != '<') {
+      return fail("unexpected text outside of a value");
+    }
+    Tag tag;
+    if (!readTag(tag)) {
+      return false;
+    }
+
+    if (tag.closing) {
+      if (stack_.empty()) {
+        if (tag.name == "plist" && inPlist && done) {
+          inPlist = false;
+          continue;
+        }
+        return fail("unexpected </" + std::string(tag.name) + ">");
+      }
+      Level level = stack_.back();
+      if (tag.name != (level.dict ? "dict" : "array")) {
+        return fail("unexpected </" + std::string(tag.name) + ">");
+      }
+      if (level.keyRead) {
+        return fail("missing value after <key>");
+      }
+      stack_.pop_back();
+      if (!(level.dict ? sax_.end_object() : sax_.end_array())) {
+        return false;
+      }
+      done = stack_.empty();
+      continue;
+    }
+
+    if (tag.name == "plist" && !inPlist && !done && stack_.empty()) {
+      inPlist = !tag.selfClosing;
+      continue;
+    }
+    if (done) {
+      return fail("more than one top-level value");
+    }
+    if (!stack_.empty() && stack_.back().dict && !stack_.back().keyRead) {
+      if (tag.name != "key") {
+        return fail("expected <key> instead of <" + std::string(tag.name) +
+                    ">");
+      }
+      text_.clear();
+      if (!tag.selfClosing && !readText(tag.name)) {
+        return false;
+      }
+      stack_.back().keyRead = true;
+      if (!sax_.key(text_)) {
+        return false;
+      }
+      continue;
+    }
+
+    if (!stack_.empty()) {
+      stack_.back().keyRead = false;
+    }
+    if (tag.name == "dict" || tag.name == "array") {
+      bool dict = tag.name == "dict";
+      constexpr size_t kUnknownSize = static_cast<size_t>(-1);
+      if (!(dict ? sax_.start_object(kUnknownSize)
+                 : sax_.start_array(kUnknownSize))) {
+        return false;
+      }
+      if (!tag.selfClosing) {
+        stack_.push_back({dict});
+      } else if (!(dict ? sax_.end_object() : sax_.end_array())) {
+        return false;
+      }
+    } else if (!scalar(tag)) {
+      return false;
+    }
+    done = stack_.empty();
+  }
+}
+
+bool PlistReader::fail(const std::string &message) {
+  size_t end = std::min(pos_, xml_.size());
+  size_t line = 1 + std::count(xml_.begin(), xml_.begin() + end, '\n');
+  error_ = "Plist parse error at line " + std::to_string(line) + ": " +
+           message;
+  return false;
+}
+
+bool PlistReader::skipMarkup() {
+  for (;;) {
+    while (pos_ < xml_.size() && isSpace(xml_[pos_])) {
+      pos_++;
+    }
+    std::string_view end;
+    if (startsWith("<?")) {
+      end = "?>";
+    } else if (startsWith("<!--")) {
+      end = "-->";
+    } else if (startsWith("<!")) {
+      // DOCTYPE, with an internal subset in brackets if any
+      size_t depth = 0;
+      for (; pos_ < xml_.size(); pos_++) {
+        char c = xml_[pos_];
+        if (c == '[') {
+          depth++;
+        } else if (c == ']' && depth > 0) {
+          depth--;
+        } else if (c == '>' && depth == 0) {
+          break;
+        }
+      }
+      if (pos_ >= xml_.size()) {
+        return fail("unterminated declaration");
+      }
+      pos_++;
+      continue;
+    } else {
+      return true;
+    }
+    size_t found = xml_.find(end, pos_ + 2);
+    if (found == std::string_view::npos) {
+      return fail("unterminated " +
+                  std::string(end == "?>" ? "processing instruction"
+                                          : "comment"));
+    }
+    pos_ = found + end.size();
+  }
+}
+
+bool PlistReader::readTag(Tag &tag) {
+  pos_++; // '<'
+  if (pos_ < xml_.size() && xml_[pos_] == '/') {
+    tag.closing = true;
+    pos_++;
+  }
+  size_t start = pos_;
+  while (pos_ < xml_.size() && !isSpace(xml_[pos_]) && xml_[pos_] != '/' &&
+         xml_[pos_] != '>') {
+    pos_++;
+  }
+  tag.name = xml_.substr(start, pos_ - start);
+  if (tag.name.empty()) {
+    return fail("missing element name");
+  }
+
+  // Attributes are skipped; the version of <plist> does not matter here
+  char quote = 0;
+  for (; pos_ < xml_.size(); pos_++) {
+    char c = xml_[pos_];
+    if (quote) {
+      quote = c == quote ? 0 : quote;
+    } else if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == '>') {
+      tag.selfClosing = xml_[pos_ - 1] == '/';
+      pos_++;
+      return true;
+    }
+  }
+  return fail("unterminated <" + std::string(tag.name) + ">");
+}
+
+bool PlistReader::readText(std::string_view element) {
+  for (;;) {
+    size_t lt = xml_.find('<', pos_);
+    if (lt == std::string_view::npos) {
+      return fail("unterminated <" + std::string(element) + ">");
+    }
+    if (!appendText(xml_.substr(pos_, lt - pos_), true)) {
+      return false;
+    }
+    pos_ = lt;
+
+    if (startsWith("<![CDATA[")) {
+      size_t end = xml_.find("]]>", pos_);
+      if (end == std::string_view::npos) {
+        return fail("unterminated CDATA section");
+      }
+      appendText(xml_.substr(pos_ + 9, end - pos_ - 9), false);
+      pos_ = end + 3;
+    } else if (startsWith("<!--")) {
+      size_t end = xml_.find("-->", pos_);
+      if (end == std::string_view::npos) {
+        return fail("unterminated comment");
+      }
+      pos_ = end + 3;
+    } else if (startsWith("</") &&
+               xml_.compare(pos_ + 2, element.size(), element) == 0) {
+      pos_ += 2 + element.size();
+      while (pos_ < xml_.size() && isSpace(xml_[pos_])) {
+        pos_++;
+      }
+      if (pos_ >= xml_.size() || xml_[pos_] != '>') {
+        return fail("malformed </" + std::string(element) + ">");
+      }
+      pos_++;
+      return true;
+    } else {
+      return fail("unexpected element in <" + std::string(element) + ">");
+    }
+  }
+}
+
+bool PlistReader::appendText(std::string_view chars, bool entities) {
+  size_t start = 0;
+  for (size_t i = 0; i < chars.size(); ++i) {
+    char c = chars[i];
+    if (c != '\r' && (c != '&' || !entities)) {
+      continue;
+    }
+    text_.append(chars, start, i - start);
+    if (c == '\r') {
+      // XML reads every line break as "\n"
+      text_ += '\n';
+      if (i + 1 < chars.size() && chars[i + 1] == '\n') {
+        i++;
+      }
+    } else {
+      size_t semicolon = chars.find(';', i);
+      if (semicolon == std::string_view::npos ||
+          !appendEntity(chars.substr(i + 1, semicolon - i - 1))) {
+        pos_ += i;
+        return fail("invalid entity reference");
+      }
+      i = semicolon;
+    }
+    start = i + 1;
+  }
+  text_.append(chars, start, std::string_view::npos);
+  return true;
+}
+
+bool PlistReader::appendEntity(std::string_view name) {
+  if (name == "lt") {
+    text_ += '<';
+  } else if (name == "gt") {
+    text_ += '>';
+  } else if (name == "amp") {
+    text_ += '&';
+  } else if (name == "quot") {
+    text_ += '"';
+  } else if (name == "apos") {
+    text_ += '\'';
+  } else if (name.size() > 1 && name[0] == '#') {
+    bool hex = name[1] == 'x' || name[1] == 'X';
+    std::string digits(name.substr(hex ? 2 : 1));
+    if (digits.empty() || digits.size() > 8) {
+      return false;
+    }
+    char *end;
+    unsigned long codePoint = std::strtoul(digits.c_str(), &end, hex ? 16 : 10);
+    if (*end != '\0' || codePoint == 0 || codePoint > 0x10FFFF) {
+      return false;
+    }
+    appendUtf8(text_, static_cast<uint32_t>(codePoint));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool PlistReader::scalar(const Tag &tag) {
+  std::string_view name = tag.name;
+  if (name == "true" || name == "false") {
+    text_.clear();
+    if (!tag.selfClosing && !readText(name)) {
+      return false;
+    }
+    return sax_.boolean(name == "true");
+  }
+  if (name != "string" && name != "integer" && name != "real" &&
+      name != "date" && name != "data") {
+    return fail("unknown element <" + std::string(name) + ">");
+  }
+
+  text_.clear();
+  if (!tag.selfClosing && !readText(name)) {
+    return false;
+  }
+  if (name == "integer" || name == "real") {
+    size_t first = text_.find_first_not_of(" \t\n");
+    size_t last = text_.find_last_not_of(" \t\n");
+    std::string number =
+        first == std::string::npos ? "" : text_.substr(first, last - first + 1);
+    char *end;
+    errno = 0;
+    if (name == "integer") {
+      long long value = std::strtoll(number.c_str(), &end, 10);
+      if (!number.empty() && *end == '\0' && errno == 0) {
+        return sax_.number_integer(value);
+      }
+    } else {
+      double value = std::strtod(number.c_str(), &end);
+      if (!number.empty() && *end == '\0') {
+        return sax_.number_float(value, number);
+      }
+    }
+    return fail("invalid <" + std::string(name) + "> " + number);
+  }
+  return sax_.string(text_);
+}
+
+} // namespace
+
+bool readPlist(std::string_view xml, GrammarSax &sax, std::string &error) {
+  PlistReader reader(xml, sax, error);
+  return reader.read();
+}
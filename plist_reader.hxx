@@ -0,0 +1,17 @@
+#ifndef PLIST_READER_H
+#define PLIST_READER_H
+
+#include "grammar_formats.hxx"
+#include <string>
+#include <string_view>
+
+// Read an XML property list, the format of .tmLanguage files, reporting its
+// values to `sax` as the events of the equivalent JSON: <dict> is an object
+// whose <key>s are keys, <array> an array, <string>, <date> and <data>
+// strings, and <integer>, <real>, <true/> and <false/> numbers and booleans.
+// The input is read in a single pass without building anything in between.
+// Returns false if the handler stops reading, or with `error` set if the
+// input is not a property list.
+bool readPlist(std::string_view xml, GrammarSax &sax, std::string &error);
+
+#endif
@@ -0,0 +1,297 @@
+#include "regex_analyzer.hxx"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+extern "C" {
+#include <oniguruma.h>
+}
+
+namespace {
+
+// Score weights. Anything that makes Vim retry a match at many positions or
+// backtrack over the same text costs far more than plain atoms.
+constexpr int kRepeatCost = 2;
+constexpr int kLookaheadCost = 5;
+constexpr int kLookbehindCost = 10;
+constexpr int kBackrefCost = 10;
+constexpr int kLeadingWildcardCost = 30;
+constexpr int kUnboundedLookbehindCost = 40;
+constexpr int kNestedQuantifierCost = 50;
+constexpr int kTruncatedCost = 100;
+constexpr uint32_t kLargeAlternation = 100;
+
+// Longest pattern text shown in the report
+constexpr size_t kMaxPatternWidth = 120;
+
+class CostWalker {
+public:
+  explicit CostWalker(const RegexTree &tree) : tree_(tree) {}
+
+  RegexCost run() {
+    if (tree_.truncated) {
+      add(kTruncatedCost, "nesting too deep to translate");
+      return cost_;
+    }
+    if (leadingWildcard(tree_.root)) {
+      add(kLeadingWildcardCost, "leading .*");
+    }
+    walk(tree_.root, 0, false);
+    return cost_;
+  }
+
+private:
+  void add(int points, const std::string &finding = {}) {
+    cost_.score += points;
+    if (!finding.empty() &&
+        std::find(cost_.findings.begin(), cost_.findings.end(), finding) ==
+            cost_.findings.end()) {
+      cost_.findings.push_back(finding);
+    }
+  }
+
+  // `unbounded` is the number of enclosing unbounded repeats
+  void walk(uint32_t index, int unbounded, bool inLookbehind) {
+    const RegexNode &node = tree_.nodes[index];
+    switch (node.kind) {
+    case RegexNodeKind::Sequence:
+      for (uint32_t i = 0; i < node.count; ++i) {
+        walk(tree_.child(node, i), unbounded, inLookbehind);
+      }
+      break;
+    case RegexNodeKind::Alternation:
+      if (node.count >= kLargeAlternation) {
+        add(static_cast<int>(node.count / 4),
+            "alternation with " + std::to_string(node.count) + " branches");
+      } else {
+        add(static_cast<int>(node.count / 20));
+      }
+      for (uint32_t i = 0; i < node.count; ++i) {
+        walk(tree_.child(node, i), unbounded, inLookbehind);
+      }
+      break;
+    case RegexNodeKind::Group:
+      if (node.group == RegexGroupKind::Lookbehind ||
+          node.group == RegexGroupKind::NegativeLookbehind) {
+        add(kLookbehindCost);
+        walk(node.first, unbounded, true);
+      } else {
+        if (node.group == RegexGroupKind::Lookahead ||
+            node.group == RegexGroupKind::NegativeLookahead) {
+          add(kLookaheadCost);
+        }
+        walk(node.first, unbounded, inLookbehind);
+      }
+      break;
+    case RegexNodeKind::Repeat:
+      if (unbounded > 0 && (node.max == -1 || node.max > 1)) {
+        add(kNestedQuantifierCost, "nested quantifier");
+      }
+      if (node.max == -1) {
+        add(kRepeatCost);
+        if (inLookbehind) {
+          add(kUnboundedLookbehindCost, "unbounded lookbehind");
+        }
+        walk(node.first, unbounded + 1, inLookbehind);
+      } else {
+        walk(node.first, unbounded, inLookbehind);
+      }
+      break;
+    case RegexNodeKind::Backref:
+      add(kBackrefCost, "back reference");
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Whether a match can start with ".*" (or "[^x]*"), which makes Vim scan
+  // to the end of the line from every start position
+  bool leadingWildcard(uint32_t index) const {
+    const RegexNode &node = tree_.nodes[index];
+    switch (node.kind) {
+    case RegexNodeKind::Sequence:
+      return node.count > 0 && leadingWildcard(tree_.child(node, 0));
+    case RegexNodeKind::Alternation:
+      for (uint32_t i = 0; i < node.count; ++i) {
+        if (leadingWildcard(tree_.child(node, i))) {
+          return true;
+        }
+      }
+      return false;
+    case RegexNodeKind::Group:
+      return (node.group == RegexGroupKind::Capture ||
+              node.group == RegexGroupKind::NonCapture ||
+              node.group == RegexGroupKind::Atomic) &&
+             leadingWildcard(node.first);
+    case RegexNodeKind::Repeat: {
+      const RegexNode &child = tree_.nodes[node.first];
+      return node.min == 0 && node.max == -1 &&
+             (child.kind == RegexNodeKind::Any ||
+              (child.kind == RegexNodeKind::CharClass &&
+               tree_.nodeText(child).substr(0, 2) == "[^"));
+    }
+    default:
+      return false;
+    }
+  }
+
+  const RegexTree &tree_;
+  RegexCost cost_;
+};
+
+// Finds the constructs that make Vim's backtracking engine slow: repeats
+// nested in unbounded repeats (exponential on a failing match) and
+// lookbehinds (retried from every earlier column)
+class EngineWalker {
+public:
+  explicit EngineWalker(const RegexTree &tree) : tree_(tree) {}
+
+  VimRegexEngine run() {
+    if (tree_.truncated) {
+      return VimRegexEngine::Auto;
+    }
+    walk(tree_.root, 0);
+
+    // Backtracking has less overhead per match attempt, which dominates for
+    // the many short matches of syntax highlighting
+    return nestedQuantifier_ || lookbehind_ ? VimRegexEngine::Nfa
+                                            : VimRegexEngine::Backtracking;
+  }
+
+private:
+  void walk(uint32_t index, int unbounded) {
+    const RegexNode &node = tree_.nodes[index];
+    switch (node.kind) {
+    case RegexNodeKind::Sequence:
+    case RegexNodeKind::Alternation:
+      for (uint32_t i = 0; i < node.count; ++i) {
+        walk(tree_.child(node, i), unbounded);
+      }
+      break;
+    case RegexNodeKind::Group:
+      lookbehind_ |= node.group == RegexGroupKind::Lookbehind ||
+                     node.group == RegexGroupKind::NegativeLookbehind;
+      walk(node.first, unbounded);
+      break;
+    case RegexNodeKind::Repeat:
+      nestedQuantifier_ |= unbounded > 0 && (node.max == -1 || node.max > 1);
+      walk(node.first, node.max == -1 ? unbounded + 1 : unbounded);
+      break;
+    default:
+      break;
+    }
+  }
+
+  const RegexTree &tree_;
+  bool nestedQuantifier_ = false;
+  bool lookbehind_ = false;
+};
+
+} // namespace
+
+void initializeOnigurumaOnce() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    OnigEncoding encodings[] = {ONIG_ENCODING_UTF8};
+    onig_initialize(encodings, 1);
+  });
+}
+
+bool compileOniguruma(std::string_view regex, std::string &error) {
+  initializeOnigurumaOnce();
+
+  // Same options as TextMate implementations: plain groups capture even
+  // when named groups are present
+  OnigRegex compiled = nullptr;
+  OnigErrorInfo info{};
+  auto pattern = reinterpret_cast<const OnigUChar *>(regex.data());
+  int result = onig_new(&compiled, pattern, pattern + regex.size(),
+                        ONIG_OPTION_CAPTURE_GROUP, ONIG_ENCODING_UTF8,
+                        ONIG_SYNTAX_ONIGURUMA, &info);
+  if (result != ONIG_NORMAL) {
+    OnigUChar message[ONIG_MAX_ERROR_MESSAGE_LEN];
+    onig_error_code_to_str(message, result, &info);
+    error = reinterpret_cast<const char *>(message);
+    return false;
+  }
+  onig_free(compiled);
+  return true;
+}
+
+RegexCost analyzeRegexTree(const RegexTree &tree) {
+  return CostWalker(tree).run();
+}
+
+VimRegexEngine chooseVimRegexEngine(const RegexTree &tree) {
+  return EngineWalker(tree).run();
+}
+
+std::string_view vimRegexEnginePrefix(VimRegexEngine engine) {
+  switch (engine) {
+  case VimRegexEngine::Backtracking:
+    return "\\%#=1";
+  case VimRegexEngine::Nfa:
+    return "\\%#=2";
+  default:
+    return {};
+  }
+}
+
+void writeRegexReport(std::ostream &os, std::vector<RegexReport> reports,
+                      size_t limit) {
+  size_t flagged = 0;
+  size_t rejected = 0;
+  for (const auto &report : reports) {
+    flagged += report.cost.findings.empty() ? 0 : 1;
+    rejected += report.error.empty() ? 0 : 1;
+  }
+  os << "Analyzed " << reports.size() << " regexes: " << flagged
+     << " flagged, " << rejected << " rejected by Oniguruma\n";
+
+  // Worst first; equal scores keep grammar order
+  std::stable_sort(reports.begin(), reports.end(),
+                   [](const RegexReport &a, const RegexReport &b) {
+                     return a.cost.score > b.cost.score;
+                   });
+
+  size_t shown = limit == 0 ? reports.size() : std::min(limit, reports.size());
+  if (shown > 0) {
+    os << "\nRank  Score  Rule\n";
+  }
+  for (size_t i = 0; i < shown; ++i) {
+    const RegexReport &report = reports[i];
+    os << std::setw(4) << (i + 1) << std::setw(7) << report.cost.score << "  "
+       << report.location << " " << report.field;
+    if (!report.name.empty()) {
+      os << " (" << report.name << ")";
+    }
+    os << "\n";
+
+    const std::string indent(13, ' ');
+    if (!report.cost.findings.empty()) {
+      os << indent;
+      for (size_t j = 0; j < report.cost.findings.size(); ++j) {
+        os << (j > 0 ? "; " : "") << report.cost.findings[j];
+      }
+      os << "\n";
+    }
+    os << indent;
+    if (report.pattern.size() > kMaxPatternWidth) {
+      os << report.pattern.substr(0, kMaxPatternWidth) << "...";
+    } else {
+      os << report.pattern;
+    }
+    os << "\n";
+  }
+
+  if (rejected > 0) {
+    os << "\nOniguruma errors:\n";
+    for (const auto &report : reports) {
+      if (!report.error.empty()) {
+        os << "  " << report.location << " " << report.field << ": "
+           << report.error << "\n";
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef REGEX_ANALYZER_H
+#define REGEX_ANALYZER_H
+
+#include "vim_regex.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Vim regex engines, selected by "\%#=N" at the start of a pattern
+enum class VimRegexEngine : uint8_t {
+  Auto = 0,         // Left to Vim ('regexpengine')
+  Backtracking = 1, // Old engine
+  Nfa = 2,          // NFA engine
+};
+
+// Estimated matching cost of one regex in Vim
+struct RegexCost {
+  int score = 0;
+  std::vector<std::string> findings; // Constructs that raised the score
+};
+
+// Analysis result of one match/begin/end regex of a grammar
+struct RegexReport {
+  std::string location; // Rule path, e.g. "repository.strings/patterns[1]"
+  std::string field;    // "match", "begin" or "end"
+  std::string name;     // Scope name of the pattern
+  std::string pattern;  // Generated Vim regex
+  std::string error;    // Oniguruma compile error (empty if it compiles)
+  RegexCost cost;
+};
+
+// Initialize Oniguruma for UTF-8 once per process
+void initializeOnigurumaOnce();
+
+// Compile a regex with Oniguruma (as TextMate does) to check it is valid
+bool compileOniguruma(std::string_view regex, std::string &error);
+
+// Score a parsed regex by the constructs that make Vim's matcher slow:
+// nested unbounded quantifiers, unbounded lookbehind, a leading ".*",
+// very large alternations and back references
+RegexCost analyzeRegexTree(const RegexTree &tree);
+
+// Engine likely to match a parsed regex faster in syntax highlighting:
+// NFA for nested quantifiers and lookbehinds, backtracking otherwise (Auto
+// for trees cut off at the nesting limit)
+VimRegexEngine chooseVimRegexEngine(const RegexTree &tree);
+
+// Pattern prefix selecting an engine ("" for Auto)
+std::string_view vimRegexEnginePrefix(VimRegexEngine engine);
+
+// Write the reports ranked by score, at most `limit` of them (0 = all)
+void writeRegexReport(std::ostream &os, std::vector<RegexReport> reports,
+                      size_t limit);
+
+#endif
@@ -0,0 +1,86 @@
+#include "regex_cache.hxx"
+#include <mutex>
+
+const RegexTranslationCache::Entry &
+RegexTranslationCache::translate(std::string_view regex,
+                                 VimRegexTranslator &translator) {
+  Shard &shard = shards_[std::hash<std::string_view>()(regex) % kShards];
+  shard.lookups.fetch_add(1, std::memory_order_relaxed);
+  // Scratch key reused per lookup; the maps cannot look a string_view up
+  thread_local std::string key;
+  key.assign(regex);
+
+  const Entry *entry = nullptr;
+  {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+      entry = &it->second;
+    }
+  }
+  if (!entry) {
+    // Translated without the lock; when two threads miss the same regex,
+    // the first to insert wins and both translations count as misses
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    const std::string &vim = translator.translate(regex);
+    VimRegexEngine engine = chooseVimRegexEngine(translator.tree());
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    entry = &shard.entries.try_emplace(key, vim, engine, generation_)
+                 .first->second;
+  }
+  // Skip the store when it would not change anything, so that threads
+  // reading a common entry do not fight over its cache line
+  if (entry->generation.load(std::memory_order_relaxed) != generation_) {
+    entry->generation.store(generation_, std::memory_order_relaxed);
+  }
+  return *entry;
+}
+
+void RegexTranslationCache::prune() {
+  for (Shard &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+      if (it->second.generation.load(std::memory_order_relaxed) !=
+          generation_) {
+        it = shard.entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    shard.lookups.store(0, std::memory_order_relaxed);
+    shard.misses.store(0, std::memory_order_relaxed);
+  }
+  generation_++;
+}
+
+size_t RegexTranslationCache::lookups() const {
+  size_t total = 0;
+  for (const Shard &shard : shards_) {
+    total += shard.lookups.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+size_t RegexTranslationCache::misses() const {
+  size_t total = 0;
+  for (const Shard &shard : shards_) {
+    total += shard.misses.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+size_t RegexTranslationCache::hits() const {
+  // Read while other threads look regexes up, misses can run ahead
+  size_t looked = lookups();
+  size_t missed = misses();
+  return looked > missed ? looked - missed : 0;
+}
+
+size_t RegexTranslationCache::size() const {
+  size_t total = 0;
+  for (const Shard &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    total += shard.entries.size();
+  }
+  return total;
+}
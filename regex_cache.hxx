@@ -0,0 +1,68 @@
+#ifndef REGEX_CACHE_H
+#define REGEX_CACHE_H
+
+#include "regex_analyzer.hxx"
+#include "vim_regex.hxx"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Vim translations of TextMate regexes by source text. Kept from one
+// conversion of a grammar to the next so that only the regexes an edit
+// changed are translated again, or shared by the grammars of a batch, whose
+// escapes, numbers and identifiers recur from one grammar to the next.
+//
+// Safe to use from several threads: the entries are split between shards by
+// the hash of their regex, each with a lock of its own, so lookups only
+// contend when they hit the same shard and translations run without any
+// lock held. prune() must not run concurrently with translate().
+class RegexTranslationCache {
+public:
+  struct Entry {
+    Entry(std::string vim, VimRegexEngine engine, uint64_t generation)
+        : vim(std::move(vim)), engine(engine), generation(generation) {}
+
+    std::string vim;       // Vim regex without the engine prefix
+    VimRegexEngine engine; // Engine chosen for it
+    // Last generation the entry was used in
+    mutable std::atomic<uint64_t> generation;
+  };
+
+  // Translation of a regex, translated with `translator` if it is not
+  // cached yet. The entry stays valid until the next prune.
+  const Entry &translate(std::string_view regex,
+                         VimRegexTranslator &translator);
+
+  // Drop the entries not used since the last prune, so regexes removed from
+  // the grammar do not pile up, and reset the counters
+  void prune();
+
+  // Regexes looked up, found and translated since the last prune
+  size_t lookups() const;
+  size_t misses() const;
+  size_t hits() const;
+
+  size_t size() const;
+
+private:
+  static constexpr size_t kShards = 64;
+
+  // On a cache line of its own, so that threads using neighbouring shards
+  // do not slow each other down
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex; // Guards entries
+    std::unordered_map<std::string, Entry> entries;
+    std::atomic<size_t> lookups{0};
+    std::atomic<size_t> misses{0};
+  };
+
+  std::array<Shard, kShards> shards_;
+  uint64_t generation_ = 0;
+};
+
+#endif
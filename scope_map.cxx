@@ -0,0 +1,309 @@
+#include "scope_map.hxx"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+// Built-in mappings, most specific first. Based on official Vim syntax files.
+constexpr ScopeMapping kDefaultMappings[] = {
+    // Comments
+    {"comment.line", "Comment"},
+    {"comment.block", "Comment"},
+    {"comment", "Comment"},
+
+    // Keywords - more specific mappings
+    {"keyword.package", "Statement"},
+    {"keyword.control.import", "Statement"},
+    {"keyword.control.go", "Conditional"},
+    {"keyword.control", "Conditional"},
+    {"keyword.function", "Keyword"},
+    {"keyword.var", "Keyword"},
+    {"keyword.const", "Keyword"},
+    {"keyword.type", "Keyword"},
+    {"keyword.interface", "Keyword"},
+    {"keyword.struct", "Keyword"},
+    {"keyword.map", "Keyword"},
+    {"keyword.channel", "Keyword"},
+    {"keyword.operator", "Operator"},
+    {"keyword", "Keyword"},
+
+    // Storage types - Go built-in types
+    {"storage.type.boolean", "Boolean"},
+    {"storage.type.numeric", "Type"},
+    {"storage.type.string", "Type"},
+    {"storage.type.byte", "Type"},
+    {"storage.type.rune", "Type"},
+    {"storage.type.uintptr", "Type"},
+    {"storage.type.error", "Type"},
+    {"storage.type", "Type"},
+    {"storage", "StorageClass"},
+
+    // Strings
+    {"string.quoted.double", "String"},
+    {"string.quoted.raw", "String"},
+    {"string.quoted.rune", "Character"},
+    {"string", "String"},
+
+    // Constants
+    {"constant.numeric", "Number"},
+    {"constant.character.escape", "SpecialChar"},
+    {"constant.other.placeholder", "SpecialChar"},
+    {"constant.other.rune", "Character"},
+    {"constant.language", "Boolean"},
+    {"constant", "Constant"},
+
+    // Functions
+    {"entity.name.function.support.builtin", "Function"},
+    {"entity.name.function", "Function"},
+    {"support.function.builtin", "Function"},
+    {"support.function", "Function"},
+
+    // Types and entities
+    {"entity.name.type.package", "Identifier"},
+    {"entity.name.type.any", "Type"},
+    {"entity.name.type.comparable", "Type"},
+    {"entity.name.type", "Type"},
+
+    // Variables
+    {"variable.parameter", "Identifier"},
+    {"variable.other.assignment", "Identifier"},
+    {"variable.other", "Identifier"},
+    {"variable", "Identifier"},
+
+    // Punctuation - more specific
+    {"punctuation.terminator", "Delimiter"},
+    {"punctuation.separator", "Delimiter"},
+    {"punctuation.definition.begin", "Delimiter"},
+    {"punctuation.definition.end", "Delimiter"},
+    {"punctuation.other", "Delimiter"},
+    {"punctuation", "Delimiter"},
+
+    // Invalid/Error
+    {"invalid.illegal", "Error"},
+    {"invalid", "Error"},
+
+    // Support
+    {"support.type", "Type"},
+    {"support", "Special"},
+
+    // Meta
+    {"meta.function", "Function"},
+    {"meta.type", "Type"},
+
+};
+
+constexpr uint32_t kNoMatch = UINT32_MAX;
+
+// One state per pattern character plus the root
+constexpr size_t countStates(const ScopeMapping *entries, size_t count) {
+  size_t states = 1;
+  for (size_t i = 0; i < count; ++i) {
+    states += entries[i].scope.size();
+  }
+  return states;
+}
+
+// Distinct pattern characters plus symbol 0 for every other byte
+constexpr size_t countSymbols(const ScopeMapping *entries, size_t count) {
+  bool seen[256] = {};
+  size_t symbols = 1;
+  for (size_t i = 0; i < count; ++i) {
+    for (char c : entries[i].scope) {
+      if (!seen[static_cast<unsigned char>(c)]) {
+        seen[static_cast<unsigned char>(c)] = true;
+        symbols++;
+      }
+    }
+  }
+  return symbols;
+}
+
+// Build the automaton of a mapping table into `table`, whose arrays are
+// sized by countStates()/countSymbols() and zero-filled. Used at compile
+// time for the built-in table and at run time for user tables.
+template <class Table>
+constexpr uint32_t buildAutomaton(const ScopeMapping *entries, size_t count,
+                                  Table &table) {
+  uint32_t symbols = 1;
+  for (size_t i = 0; i < count; ++i) {
+    for (char c : entries[i].scope) {
+      uint32_t &symbol = table.symbolOf[static_cast<unsigned char>(c)];
+      if (symbol == 0) {
+        symbol = symbols++;
+      }
+    }
+  }
+
+  // Trie of the patterns; no edge leads back to the root, so 0 marks a
+  // missing edge. A pattern listed twice keeps its first entry.
+  uint32_t states = 1;
+  table.output[0] = kNoMatch;
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t state = 0;
+    for (char c : entries[i].scope) {
+      uint32_t &edge =
+          table.next[state * symbols +
+                     table.symbolOf[static_cast<unsigned char>(c)]];
+      if (edge == 0) {
+        edge = states;
+        table.output[states] = kNoMatch;
+        states++;
+      }
+      state = edge;
+    }
+    table.output[state] = std::min(table.output[state],
+                                   static_cast<uint32_t>(i));
+  }
+
+  // Breadth-first: every state inherits the output of its failure state
+  // and missing edges are filled from it, which turns the trie into a DFA
+  size_t head = 0;
+  size_t tail = 0;
+  for (uint32_t symbol = 1; symbol < symbols; ++symbol) {
+    if (uint32_t child = table.next[symbol]) {
+      table.fail[child] = 0;
+      table.queue[tail++] = child;
+    }
+  }
+  while (head < tail) {
+    uint32_t state = table.queue[head++];
+    uint32_t fail = table.fail[state];
+    table.output[state] = std::min(table.output[state], table.output[fail]);
+    for (uint32_t symbol = 1; symbol < symbols; ++symbol) {
+      uint32_t &edge = table.next[state * symbols + symbol];
+      uint32_t fallback = table.next[fail * symbols + symbol];
+      if (edge != 0) {
+        table.fail[edge] = fallback;
+        table.queue[tail++] = edge;
+      } else {
+        edge = fallback;
+      }
+    }
+  }
+  return symbols;
+}
+
+template <size_t States, size_t Symbols> struct FixedTable {
+  std::array<uint32_t, 256> symbolOf{};
+  std::array<uint32_t, States * Symbols> next{};
+  std::array<uint32_t, States> output{};
+  std::array<uint32_t, States> fail{};
+  std::array<uint32_t, States> queue{};
+};
+
+struct VectorTable {
+  std::vector<uint32_t> symbolOf;
+  std::vector<uint32_t> next;
+  std::vector<uint32_t> output;
+  std::vector<uint32_t> fail;
+  std::vector<uint32_t> queue;
+};
+
+constexpr size_t kDefaultStates =
+    countStates(kDefaultMappings, std::size(kDefaultMappings));
+constexpr size_t kDefaultSymbols =
+    countSymbols(kDefaultMappings, std::size(kDefaultMappings));
+
+constexpr FixedTable<kDefaultStates, kDefaultSymbols> makeDefaultTable() {
+  FixedTable<kDefaultStates, kDefaultSymbols> table;
+  buildAutomaton(kDefaultMappings, std::size(kDefaultMappings), table);
+  return table;
+}
+
+constexpr auto kDefaultTable = makeDefaultTable();
+
+constexpr ScopeMatcher kDefaultMatcher(kDefaultMappings,
+                                       kDefaultTable.symbolOf.data(),
+                                       kDefaultTable.next.data(),
+                                       kDefaultTable.output.data(),
+                                       kDefaultSymbols);
+
+bool isHighlightGroup(std::string_view name) {
+  return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  });
+}
+
+} // namespace
+
+std::string_view ScopeMatcher::lookup(std::string_view scope) const {
+  uint32_t state = 0;
+  uint32_t best = kNoMatch;
+  for (char c : scope) {
+    state = next_[state * symbols_ + symbolOf_[static_cast<unsigned char>(c)]];
+    best = std::min(best, output_[state]);
+  }
+  return best == kNoMatch ? std::string_view() : entries_[best].group;
+}
+
+const ScopeMatcher &defaultScopeMatcher() { return kDefaultMatcher; }
+
+ScopeMap::ScopeMap() : matcher_(kDefaultMatcher) {}
+
+bool ScopeMap::load(const std::string &path, std::string &error) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    error = "Cannot open scope map: " + path;
+    return false;
+  }
+  std::vector<char> text((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+  // Entries point into `text`, whose buffer is kept when it is moved
+  std::vector<ScopeMapping> entries;
+  std::string_view rest(text.data(), text.size());
+  size_t lineNumber = 0;
+  while (!rest.empty()) {
+    size_t end = rest.find('\n');
+    std::string_view line = rest.substr(0, end);
+    rest = end == std::string_view::npos ? std::string_view()
+                                         : rest.substr(end + 1);
+    lineNumber++;
+
+    std::string_view fields[3];
+    size_t found = 0;
+    size_t pos = 0;
+    while (found < 3) {
+      pos = line.find_first_not_of(" \t\r", pos);
+      if (pos == std::string_view::npos) {
+        break;
+      }
+      size_t stop = line.find_first_of(" \t\r", pos);
+      fields[found++] = line.substr(pos, stop - pos);
+      pos = stop;
+    }
+    if (found == 0 || fields[0][0] == '#') {
+      continue;
+    }
+    if (found != 2 || !isHighlightGroup(fields[1])) {
+      error = path + ":" + std::to_string(lineNumber) +
+              ": expected \"<scope> <highlight-group>\"";
+      return false;
+    }
+    entries.push_back({fields[0], fields[1]});
+  }
+  entries.insert(entries.end(), std::begin(kDefaultMappings),
+                 std::end(kDefaultMappings));
+
+  size_t states = countStates(entries.data(), entries.size());
+  size_t symbols = countSymbols(entries.data(), entries.size());
+  VectorTable table;
+  table.symbolOf.assign(256, 0);
+  table.next.assign(states * symbols, 0);
+  table.output.assign(states, 0);
+  table.fail.assign(states, 0);
+  table.queue.assign(states, 0);
+  buildAutomaton(entries.data(), entries.size(), table);
+
+  text_ = std::move(text);
+  entries_ = std::move(entries);
+  symbolOf_ = std::move(table.symbolOf);
+  next_ = std::move(table.next);
+  output_ = std::move(table.output);
+  matcher_ = ScopeMatcher(entries_.data(), symbolOf_.data(), next_.data(),
+                          output_.data(), static_cast<uint32_t>(symbols));
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef SCOPE_MAP_H
+#define SCOPE_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// TextMate scope pattern and the Vim highlight group it links to
+struct ScopeMapping {
+  std::string_view scope;
+  std::string_view group;
+};
+
+// Finds the highlight group of a scope in one pass over the scope name.
+// A table of mappings is compiled into a dense Aho-Corasick automaton over
+// the characters used by its patterns; the first mapping in table order
+// whose pattern occurs in the scope wins.
+class ScopeMatcher {
+public:
+  constexpr ScopeMatcher(const ScopeMapping *entries, const uint32_t *symbolOf,
+                         const uint32_t *next, const uint32_t *output,
+                         uint32_t symbols)
+      : entries_(entries), symbolOf_(symbolOf), next_(next), output_(output),
+        symbols_(symbols) {}
+
+  // Highlight group for a scope (empty if no mapping matches)
+  std::string_view lookup(std::string_view scope) const;
+
+private:
+  const ScopeMapping *entries_;
+  const uint32_t *symbolOf_; // Byte -> symbol (0 = not in any pattern)
+  const uint32_t *next_;     // State x symbol -> state
+  const uint32_t *output_;   // State -> first matching entry
+  uint32_t symbols_;
+};
+
+// Built-in mappings, compiled at build time
+const ScopeMatcher &defaultScopeMatcher();
+
+// Scope mappings read from a user file, taking precedence over the built-in
+// table. Each line of the file is "<scope> <highlight-group>"; blank lines
+// and lines starting with '#' are skipped. As with the built-in table a
+// mapping applies to every scope containing its pattern, and earlier lines
+// win over later ones.
+class ScopeMap {
+public:
+  ScopeMap();
+  ScopeMap(const ScopeMap &) = delete;
+  ScopeMap &operator=(const ScopeMap &) = delete;
+
+  bool load(const std::string &path, std::string &error);
+
+  std::string_view lookup(std::string_view scope) const {
+    return matcher_.lookup(scope);
+  }
+
+private:
+  std::vector<char> text_; // File content the user entries point into
+  std::vector<ScopeMapping> entries_;
+  std::vector<uint32_t> symbolOf_;
+  std::vector<uint32_t> next_;
+  std::vector<uint32_t> output_;
+  ScopeMatcher matcher_;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "syntax_items.hxx"
+#include <streambuf>
+
+namespace {
+
+// Stream buffer that only counts what is written to it
+class CountingBuffer : public std::streambuf {
+public:
+  size_t count() const { return count_; }
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      count_++;
+    }
+    return traits_type::not_eof(ch);
+  }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    count_ += static_cast<size_t>(n);
+    return n;
+  }
+
+private:
+  size_t count_ = 0;
+};
+
+// Delimiters in order of preference
+constexpr char kDelimiters[] = {'@', '#', '|', '~', '!', '%', '^', '&', '*'};
+
+bool patternHas(const SyntaxPattern &pattern, char c) {
+  return pattern.engine.find(c) != std::string::npos ||
+         pattern.text.find(c) != std::string::npos;
+}
+
+// Delimiter that works for both patterns of a region (or the one pattern of
+// a match), without building the patterns as strings
+char itemDelimiter(const SyntaxPattern &start, const SyntaxPattern *end) {
+  for (char delim : kDelimiters) {
+    if (!patternHas(start, delim) && !(end && patternHas(*end, delim))) {
+      return delim;
+    }
+  }
+  return '@';
+}
+
+} // namespace
+
+std::string chooseDelimiter(std::string_view pattern) {
+  for (char delim : kDelimiters) {
+    if (pattern.find(delim) == std::string_view::npos) {
+      return std::string(1, delim);
+    }
+  }
+  // Fallback to @ if all else fails
+  return "@";
+}
+
+void writeSyntaxItems(std::ostream &os, const std::vector<SyntaxItem> &items) {
+  for (const SyntaxItem &item : items) {
+    switch (item.kind) {
+    case SyntaxItem::Kind::Section:
+      os << "\n\" " << item.text << "\n";
+      continue;
+    case SyntaxItem::Kind::Comment:
+      os << "\" " << item.text << "\n";
+      continue;
+    case SyntaxItem::Kind::Cluster:
+      os << "syntax cluster " << item.group << " contains=" << item.text
+         << "\n";
+      continue;
+    case SyntaxItem::Kind::Sync:
+      os << "syntax sync " << item.text << "\n";
+      continue;
+    case SyntaxItem::Kind::Keyword:
+      os << "syntax keyword ";
+      break;
+    case SyntaxItem::Kind::Match:
+      os << "syntax match ";
+      break;
+    case SyntaxItem::Kind::Region:
+      os << "syntax region ";
+      break;
+    }
+    os << item.group;
+    if (item.contained) {
+      os << " contained";
+    }
+    if (item.kind == SyntaxItem::Kind::Keyword) {
+      os << " " << item.text;
+    } else if (item.kind == SyntaxItem::Kind::Match) {
+      char delim = itemDelimiter(item.pattern, nullptr);
+      os << " " << delim << item.pattern.engine << item.pattern.text << delim;
+    } else {
+      // Choose delimiter that works for both start and end
+      char delim = itemDelimiter(item.pattern, &item.end);
+      if (!item.matchGroup.empty()) {
+        os << " matchgroup=" << item.matchGroup;
+      }
+      os << " start=" << delim << item.pattern.engine << item.pattern.text
+         << delim << " end=" << delim << item.end.engine << item.end.text
+         << delim;
+      if (!item.contains.empty()) {
+        os << " contains=" << item.contains;
+      }
+    }
+    os << "\n";
+  }
+}
+
+size_t syntaxItemsSize(const std::vector<SyntaxItem> &items) {
+  CountingBuffer buffer;
+  std::ostream os(&buffer);
+  writeSyntaxItems(os, items);
+  return buffer.count();
+}
@@ -0,0 +1,73 @@
+#ifndef SYNTAX_ITEMS_H
+#define SYNTAX_ITEMS_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Vim pattern of a syntax item with the regex it was translated from
+struct SyntaxPattern {
+  std::string engine; // \%#=N prefix (may be empty)
+  std::string text;   // Vim regex without the prefix
+  std::string source; // Oniguruma regex of the grammar
+
+  // Pattern as written: the prefix followed by the regex
+  std::string vim() const { return engine + text; }
+};
+
+// Line of the syntax definitions of a generated file. The definitions are
+// generated as items first, so passes can rewrite them before writing.
+struct SyntaxItem {
+  enum class Kind {
+    Section, // Comment heading a part of the file, after an empty line
+    Comment, // Comment line
+    Keyword, // ":syntax keyword"; text is the keyword list
+    Match,   // ":syntax match" of pattern
+    Region,  // ":syntax region" from pattern to end
+    Cluster, // ":syntax cluster"; text is the contained groups
+    Sync     // ":syntax sync"; text is its arguments
+  };
+
+  Kind kind;
+  std::string group;      // Syntax group or cluster
+  bool contained = false; // Emitted with "contained"
+  std::string text;       // Comment, keywords, cluster groups or sync args
+  SyntaxPattern pattern;  // Match pattern or region start
+  SyntaxPattern end;      // Region end
+  std::string matchGroup; // Region "matchgroup=" (may be empty)
+  std::string contains;   // Region "contains=" list (may be empty)
+
+  SyntaxItem(Kind kind, std::string group = {}, bool contained = false,
+             std::string text = {})
+      : kind(kind), group(std::move(group)), contained(contained),
+        text(std::move(text)) {}
+
+  // Items made of their text alone
+  static SyntaxItem section(std::string text) {
+    return {Kind::Section, {}, false, std::move(text)};
+  }
+  static SyntaxItem comment(std::string text) {
+    return {Kind::Comment, {}, false, std::move(text)};
+  }
+  static SyntaxItem sync(std::string text) {
+    return {Kind::Sync, {}, false, std::move(text)};
+  }
+
+  bool isComment() const {
+    return kind == Kind::Section || kind == Kind::Comment;
+  }
+};
+
+// Choose a delimiter that doesn't appear in the pattern
+std::string chooseDelimiter(std::string_view pattern);
+
+// Write the items as Vim script lines
+void writeSyntaxItems(std::ostream &os, const std::vector<SyntaxItem> &items);
+
+// Number of bytes writeSyntaxItems() writes for the items
+size_t syntaxItemsSize(const std::vector<SyntaxItem> &items);
+
+#endif
@@ -0,0 +1,311 @@
+#include "syntax_passes.hxx"
+#include "keyword_lowering.hxx"
+#include "vim_regex.hxx"
+#include <chrono>
+#include <iomanip>
+#include <unordered_set>
+
+namespace {
+
+// Vim allows \1 .. \9, so a merged pattern can hold nine capture groups
+constexpr int kMaxCaptureGroups = 9;
+
+// State shared by the passes of one run
+struct PassState {
+  const SyncOptions &sync;
+  VimRegexTranslator translator;
+};
+
+// A pass rewrites the items and returns how many it changed
+using PassFunction = size_t (*)(std::vector<SyntaxItem> &, PassState &);
+
+size_t lowerKeywords(std::vector<SyntaxItem> &items, PassState &state) {
+  // Whole-word lists become keywords, which Vim finds with a hash lookup
+  // instead of trying a regex at every column
+  size_t changed = 0;
+  std::vector<std::string> keywords;
+  for (SyntaxItem &item : items) {
+    if (item.kind != SyntaxItem::Kind::Match || item.pattern.source.empty()) {
+      continue;
+    }
+    if (!extractKeywords(state.translator.parse(item.pattern.source),
+                         keywords)) {
+      continue;
+    }
+    item.kind = SyntaxItem::Kind::Keyword;
+    item.text.clear();
+    for (const auto &keyword : keywords) {
+      if (!item.text.empty()) {
+        item.text += " ";
+      }
+      item.text += keyword;
+    }
+    item.pattern = {};
+    changed++;
+  }
+  return changed;
+}
+
+// Retranslate a pattern with alternations factored
+bool factorPattern(SyntaxPattern &pattern, VimRegexTranslator &translator) {
+  if (pattern.source.find('|') == std::string::npos) {
+    return false;
+  }
+  const std::string &factored = translator.translate(pattern.source);
+  if (factored == pattern.text) {
+    return false;
+  }
+  pattern.text = factored;
+  return true;
+}
+
+size_t factorAlternations(std::vector<SyntaxItem> &items, PassState &state) {
+  size_t changed = 0;
+  state.translator.setFactorAlternations(true);
+  for (SyntaxItem &item : items) {
+    if (item.kind == SyntaxItem::Kind::Match) {
+      changed += factorPattern(item.pattern, state.translator);
+    } else if (item.kind == SyntaxItem::Kind::Region &&
+               !hasVimExternalGroups(item.pattern.text)) {
+      // Retranslating would undo the external groups of a start and end
+      bool start = factorPattern(item.pattern, state.translator);
+      bool end = factorPattern(item.end, state.translator);
+      changed += start || end;
+    }
+  }
+  return changed;
+}
+
+// Key under which equal items collide
+std::string itemKey(const SyntaxItem &item) {
+  std::string key(1, static_cast<char>('0' + static_cast<int>(item.kind)));
+  key += item.contained ? '1' : '0';
+  for (const std::string *part :
+       {&item.group, &item.text, &item.pattern.engine, &item.pattern.text,
+        &item.end.engine, &item.end.text, &item.matchGroup, &item.contains}) {
+    key += *part;
+    key += '\0';
+  }
+  return key;
+}
+
+// Remove the marked items, keeping the order of the others
+size_t eraseRemoved(std::vector<SyntaxItem> &items,
+                    const std::vector<bool> &removed) {
+  size_t out = 0;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (removed[i]) {
+      continue;
+    }
+    if (out != i) {
+      items[out] = std::move(items[i]);
+    }
+    out++;
+  }
+  size_t count = items.size() - out;
+  items.erase(items.begin() + out, items.end());
+  return count;
+}
+
+size_t dropDuplicates(std::vector<SyntaxItem> &items, PassState &) {
+  // Vim gives the item defined last priority, so of equal items the last
+  // one decides and the earlier ones change nothing
+  std::vector<bool> removed(items.size(), false);
+  std::unordered_set<std::string> seen;
+  for (size_t i = items.size(); i-- > 0;) {
+    if (!items[i].isComment() && !seen.insert(itemKey(items[i])).second) {
+      removed[i] = true;
+    }
+  }
+  return eraseRemoved(items, removed);
+}
+
+// Capture groups of a Vim pattern, or -1 if it cannot be a branch of a
+// larger alternation: back references would refer to the wrong group, \c
+// and \C apply to the whole pattern and \zs changes which branch Vim
+// considers to start first
+int mergeableCaptures(std::string_view pattern) {
+  int captures = 0;
+  for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+    if (pattern[i] != '\\') {
+      continue;
+    }
+    char c = pattern[++i];
+    if (c == '(') {
+      captures++;
+    } else if ((c >= '1' && c <= '9') || c == 'c' || c == 'C') {
+      return -1;
+    } else if (c == 'z' && i + 1 < pattern.size() && pattern[i + 1] == 's') {
+      return -1;
+    }
+  }
+  return captures;
+}
+
+size_t mergeMatches(std::vector<SyntaxItem> &items, PassState &) {
+  // Consecutive matches of one group become "later\|earlier": the first
+  // branch that matches wins, as the later item would
+  std::vector<bool> removed(items.size(), false);
+  size_t previous = items.size();
+  for (size_t i = 0; i < items.size(); ++i) {
+    SyntaxItem &item = items[i];
+    if (item.isComment()) {
+      continue;
+    }
+    if (previous < items.size()) {
+      SyntaxItem &earlier = items[previous];
+      if (item.kind == SyntaxItem::Kind::Match &&
+          earlier.kind == SyntaxItem::Kind::Match &&
+          item.group == earlier.group && item.contained == earlier.contained &&
+          item.pattern.engine == earlier.pattern.engine) {
+        int captures = mergeableCaptures(item.pattern.text);
+        int earlierCaptures = mergeableCaptures(earlier.pattern.text);
+        if (captures >= 0 && earlierCaptures >= 0 &&
+            captures + earlierCaptures <= kMaxCaptureGroups) {
+          item.pattern.text += "\\|" + earlier.pattern.text;
+          item.pattern.source = "(?:" + item.pattern.source + ")|(?:" +
+                                earlier.pattern.source + ")";
+          removed[previous] = true;
+        }
+      }
+    }
+    previous = i;
+  }
+  return eraseRemoved(items, removed);
+}
+
+size_t addSyncRules(std::vector<SyntaxItem> &items, PassState &state) {
+  // Regions Vim can be inside when it starts parsing mid-file
+  std::vector<SyncRegion> regions;
+  for (const SyntaxItem &item : items) {
+    if (item.kind != SyntaxItem::Kind::Region || item.contained) {
+      continue;
+    }
+    const RegexTree &endTree = state.translator.parse(item.end.source);
+    regions.push_back(
+        {item.group, item.pattern.vim(),
+         classifySyncRegion(item.pattern.text, item.end.text, endTree)});
+  }
+  SyncPlan plan = planSyntaxSync(regions, state.sync);
+
+  // Sync patterns refer to the regions, so they come after them
+  size_t count = items.size();
+  items.push_back(SyntaxItem::section("Synchronization"));
+  auto addSync = [&items](std::string text) {
+    items.push_back(SyntaxItem::sync(std::move(text)));
+  };
+  if (plan.method == SyncMethod::FromStart) {
+    addSync("fromstart");
+    return items.size() - count;
+  }
+  for (const SyncRegion *region : plan.patterns) {
+    std::string delim = chooseDelimiter(region->start);
+    addSync("match " + region->group + "_sync grouphere " + region->group +
+            " " + delim + region->start + delim);
+  }
+  std::string text;
+  if (plan.method == SyncMethod::CComment) {
+    text = "ccomment ";
+    if (!plan.commentGroup.empty()) {
+      text += plan.commentGroup + " ";
+    }
+  }
+  text += "minlines=" + std::to_string(plan.minLines);
+  if (plan.maxLines > 0) {
+    text += " maxlines=" + std::to_string(plan.maxLines);
+  }
+  addSync(std::move(text));
+  return items.size() - count;
+}
+
+struct PassEntry {
+  SyntaxPass pass;
+  std::string_view name;
+  PassFunction run;
+};
+
+// Pipeline order; every pass sees the output of the ones before it
+constexpr PassEntry kPasses[kSyntaxPassCount] = {
+    {SyntaxPass::Keywords, "keywords", lowerKeywords},
+    {SyntaxPass::Factor, "factor", factorAlternations},
+    {SyntaxPass::Dedupe, "dedupe", dropDuplicates},
+    {SyntaxPass::Merge, "merge", mergeMatches},
+    {SyntaxPass::Sync, "sync", addSyncRules},
+};
+
+} // namespace
+
+SyntaxPassSet syntaxPassesForLevel(int level) {
+  if (level <= 0) {
+    return 0;
+  }
+  SyntaxPassSet passes = syntaxPassBit(SyntaxPass::Keywords) |
+                         syntaxPassBit(SyntaxPass::Dedupe) |
+                         syntaxPassBit(SyntaxPass::Sync);
+  if (level >= 2) {
+    passes |= syntaxPassBit(SyntaxPass::Factor) |
+              syntaxPassBit(SyntaxPass::Merge);
+  }
+  return passes;
+}
+
+std::string_view syntaxPassName(SyntaxPass pass) {
+  return kPasses[static_cast<size_t>(pass)].name;
+}
+
+bool parseSyntaxPass(std::string_view name, SyntaxPass &pass) {
+  for (const PassEntry &entry : kPasses) {
+    if (entry.name == name) {
+      pass = entry.pass;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<SyntaxPassReport> runSyntaxPasses(std::vector<SyntaxItem> &items,
+                                              SyntaxPassSet passes,
+                                              const SyncOptions &sync,
+                                              bool measureSizes) {
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<SyntaxPassReport> reports;
+  PassState state{sync, {}};
+  size_t bytes = measureSizes ? syntaxItemsSize(items) : 0;
+  for (const PassEntry &entry : kPasses) {
+    if (!(passes & syntaxPassBit(entry.pass))) {
+      continue;
+    }
+    SyntaxPassReport report;
+    report.pass = entry.pass;
+    report.itemsBefore = items.size();
+    report.bytesBefore = bytes;
+    Clock::time_point start = Clock::now();
+    report.changed = entry.run(items, state);
+    report.milliseconds =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    if (measureSizes) {
+      bytes = syntaxItemsSize(items);
+    }
+    report.itemsAfter = items.size();
+    report.bytesAfter = bytes;
+    reports.push_back(report);
+  }
+  return reports;
+}
+
+void writeSyntaxPassReport(std::ostream &os,
+                           const std::vector<SyntaxPassReport> &reports) {
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  for (const SyntaxPassReport &report : reports) {
+    os << std::left << std::setw(10) << syntaxPassName(report.pass)
+       << std::right << std::fixed << std::setprecision(3) << std::setw(9)
+       << report.milliseconds << " ms  " << report.changed << " changed, "
+       << report.itemsBefore << " -> " << report.itemsAfter << " items, "
+       << report.bytesBefore << " -> " << report.bytesAfter << " bytes\n";
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
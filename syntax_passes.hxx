@@ -0,0 +1,64 @@
+#ifndef SYNTAX_PASSES_H
+#define SYNTAX_PASSES_H
+
+#include "syntax_items.hxx"
+#include "syntax_sync.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Whole-grammar transformations of the syntax items, run between generating
+// and writing them, in this order
+enum class SyntaxPass : uint8_t {
+  Keywords, // Lower whole-word literal matches to ":syntax keyword"
+  Factor,   // Print large literal alternations as a prefix trie
+  Dedupe,   // Drop items equal to a later item
+  Merge,    // Merge consecutive matches of a group into one alternation
+  Sync,     // Add the ":syntax sync" setup derived from the regions
+};
+
+constexpr size_t kSyntaxPassCount = 5;
+
+// Set of passes, one bit per SyntaxPass
+using SyntaxPassSet = uint32_t;
+
+constexpr SyntaxPassSet syntaxPassBit(SyntaxPass pass) {
+  return SyntaxPassSet(1) << static_cast<unsigned>(pass);
+}
+
+// Passes of an optimization level: 0 runs none, 1 the cheap ones that make
+// the file load faster (keywords, dedupe, sync) and 2 (the default) all
+SyntaxPassSet syntaxPassesForLevel(int level);
+
+// Name of a pass on the command line
+std::string_view syntaxPassName(SyntaxPass pass);
+
+// Parse a pass name
+bool parseSyntaxPass(std::string_view name, SyntaxPass &pass);
+
+// What running one pass did
+struct SyntaxPassReport {
+  SyntaxPass pass;
+  double milliseconds = 0;
+  size_t changed = 0; // Items the pass rewrote, removed or added
+  size_t itemsBefore = 0;
+  size_t itemsAfter = 0;
+  size_t bytesBefore = 0; // Size of the items as written, if measured
+  size_t bytesAfter = 0;
+};
+
+// Run the enabled passes over the items in pipeline order. Measuring the
+// sizes in the reports means writing the items out after every pass, so it
+// is only done on request.
+std::vector<SyntaxPassReport> runSyntaxPasses(std::vector<SyntaxItem> &items,
+                                              SyntaxPassSet passes,
+                                              const SyncOptions &sync,
+                                              bool measureSizes = false);
+
+// Print one line per pass with its time and changes
+void writeSyntaxPassReport(std::ostream &os,
+                           const std::vector<SyntaxPassReport> &reports);
+
+#endif
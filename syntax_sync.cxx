@@ -0,0 +1,171 @@
+#include "syntax_sync.hxx"
+#include <utility>
+
+namespace {
+
+// Lines parsed back when nothing crosses a line end
+constexpr int kSingleLineMinLines = 1;
+// Lines parsed back before a sync point, for matches spanning a few lines
+constexpr int kContextMinLines = 10;
+// Lines parsed back when a region can only be recovered by parsing it again
+constexpr int kBlindMinLines = 50;
+// Lines searched for a sync point or a C comment
+constexpr int kSearchMaxLines = 500;
+
+// Whether a regex matches at every line end, at the latest where it starts.
+// A region with such an end pattern cannot continue on the next line.
+bool matchesAtLineEnd(const RegexTree &tree, uint32_t index) {
+  const RegexNode &node = tree.nodes[index];
+  switch (node.kind) {
+  case RegexNodeKind::LineEnd:
+    return true;
+  case RegexNodeKind::Literal:
+    return node.ch == '\n';
+  case RegexNodeKind::Escape:
+    return tree.nodeText(node) == "\\n";
+  case RegexNodeKind::Sequence:
+    for (uint32_t i = 0; i < node.count; ++i) {
+      if (!matchesAtLineEnd(tree, tree.child(node, i))) {
+        return false;
+      }
+    }
+    return node.count > 0;
+  case RegexNodeKind::Alternation:
+    for (uint32_t i = 0; i < node.count; ++i) {
+      if (matchesAtLineEnd(tree, tree.child(node, i))) {
+        return true;
+      }
+    }
+    return false;
+  case RegexNodeKind::Group:
+    return (node.group == RegexGroupKind::Capture ||
+            node.group == RegexGroupKind::NonCapture ||
+            node.group == RegexGroupKind::Lookahead ||
+            node.group == RegexGroupKind::Atomic) &&
+           matchesAtLineEnd(tree, node.first);
+  case RegexNodeKind::Repeat:
+    return node.min == 0 || matchesAtLineEnd(tree, node.first);
+  default:
+    return false;
+  }
+}
+
+// Whether a regex refers back to a group, which in an end pattern is a group
+// of the start
+bool hasBackref(const RegexTree &tree) {
+  for (const RegexNode &node : tree.nodes) {
+    if (node.kind == RegexNodeKind::Backref) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+bool parseSyncMethod(std::string_view name, SyncMethod &method) {
+  static constexpr std::pair<std::string_view, SyncMethod> kNames[] = {
+      {"auto", SyncMethod::Auto},         {"fromstart", SyncMethod::FromStart},
+      {"ccomment", SyncMethod::CComment}, {"match", SyncMethod::Match},
+      {"lines", SyncMethod::Lines}};
+  for (const auto &entry : kNames) {
+    if (entry.first == name) {
+      method = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+SyncRegionKind classifySyncRegion(std::string_view start, std::string_view end,
+                                  const RegexTree &endTree) {
+  if (!endTree.truncated && matchesAtLineEnd(endTree, endTree.root)) {
+    return SyncRegionKind::SingleLine;
+  }
+  // A "grouphere" pattern cannot supply the start text the end needs
+  if (hasBackref(endTree)) {
+    return SyncRegionKind::Dependent;
+  }
+  // The form ":syntax sync ccomment" expects
+  if (start == "/\\*" && end == "\\*/") {
+    return SyncRegionKind::CComment;
+  }
+  if (start == end) {
+    return SyncRegionKind::Symmetric;
+  }
+  return SyncRegionKind::Distinct;
+}
+
+SyncPlan planSyntaxSync(const std::vector<SyncRegion> &regions,
+                        const SyncOptions &options) {
+  bool crossing = false;
+  bool symmetric = false;
+  bool distinct = false;
+  const SyncRegion *comment = nullptr;
+  for (const auto &region : regions) {
+    switch (region.kind) {
+    case SyncRegionKind::SingleLine:
+      break;
+    case SyncRegionKind::CComment:
+      // Vim uses the last region defined with the group
+      comment = &region;
+      crossing = true;
+      break;
+    case SyncRegionKind::Symmetric:
+    case SyncRegionKind::Dependent:
+      symmetric = true;
+      crossing = true;
+      break;
+    case SyncRegionKind::Distinct:
+      distinct = true;
+      crossing = true;
+      break;
+    }
+  }
+
+  SyncPlan plan;
+  plan.method = options.method;
+  if (plan.method == SyncMethod::Auto) {
+    if (distinct) {
+      plan.method = SyncMethod::Match;
+    } else if (comment) {
+      plan.method = SyncMethod::CComment;
+    } else {
+      plan.method = SyncMethod::Lines;
+    }
+  }
+  if (plan.method == SyncMethod::FromStart) {
+    return plan;
+  }
+
+  if (plan.method == SyncMethod::CComment && comment) {
+    plan.commentGroup = comment->group;
+  }
+  if (plan.method == SyncMethod::Match) {
+    for (const auto &region : regions) {
+      if (region.kind == SyncRegionKind::CComment ||
+          region.kind == SyncRegionKind::Distinct) {
+        plan.patterns.push_back(&region);
+      }
+    }
+  }
+
+  // Regions that cannot be synced on are only recovered by parsing across
+  // their start
+  if (options.minLines >= 0) {
+    plan.minLines = options.minLines;
+  } else if (symmetric || (crossing && plan.method == SyncMethod::Lines)) {
+    plan.minLines = kBlindMinLines;
+  } else if (crossing) {
+    plan.minLines = kContextMinLines;
+  } else {
+    plan.minLines = kSingleLineMinLines;
+  }
+
+  if (options.maxLines >= 0) {
+    plan.maxLines = options.maxLines;
+  } else if (plan.method != SyncMethod::Lines) {
+    plan.maxLines = kSearchMaxLines;
+  }
+  return plan;
+}
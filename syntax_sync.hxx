@@ -0,0 +1,65 @@
+#ifndef SYNTAX_SYNC_H
+#define SYNTAX_SYNC_H
+
+#include "vim_regex.hxx"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How Vim finds the syntax state where redrawing starts (":syntax sync")
+enum class SyncMethod {
+  Auto,      // Chosen from the regions of the grammar
+  FromStart, // Always parse from the first line
+  CComment,  // Find out whether the line is inside a /* */ comment
+  Match,     // Search backwards for the start of a multi-line region
+  Lines,     // Parse a fixed number of lines back
+};
+
+// Sync settings requested on the command line
+struct SyncOptions {
+  SyncMethod method = SyncMethod::Auto;
+  int minLines = -1; // -1 = computed from the regions
+  int maxLines = -1; // -1 = computed from the regions
+};
+
+// Parse a sync method name: auto, fromstart, ccomment, match or lines
+bool parseSyncMethod(std::string_view name, SyncMethod &method);
+
+// How a top-level region can be found again when parsing starts mid-file
+enum class SyncRegionKind {
+  SingleLine, // Ends at every line end, so never crosses a line
+  CComment,   // Starts with "/*" and ends with "*/"
+  Symmetric,  // Same start and end pattern: a start cannot be told apart
+  Distinct,   // Crosses lines and has a start of its own
+  Dependent,  // Crosses lines and its end refers to text of its start
+};
+
+// Region emitted at top level
+struct SyncRegion {
+  std::string group; // Syntax group of the region
+  std::string start; // Vim start pattern
+  SyncRegionKind kind;
+};
+
+// Classify a region by its Vim start/end patterns and the parsed end regex
+SyncRegionKind classifySyncRegion(std::string_view start, std::string_view end,
+                                  const RegexTree &endTree);
+
+// Sync setup to emit
+struct SyncPlan {
+  SyncMethod method = SyncMethod::Lines; // Never Auto
+  int minLines = 0;                      // Unused for FromStart
+  int maxLines = 0;                      // 0 = no limit, not emitted
+  std::string commentGroup;              // Group for "ccomment" (may be empty)
+  std::vector<const SyncRegion *> patterns; // Regions to sync on for Match
+};
+
+// Choose the sync setup for the top-level regions of a grammar. Regions with
+// their own start are synced on with "grouphere" patterns; a C comment alone
+// is handled by "ccomment"; regions with the same start and end, or an end
+// that refers back to the start, can only be recovered by parsing enough lines
+// back, which raises "minlines".
+SyncPlan planSyntaxSync(const std::vector<SyncRegion> &regions,
+                        const SyncOptions &options);
+
+#endif
@@ -0,0 +1,45 @@
+// Translations of Oniguruma regexes the converter must get right, checked
+// against the Vim regex expected for each
+#include "vim_regex.hxx"
+#include <cstdio>
+#include <string_view>
+
+namespace {
+
+struct TranslationCase {
+  std::string_view regex;
+  std::string_view vim;
+};
+
+constexpr TranslationCase kCases[] = {
+    {"[a-z]+", "[a-z]\\+"},
+    {"[-a]", "[-a]"},
+    {"[a-]", "[a-]"},
+    {"[^-a]", "[^-a]"},
+    {"[\\x41-\\x5a]", "[\\x41-\\x5a]"},
+    // A "-" after a class escape or a range is a literal
+    {"[\\w-.]+", "[0-9A-Za-z_\\-.]\\+"},
+    {"[\\d-x]", "[0-9\\-x]"},
+    {"[a-z-_]", "[a-z\\-_]"},
+    // Code points beyond eight digits are left alone
+    {"\\x{1F600}", "\\%U0001f600"},
+    {"\\x{FFFFFFFFFFFFFFFFFFFFFFFF}", "\\x{FFFFFFFFFFFFFFFFFFFFFFFF}"},
+};
+
+} // namespace
+
+int main() {
+  VimRegexTranslator translator;
+  int failures = 0;
+  for (const TranslationCase &test : kCases) {
+    const std::string &vim = translator.translate(test.regex);
+    if (vim != test.vim) {
+      std::printf("%.*s: expected %.*s, got %s\n",
+                  static_cast<int>(test.regex.size()), test.regex.data(),
+                  static_cast<int>(test.vim.size()), test.vim.data(),
+                  vim.c_str());
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
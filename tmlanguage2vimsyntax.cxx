@@ -1,460 +1,314 @@
 #include "tmlanguage2vimsyntax.hxx"
+#include "grammar_cache.hxx"
+#include "grammar_loader.hxx"
+#include "grammar_registry.hxx"
+#include "keyword_lowering.hxx"
+#include "parallel.hxx"
 #include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
-TmLanguage2VimSyntax::TmLanguage2VimSyntax() {
+namespace {
+
+// Stream buffer that hands what is written to it to a SyntaxWriter in
+// chunks of its buffer size
+class WriterBuffer : public std::streambuf {
+public:
+  explicit WriterBuffer(const SyntaxWriter &write) : write_(write) {
+    setp(buffer_, buffer_ + sizeof(buffer_));
+  }
+
+protected:
+  int_type overflow(int_type ch) override {
+    sync();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+    return traits_type::not_eof(ch);
+  }
+
+  int sync() override {
+    if (pptr() > pbase()) {
+      write_(std::string_view(pbase(), static_cast<size_t>(pptr() - pbase())));
+      setp(buffer_, buffer_ + sizeof(buffer_));
+    }
+    return 0;
+  }
+
+private:
+  const SyntaxWriter &write_;
+  char buffer_[16384];
+};
+
+} // namespace
+
+std::string_view CaptureList::find(std::string_view key) const {
+  for (size_t i = 0; i < size(); ++i) {
+    if (this->key(i) == key) {
+      return name(i);
+    }
+  }
+  return {};
+}
+
+const RuleRecord *TextMateGrammar::findRule(std::string_view name) const {
+  auto it = std::lower_bound(repository.rules.begin(), repository.rules.end(),
+                             name, [this](const RuleRecord &rule,
+                                          std::string_view key) {
+                               return ruleName(rule) < key;
+                             });
+  if (it != repository.rules.end() && ruleName(*it) == name) {
+    return &*it;
+  }
+  return nullptr;
+}
+
+TmLanguage2VimSyntax::TmLanguage2VimSyntax(
+    const ConversionOptions &options, std::pmr::memory_resource *resource)
+    : options_(options), grammar_(resource), includes_(resource) {
   // Initialize converter
   initializeOniguruma();
+  includes_.build(grammar_);
 }
 
 TmLanguage2VimSyntax::~TmLanguage2VimSyntax() {
   // Cleanup resources
 }
 
-bool TmLanguage2VimSyntax::parseJson(const std::string &jsonContent) {
+bool TmLanguage2VimSyntax::parseGrammar(std::string_view content) {
+  reset();
   try {
-    parseJsonValue(jsonContent);
+    if (!options_.cacheDir.empty()) {
+      parseGrammarCached(content);
+    } else {
+      parseGrammarText(content);
+      // Translated up front when kept, split between threads or timed
+      if (options_.regexCache || resolveThreads(options_.threads) > 1 ||
+          options_.stats) {
+        translateRegexes();
+      }
+    }
+    includes_.build(grammar_);
+    if (options_.stats) {
+      stats_.grammarBytes = content.size();
+      countGrammar();
+    }
+    lastError_.clear();
     return true;
   } catch (const std::exception &e) {
-    std::cerr << "Error parsing JSON: " << e.what() << std::endl;
+    lastError_ = e.what();
     return false;
   }
 }
 
-void TmLanguage2VimSyntax::parseJsonValue(const std::string &jsonStr) {
-  using json = nlohmann::json;
-
-  try {
-    auto data = json::parse(jsonStr);
-
-    // Extract basic information
-    if (data.contains("name")) {
-      grammar_.name = data["name"];
-    }
-    if (data.contains("scopeName")) {
-      grammar_.scopeName = data["scopeName"];
-    }
+void TmLanguage2VimSyntax::reset() {
+  grammar_.clear();
+  includes_.build(grammar_);
+  reachability_ = {};
+  cacheHit_ = false;
+  lastError_.clear();
+  passReports_.clear();
+  embeddings_.clear();
+  stats_ = {};
+}
 
-    // Extract top-level patterns
-    if (data.contains("patterns")) {
-      for (const auto &patternJson : data["patterns"]) {
-        Pattern pattern = parsePattern(patternJson);
-        grammar_.patterns.push_back(pattern);
-      }
+void TmLanguage2VimSyntax::countGrammar() {
+  const PatternStore &store = grammar_.store;
+  stats_.rules = grammar_.repository.rules.size();
+  stats_.patterns = 0;
+  stats_.regexes = 0;
+  for (uint32_t i = 0; i < store.records.size(); ++i) {
+    if (!store.records[i].live) {
+      continue;
     }
-
-    // Extract repository rules
-    if (data.contains("repository")) {
-      for (const auto &[name, ruleJson] : data["repository"].items()) {
-        Pattern rule = parsePattern(ruleJson);
-        grammar_.repository.rules[name] = rule;
-      }
+    stats_.patterns++;
+    for (RegexField field : {kMatch, kBegin, kEnd}) {
+      stats_.regexes += !Pattern(store, i).regex(field).empty();
     }
-
-  } catch (const json::exception &e) {
-    throw std::runtime_error("JSON parse error: " + std::string(e.what()));
   }
 }
 
-Pattern TmLanguage2VimSyntax::parsePattern(const nlohmann::json &patternJson) {
-  Pattern pattern;
-
-  // Extract pattern name
-  if (patternJson.contains("name")) {
-    pattern.name = patternJson["name"];
-  }
-  if (patternJson.contains("match")) {
-    pattern.match = patternJson["match"];
-  }
-  if (patternJson.contains("begin")) {
-    pattern.begin = patternJson["begin"];
-  }
-  if (patternJson.contains("end")) {
-    pattern.end = patternJson["end"];
-  }
-  if (patternJson.contains("include")) {
-    pattern.include = patternJson["include"];
-  }
-
-  // Extract captures for match patterns
-  if (patternJson.contains("captures")) {
-    for (const auto &[key, value] : patternJson["captures"].items()) {
-      if (value.contains("name")) {
-        pattern.captures[key] = value["name"];
-      }
-    }
+void TmLanguage2VimSyntax::parseGrammarText(std::string_view text) {
+  PhaseTimer timer(collectedStats(), ConversionPhase::Parse);
+  // Fill grammar_ directly from parser events instead of building a DOM
+  std::string error;
+  bool parsed =
+      options_.reachableOnly
+          ? parseReachableGrammar(grammar_, text, reachability_, error)
+          : ::parseGrammar(grammar_, text, error);
+  if (!parsed) {
+    throw std::runtime_error(error);
   }
+}
 
-  // Extract beginCaptures for region patterns
-  if (patternJson.contains("beginCaptures")) {
-    for (const auto &[key, value] : patternJson["beginCaptures"].items()) {
-      if (value.contains("name")) {
-        pattern.beginCaptures[key] = value["name"];
-      }
-    }
+void TmLanguage2VimSyntax::parseGrammarCached(std::string_view text) {
+  uint64_t key = grammarCacheKey(text, options_.reachableOnly);
+  std::string path = grammarCachePath(options_.cacheDir, key);
+  {
+    PhaseTimer timer(collectedStats(), ConversionPhase::Parse);
+    cacheHit_ = loadGrammarCache(path, key, grammar_, reachability_);
   }
-
-  // Extract endCaptures for region patterns
-  if (patternJson.contains("endCaptures")) {
-    for (const auto &[key, value] : patternJson["endCaptures"].items()) {
-      if (value.contains("name")) {
-        pattern.endCaptures[key] = value["name"];
-      }
-    }
+  if (cacheHit_) {
+    return;
   }
 
-  // Extract nested patterns
-  if (patternJson.contains("patterns")) {
-    for (const auto &subPatternJson : patternJson["patterns"]) {
-      Pattern subPattern = parsePattern(subPatternJson);
-      pattern.patterns.push_back(subPattern);
-    }
-  }
-
-  return pattern;
+  parseGrammarText(text);
+  translateRegexes();
+  // The cache only saves time; a failed write leaves the next run cold
+  std::string error;
+  saveGrammarCache(path, key, grammar_, reachability_, error);
 }
 
-std::string
-TmLanguage2VimSyntax::convertRegexToVim(const std::string &regex) const {
-  std::string preprocessed = regex;
-
-  // Check for (?x) extended mode and remove whitespace/newlines if present
-  if (regex.find("(?x)") != std::string::npos) {
-    std::string result;
-    bool inExtendedMode = false;
-    bool inCharClass = false;
-    bool escaped = false;
-
-    for (size_t i = 0; i < regex.length(); ++i) {
-      // Check for (?x)
-      if (!escaped && i + 3 < regex.length() && regex.substr(i, 4) == "(?x)") {
-        inExtendedMode = true;
-        i += 3; // Skip (?x), will increment again in loop
-        continue;
-      }
-
-      if (escaped) {
-        result += regex[i];
-        escaped = false;
-        continue;
-      }
-
-      if (regex[i] == '\\') {
-        result += regex[i];
-        escaped = true;
-        continue;
-      }
-
-      if (regex[i] == '[')
-        inCharClass = true;
-      if (regex[i] == ']')
-        inCharClass = false;
-
-      // In extended mode, skip whitespace and newlines outside character
-      // classes
-      if (inExtendedMode && !inCharClass &&
-          (regex[i] == ' ' || regex[i] == '\t' || regex[i] == '\n' ||
-           regex[i] == '\r')) {
-        continue;
-      }
-
-      result += regex[i];
-    }
-
-    preprocessed = result;
+void TmLanguage2VimSyntax::translateRegexes() {
+  PhaseTimer timer(collectedStats(), ConversionPhase::Translate);
+  unsigned threads = resolveThreads(options_.threads);
+  if (threads > 1) {
+    translateRegexesInParallel(threads);
+    return;
   }
 
-  std::string result;
-  size_t i = 0;
-
-  while (i < preprocessed.length()) {
-    // Handle escaped characters from input
-    if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-      char next = preprocessed[i + 1];
-
-      // In Oniguruma:
-      // \( \) \{ \} = literal characters
-      // | + ? = operators (OR, one-or-more, zero-or-one)
-      // \| \+ \? = literal characters
-      //
-      // In Vim:
-      // ( ) { } = literal characters
-      // \( \) \{ \} = operators (grouping, quantifier)
-      // | + ? = literal characters
-      // \| \+ \? = operators (OR, one-or-more, zero-or-one)
-
-      if (next == '(' || next == ')' || next == '{' || next == '}') {
-        // Oniguruma \( -> Vim (
-        result += next;
-        i += 2;
-        continue;
-      }
-
-      if (next == '|' || next == '+' || next == '?' || next == '=') {
-        // Oniguruma \| \+ \? \= -> Vim | + ? =
-        // But for \|, use [|] to avoid confusion with Vim's \| operator
-        if (next == '|') {
-          result += "[|]";
-        } else {
-          result += next;
-        }
-        i += 2;
+  PatternStore &store = grammar_.store;
+  const uint32_t count = static_cast<uint32_t>(store.records.size());
+  store.translations.assign(size_t(count) * kRegexFields, {});
+  translator_.setFactorAlternations(false);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!store.records[i].live) {
+      continue;
+    }
+    for (RegexField field : {kMatch, kBegin, kEnd}) {
+      std::string_view regex = Pattern(store, i).regex(field);
+      if (regex.empty()) {
         continue;
       }
-
-      if (next == '&') {
-        // Oniguruma \& -> Vim & (literal in Vim)
-        result += next;
-        i += 2;
-        continue;
+      TranslatedRegex &translation =
+          store.translations[size_t(i) * kRegexFields + field];
+      if (options_.regexCache) {
+        // Unchanged regexes of an earlier conversion are not translated again
+        const RegexTranslationCache::Entry &entry =
+            options_.regexCache->translate(regex, translator_);
+        translation = {store.addString(entry.vim), entry.engine};
+      } else {
+        const std::string &vim = translator_.translate(regex);
+        translation = {store.addString(vim),
+                       chooseVimRegexEngine(translator_.tree())};
       }
-
-      // Keep other escaped sequences as-is (e.g., \b, \w, \d, \s, etc.)
-      result += preprocessed[i];
-      result += next;
-      i += 2;
-      continue;
     }
+  }
+  translator_.setFactorAlternations(true);
+}
 
-    // Handle special Oniguruma/PCRE constructs
-    if (preprocessed[i] == '(' && i + 1 < preprocessed.length() &&
-        preprocessed[i + 1] == '?') {
-      // Special group construct
-      if (i + 2 < preprocessed.length()) {
-        char c = preprocessed[i + 2];
-
-        // Handle modifiers like (?x), (?i), (?m) - just skip them as Vim
-        // doesn't support them inline
-        if (c == 'x' || c == 'i' || c == 'm' || c == 's') {
-          if (i + 3 < preprocessed.length() && preprocessed[i + 3] == ')') {
-            // Skip the modifier
-            i += 4;
-            continue;
-          }
-        }
+void TmLanguage2VimSyntax::translateRegexesInParallel(unsigned threads) {
+  PatternStore &store = grammar_.store;
+  const size_t count = store.records.size();
+
+  // Every thread translates into a buffer of its own, through the shared
+  // cache if there is one. The results are copied into the store in record
+  // order afterwards, so the store is the same as after a serial
+  // translation.
+  constexpr uint32_t kNoResult = UINT32_MAX;
+  struct Result {
+    uint32_t worker = kNoResult;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    VimRegexEngine engine = VimRegexEngine::Auto;
+  };
+  std::vector<Result> results(count * kRegexFields);
+  std::vector<std::string> buffers(threads);
+  std::vector<VimRegexTranslator> translators(threads);
+  for (VimRegexTranslator &translator : translators) {
+    translator.setFactorAlternations(false);
+  }
 
-        if (c == ':') {
-          // Non-capturing group (?:...) -> \%(...\) in Vim
-          result += "\\%(";
-          i += 3;
-          // Process content recursively
-          int depth = 1;
-          std::string inner;
-          while (i < preprocessed.length() && depth > 0) {
-            if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-              inner += preprocessed[i];
-              inner += preprocessed[i + 1];
-              i += 2;
-              continue;
-            }
-            if (preprocessed[i] == '(')
-              depth++;
-            if (preprocessed[i] == ')') {
-              depth--;
-              if (depth == 0) {
-                result += convertRegexToVim(inner);
-                result += "\\)";
-                i++;
-                break;
-              }
-            }
-            inner += preprocessed[i];
-            i++;
-          }
-          continue;
-        } else if (c == '=') {
-          // Positive lookahead (?=...) -> (...)\@= in Vim
-          i += 3;
-          int depth = 1;
-          std::string inner;
-          while (i < preprocessed.length() && depth > 0) {
-            if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-              inner += preprocessed[i];
-              inner += preprocessed[i + 1];
-              i += 2;
-              continue;
-            }
-            if (preprocessed[i] == '(')
-              depth++;
-            if (preprocessed[i] == ')') {
-              depth--;
-              if (depth == 0) {
-                // Convert inner pattern to Vim format
-                std::string converted = convertRegexToVim(inner);
-                result += "\\(" + converted + "\\)\\@=";
-                i++;
-                break;
-              }
-            }
-            inner += preprocessed[i];
-            i++;
-          }
-          continue;
-        } else if (c == '!') {
-          // Negative lookahead (?!...) -> (...)\@! in Vim
-          i += 3;
-          int depth = 1;
-          std::string inner;
-          while (i < preprocessed.length() && depth > 0) {
-            if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-              inner += preprocessed[i];
-              inner += preprocessed[i + 1];
-              i += 2;
-              continue;
-            }
-            if (preprocessed[i] == '(')
-              depth++;
-            if (preprocessed[i] == ')') {
-              depth--;
-              if (depth == 0) {
-                std::string converted = convertRegexToVim(inner);
-                result += "\\(" + converted + "\\)\\@!";
-                i++;
-                break;
-              }
-            }
-            inner += preprocessed[i];
-            i++;
-          }
-          continue;
-        } else if (c == '<' && i + 3 < preprocessed.length()) {
-          char d = preprocessed[i + 3];
-          if (d == '=') {
-            // Positive lookbehind (?<=...) -> (...)\@<= in Vim
-            i += 4;
-            int depth = 1;
-            std::string inner;
-            while (i < preprocessed.length() && depth > 0) {
-              if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-                inner += preprocessed[i];
-                inner += preprocessed[i + 1];
-                i += 2;
-                continue;
-              }
-              if (preprocessed[i] == '(')
-                depth++;
-              if (preprocessed[i] == ')') {
-                depth--;
-                if (depth == 0) {
-                  std::string converted = convertRegexToVim(inner);
-                  result += "\\(" + converted + "\\)\\@<=";
-                  i++;
-                  break;
-                }
-              }
-              inner += preprocessed[i];
-              i++;
-            }
-            continue;
-          } else if (d == '!') {
-            // Negative lookbehind (?<!...) -> (...)\@<! in Vim
-            i += 4;
-            int depth = 1;
-            std::string inner;
-            while (i < preprocessed.length() && depth > 0) {
-              if (preprocessed[i] == '\\' && i + 1 < preprocessed.length()) {
-                inner += preprocessed[i];
-                inner += preprocessed[i + 1];
-                i += 2;
-                continue;
-              }
-              if (preprocessed[i] == '(')
-                depth++;
-              if (preprocessed[i] == ')') {
-                depth--;
-                if (depth == 0) {
-                  std::string converted = convertRegexToVim(inner);
-                  result += "\\(" + converted + "\\)\\@<!";
-                  i++;
-                  break;
+  parallelFor(count, threads, 64,
+              [&](size_t first, size_t last, unsigned worker) {
+                VimRegexTranslator &translator = translators[worker];
+                std::string &buffer = buffers[worker];
+                for (size_t i = first; i < last; ++i) {
+                  if (!store.records[i].live) {
+                    continue;
+                  }
+                  Pattern pattern(store, static_cast<uint32_t>(i));
+                  for (RegexField field : {kMatch, kBegin, kEnd}) {
+                    std::string_view regex = pattern.regex(field);
+                    if (regex.empty()) {
+                      continue;
+                    }
+                    Result &result = results[i * kRegexFields + field];
+                    result.worker = worker;
+                    result.offset = static_cast<uint32_t>(buffer.size());
+                    if (options_.regexCache) {
+                      const RegexTranslationCache::Entry &entry =
+                          options_.regexCache->translate(regex, translator);
+                      buffer += entry.vim;
+                      result.engine = entry.engine;
+                    } else {
+                      buffer += translator.translate(regex);
+                      result.engine = chooseVimRegexEngine(translator.tree());
+                    }
+                    result.length = static_cast<uint32_t>(buffer.size() -
+                                                          result.offset);
+                  }
                 }
-              }
-              inner += preprocessed[i];
-              i++;
-            }
-            continue;
-          }
-        }
-      }
-    }
-
-    // Regular capturing group (Oniguruma)
-    if (preprocessed[i] == '(') {
-      result += "\\(";
-      i++;
-      continue;
-    }
-
-    // Handle closing parenthesis
-    if (preprocessed[i] == ')') {
-      result += "\\)";
-      i++;
-      continue;
-    }
-
-    // Handle special characters that are operators in Oniguruma
-    if (preprocessed[i] == '|') {
-      // Oniguruma | = OR, Vim \| = OR
-      result += "\\|";
-      i++;
-      continue;
-    }
-
-    if (preprocessed[i] == '+') {
-      // Oniguruma + = one or more, Vim \+ = one or more
-      result += "\\+";
-      i++;
-      continue;
-    }
-
-    if (preprocessed[i] == '?') {
-      // Oniguruma ? = zero or one, Vim \? = zero or one
-      result += "\\?";
-      i++;
-      continue;
-    }
-
-    if (preprocessed[i] == '{') {
-      // Oniguruma {n,m} = quantifier, Vim \{n,m\} = quantifier
-      result += "\\{";
-      i++;
-      continue;
+              });
+
+  store.translations.assign(count * kRegexFields, {});
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &result = results[i];
+    if (result.worker != kNoResult) {
+      std::string_view vim = std::string_view(buffers[result.worker])
+                                 .substr(result.offset, result.length);
+      store.translations[i] = {store.addString(vim), result.engine};
     }
+  }
+}
 
-    if (preprocessed[i] == '}') {
-      result += "\\}";
-      i++;
-      continue;
-    }
+std::string
+TmLanguage2VimSyntax::convertRegexToVim(std::string_view regex) const {
+  // Parsed once into an AST and printed back as a Vim regex
+  return translator_.translate(regex);
+}
 
-    // All other characters pass through as-is
-    result += preprocessed[i];
-    i++;
+SyntaxPattern TmLanguage2VimSyntax::translatePattern(Pattern pattern,
+                                                     RegexField field) const {
+  SyntaxPattern result;
+  result.source = pattern.regex(field);
+  VimRegexEngine engine;
+  const PatternStore &store = grammar_.store;
+  if (!store.translations.empty()) {
+    const TranslatedRegex &translation =
+        store.translations[size_t(pattern.index()) * kRegexFields + field];
+    result.text = store.str(translation.vim);
+    engine = translation.engine;
+  } else {
+    result.text = convertRegexToVim(result.source);
+    engine = chooseVimRegexEngine(translator_.tree());
   }
-
+  result.engine = vimRegexEnginePrefix(options_.regexEngine.value_or(engine));
   return result;
 }
 
 std::string
-TmLanguage2VimSyntax::convertScopeToVim(const std::string &scope) const {
+TmLanguage2VimSyntax::convertScopeToVim(std::string_view scope) const {
   // Convert TextMate scope to Vim syntax group name
-  std::string vimGroup = scope;
 
   // If scope is empty, return empty string.
-  if (vimGroup.empty()) {
+  if (scope.empty()) {
     return "";
   }
 
-  // Replace dots with underscores
-  std::replace(vimGroup.begin(), vimGroup.end(), '.', '_');
-
-  // Replace hyphens with underscores
-  std::replace(vimGroup.begin(), vimGroup.end(), '-', '_');
-
-  // Add prefix
-  return "Go_" + vimGroup;
+  // Add prefix, replacing dots and hyphens with underscores, in a single
+  // allocation
+  std::string vimGroup;
+  vimGroup.reserve(groupPrefix_.size() + scope.size());
+  vimGroup += groupPrefix_;
+  for (char c : scope) {
+    vimGroup += c == '.' || c == '-' ? '_' : c;
+  }
+  return vimGroup;
 }
 
 std::string
@@ -468,296 +322,282 @@ TmLanguage2VimSyntax::escapeVimString(const std::string &str) const {
   return escaped;
 }
 
-std::string
-TmLanguage2VimSyntax::mapScopeToHighlightGroup(const std::string &scope) const {
+std::string_view
+TmLanguage2VimSyntax::mapScopeToHighlightGroup(std::string_view scope) const {
   // Map TextMate scopes to standard Vim highlight groups
-  // Based on official Vim syntax files
-  if (scope.empty())
-    return "";
-
-  // Comments
-  if (scope.find("comment.line") != std::string::npos)
-    return "Comment";
-  if (scope.find("comment.block") != std::string::npos)
-    return "Comment";
-  if (scope.find("comment") != std::string::npos)
-    return "Comment";
-
-  // Keywords - more specific mappings
-  if (scope.find("keyword.package") != std::string::npos)
-    return "Statement";
-  if (scope.find("keyword.control.import") != std::string::npos)
-    return "Statement";
-  if (scope.find("keyword.control.go") != std::string::npos)
-    return "Conditional";
-  if (scope.find("keyword.control") != std::string::npos)
-    return "Conditional";
-  if (scope.find("keyword.function") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.var") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.const") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.type") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.interface") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.struct") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.map") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.channel") != std::string::npos)
-    return "Keyword";
-  if (scope.find("keyword.operator") != std::string::npos)
-    return "Operator";
-  if (scope.find("keyword") != std::string::npos)
-    return "Keyword";
-
-  // Storage types - Go built-in types
-  if (scope.find("storage.type.boolean") != std::string::npos)
-    return "Boolean";
-  if (scope.find("storage.type.numeric") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type.string") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type.byte") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type.rune") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type.uintptr") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type.error") != std::string::npos)
-    return "Type";
-  if (scope.find("storage.type") != std::string::npos)
-    return "Type";
-  if (scope.find("storage") != std::string::npos)
-    return "StorageClass";
-
-  // Strings
-  if (scope.find("string.quoted.double") != std::string::npos)
-    return "String";
-  if (scope.find("string.quoted.raw") != std::string::npos)
-    return "String";
-  if (scope.find("string.quoted.rune") != std::string::npos)
-    return "Character";
-  if (scope.find("string") != std::string::npos)
-    return "String";
-
-  // Constants
-  if (scope.find("constant.numeric") != std::string::npos)
-    return "Number";
-  if (scope.find("constant.character.escape") != std::string::npos)
-    return "SpecialChar";
-  if (scope.find("constant.other.placeholder") != std::string::npos)
-    return "SpecialChar";
-  if (scope.find("constant.other.rune") != std::string::npos)
-    return "Character";
-  if (scope.find("constant.language") != std::string::npos)
-    return "Boolean";
-  if (scope.find("constant") != std::string::npos)
-    return "Constant";
-
-  // Functions
-  if (scope.find("entity.name.function.support.builtin") != std::string::npos)
-    return "Function";
-  if (scope.find("entity.name.function") != std::string::npos)
-    return "Function";
-  if (scope.find("support.function.builtin") != std::string::npos)
-    return "Function";
-  if (scope.find("support.function") != std::string::npos)
-    return "Function";
-
-  // Types and entities
-  if (scope.find("entity.name.type.package") != std::string::npos)
-    return "Identifier";
-  if (scope.find("entity.name.type.any") != std::string::npos)
-    return "Type";
-  if (scope.find("entity.name.type.comparable") != std::string::npos)
-    return "Type";
-  if (scope.find("entity.name.type") != std::string::npos)
-    return "Type";
-
-  // Variables
-  if (scope.find("variable.parameter") != std::string::npos)
-    return "Identifier";
-  if (scope.find("variable.other.assignment") != std::string::npos)
-    return "Identifier";
-  if (scope.find("variable.other") != std::string::npos)
-    return "Identifier";
-  if (scope.find("variable") != std::string::npos)
-    return "Identifier";
-
-  // Punctuation - more specific
-  if (scope.find("punctuation.terminator") != std::string::npos)
-    return "Delimiter";
-  if (scope.find("punctuation.separator") != std::string::npos)
-    return "Delimiter";
-  if (scope.find("punctuation.definition.begin") != std::string::npos)
-    return "Delimiter";
-  if (scope.find("punctuation.definition.end") != std::string::npos)
-    return "Delimiter";
-  if (scope.find("punctuation.other") != std::string::npos)
-    return "Delimiter";
-  if (scope.find("punctuation") != std::string::npos)
-    return "Delimiter";
-
-  // Invalid/Error
-  if (scope.find("invalid.illegal") != std::string::npos)
-    return "Error";
-  if (scope.find("invalid") != std::string::npos)
-    return "Error";
-
-  // Support
-  if (scope.find("support.type") != std::string::npos)
-    return "Type";
-  if (scope.find("support") != std::string::npos)
-    return "Special";
-
-  // Meta
-  if (scope.find("meta.function") != std::string::npos)
-    return "Function";
-  if (scope.find("meta.type") != std::string::npos)
-    return "Type";
-
-  // Default - don't map everything to Normal
-  return "";
+  if (options_.scopeMap) {
+    return options_.scopeMap->lookup(scope);
+  }
+  return defaultScopeMatcher().lookup(scope);
 }
 
 void TmLanguage2VimSyntax::collectSyntaxGroups(
-    const std::vector<Pattern> &patterns, std::set<std::string> &groups) const {
-  for (const auto &pattern : patterns) {
-    if (!pattern.name.empty()) {
-      std::string groupName = convertScopeToVim(pattern.name);
-      if (!groupName.empty()) {
-        groups.insert(pattern.name); // Store original scope name
-      }
+    std::vector<std::string_view> &groups) const {
+  // Every live record belongs to the top-level patterns or to a repository
+  // rule, so one pass over the flat storage visits all of them
+  const PatternStore &store = grammar_.store;
+  for (const auto &record : store.records) {
+    if (!record.live) {
+      continue;
+    }
+    std::string_view name = store.str(record.name);
+    if (!name.empty() && !convertScopeToVim(name).empty()) {
+      groups.push_back(name); // Store original scope name
     }
-    // Collect beginCaptures
-    if (!pattern.beginCaptures.empty()) {
-      for (const auto &[key, scopeName] : pattern.beginCaptures) {
+    // Collect beginCaptures and endCaptures
+    for (CaptureTable table : {kBeginCaptures, kEndCaptures}) {
+      const IndexRange &range = record.captures[table];
+      for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+        std::string_view scopeName = store.str(store.captures[i].name);
         if (!scopeName.empty()) {
-          groups.insert(scopeName);
+          groups.push_back(scopeName);
         }
       }
     }
-    // Collect endCaptures
-    if (!pattern.endCaptures.empty()) {
-      for (const auto &[key, scopeName] : pattern.endCaptures) {
-        if (!scopeName.empty()) {
-          groups.insert(scopeName);
+  }
+  std::sort(groups.begin(), groups.end());
+  groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+}
+
+void TmLanguage2VimSyntax::generateSyntaxRules(std::vector<SyntaxItem> &items,
+                                               PatternList patterns,
+                                               bool contained) const {
+  for (Pattern pattern : patterns) {
+    generateSyntaxRule(items, pattern, contained);
+  }
+}
+
+void TmLanguage2VimSyntax::generateSyntaxRule(std::vector<SyntaxItem> &items,
+                                              Pattern pattern,
+                                              bool contained) const {
+  if (!pattern.match().empty()) {
+    std::string groupName = convertScopeToVim(pattern.name());
+    if (!groupName.empty()) {
+      SyntaxItem item{SyntaxItem::Kind::Match, groupName, contained};
+      item.pattern = translatePattern(pattern, kMatch);
+      items.push_back(std::move(item));
+    }
+  }
+  if (!pattern.begin().empty() && !pattern.end().empty()) {
+    std::string groupName = convertScopeToVim(pattern.name());
+
+    // Handle beginCaptures - use matchgroup for first capture
+    std::string matchGroup;
+    std::string_view firstCapture = pattern.beginCaptures().find("1");
+    if (!firstCapture.empty()) {
+      matchGroup = convertScopeToVim(firstCapture);
+    }
+
+    if (!groupName.empty() || !matchGroup.empty()) {
+      SyntaxItem item{SyntaxItem::Kind::Region,
+                      groupName.empty() ? matchGroup + "_region" : groupName,
+                      contained};
+      item.matchGroup = std::move(matchGroup);
+      item.pattern = translatePattern(pattern, kBegin);
+      item.end = translatePattern(pattern, kEnd);
+
+      // An end such as "^\\1$" repeats text of the start, which Vim only
+      // allows through external groups
+      if (hasVimBackrefs(item.end.text) &&
+          !externalizeRegionGroups(item.pattern.text, item.end.text)) {
+        items.push_back(SyntaxItem::comment(
+            "Region " + item.group +
+            " left out: its end refers to groups of its start that Vim "
+            "cannot pass on"));
+      } else {
+        // Nested patterns, with included rules as clusters
+        std::vector<std::string> containsList;
+        collectContains(pattern.patterns(), containsList);
+        for (size_t i = 0; i < containsList.size(); ++i) {
+          if (i > 0)
+            item.contains += ",";
+          item.contains += containsList[i];
         }
+        items.push_back(std::move(item));
       }
     }
-    // Recursively collect from nested patterns
-    if (!pattern.patterns.empty()) {
-      collectSyntaxGroups(pattern.patterns, groups);
+  }
+  // Process nested patterns; those of a pattern-only container stand in
+  // its place
+  if (!pattern.patterns().empty()) {
+    bool container = pattern.match().empty() && pattern.begin().empty();
+    generateSyntaxRules(items, pattern.patterns(), contained || !container);
+  }
+}
+
+std::string TmLanguage2VimSyntax::syntaxGroupOf(Pattern pattern) const {
+  if (!pattern.match().empty() && !pattern.name().empty()) {
+    return convertScopeToVim(pattern.name());
+  }
+  if (!pattern.begin().empty() && !pattern.end().empty()) {
+    if (!pattern.name().empty()) {
+      return convertScopeToVim(pattern.name());
+    }
+    std::string_view firstCapture = pattern.beginCaptures().find("1");
+    if (!firstCapture.empty()) {
+      return convertScopeToVim(firstCapture) + "_region";
     }
   }
+  return {};
 }
 
-// Choose a delimiter that doesn't appear in the pattern
-std::string chooseDelimiter(const std::string &pattern) {
-  // Try delimiters in order of preference
-  std::vector<char> delimiters = {'@', '#', '|', '~', '!', '%', '^', '&', '*'};
-  for (char delim : delimiters) {
-    if (pattern.find(delim) == std::string::npos) {
-      return std::string(1, delim);
+std::string TmLanguage2VimSyntax::clusterName(uint32_t node) const {
+  if (node == includes_.selfNode()) {
+    return groupPrefix_ + "top";
+  }
+  std::string name(grammar_.ruleName(grammar_.repository.rules[node]));
+  for (char &c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      c = '_';
     }
   }
-  // Fallback to @ if all else fails
-  return "@";
+  return groupPrefix_ + "rule_" + name;
 }
 
-void TmLanguage2VimSyntax::generateSyntaxRules(
-    std::ostream &os, const std::vector<Pattern> &patterns,
-    const std::string &parentGroup) const {
-  for (size_t i = 0; i < patterns.size(); ++i) {
-    const auto &pattern = patterns[i];
-    // Only nested patterns (with parentGroup) are contained
-    bool shouldBeContained = !parentGroup.empty();
-
-    if (!pattern.match.empty()) {
-      std::string groupName = convertScopeToVim(pattern.name);
-      if (!groupName.empty()) {
-        std::string vimRegex = convertRegexToVim(pattern.match);
-        std::string delim = chooseDelimiter(vimRegex);
-
-        os << "syntax match " << groupName;
-        if (shouldBeContained) {
-          os << " contained";
-        }
-        os << " " << delim << vimRegex << delim << "\n";
+void TmLanguage2VimSyntax::collectContains(
+    PatternList patterns, std::vector<std::string> &contains) const {
+  for (Pattern pattern : patterns) {
+    std::string item;
+    if (!pattern.include().empty()) {
+      uint32_t node = includes_.resolve(pattern.include());
+      if (node != IncludeGraph::kNoNode) {
+        item = "@" + clusterName(node);
+      } else if (IncludeGraph::isExternal(pattern.include())) {
+        item = externalCluster(pattern.include());
       }
+    } else if (pattern.match().empty() && pattern.begin().empty()) {
+      collectContains(pattern.patterns(), contains);
+    } else {
+      item = syntaxGroupOf(pattern);
     }
-    if (!pattern.begin.empty() && !pattern.end.empty()) {
-      std::string groupName = convertScopeToVim(pattern.name);
-      std::string beginRegex = convertRegexToVim(pattern.begin);
-      std::string endRegex = convertRegexToVim(pattern.end);
-
-      // Handle beginCaptures - use matchgroup for first capture
-      std::string matchGroup;
-      if (!pattern.beginCaptures.empty()) {
-        auto it = pattern.beginCaptures.find("1");
-        if (it != pattern.beginCaptures.end() && !it->second.empty()) {
-          matchGroup = convertScopeToVim(it->second);
-        }
-      }
+    if (!item.empty() &&
+        std::find(contains.begin(), contains.end(), item) == contains.end()) {
+      contains.push_back(std::move(item));
+    }
+  }
+}
 
-      if (!groupName.empty() || !matchGroup.empty()) {
-        // Choose delimiter that works for both begin and end
-        std::string combinedPattern = beginRegex + endRegex;
-        std::string delim = chooseDelimiter(combinedPattern);
+std::string
+TmLanguage2VimSyntax::externalCluster(std::string_view include) const {
+  if (!options_.registry) {
+    return {};
+  }
+  std::string_view scope = include.substr(0, include.find('#'));
+  std::string_view rule;
+  if (scope.size() < include.size()) {
+    rule = include.substr(scope.size() + 1);
+  }
+  // Rules of this grammar that do not exist stay unresolved
+  if (scope.empty() || scope == grammar_.scopeName) {
+    return {};
+  }
+  std::string prefix;
+  if (embedded_) {
+    // Loading it here could wait on a grammar loading this one
+    if (!options_.registry->has(scope)) {
+      return {};
+    }
+    std::lock_guard<std::mutex> lock(embeddingsMutex_);
+    if (std::find(embeddedScopes_.begin(), embeddedScopes_.end(), scope) ==
+        embeddedScopes_.end()) {
+      embeddedScopes_.emplace_back(scope);
+    }
+    prefix = embeddedGrammarPrefix(scope);
+  } else {
+    std::shared_ptr<const EmbeddedGrammar> grammar =
+        options_.registry->find(scope, options_);
+    if (!grammar) {
+      return {};
+    }
+    std::lock_guard<std::mutex> lock(embeddingsMutex_);
+    if (std::find(embeddings_.begin(), embeddings_.end(), grammar) ==
+        embeddings_.end()) {
+      embeddings_.push_back(grammar);
+    }
+    prefix = grammar->prefix;
+  }
+  if (rule.empty()) {
+    return "@" + prefix + "top";
+  }
+  std::string name(rule);
+  for (char &c : name) {
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      c = '_';
+    }
+  }
+  return "@" + prefix + "rule_" + name;
+}
 
-        os << "syntax region ";
-        if (!groupName.empty()) {
-          os << groupName;
-        } else {
-          os << matchGroup << "_region";
-        }
-        if (shouldBeContained) {
-          os << " contained";
-        }
-        if (!matchGroup.empty()) {
-          os << " matchgroup=" << matchGroup;
-        }
-        os << " start=" << delim << beginRegex << delim << " end=" << delim
-           << endRegex << delim;
-
-        // Add contains for nested patterns - only if there are named patterns
-        if (!pattern.patterns.empty()) {
-          std::vector<std::string> containsList;
-          for (const auto &subPattern : pattern.patterns) {
-            if (!subPattern.name.empty()) {
-              std::string subGroupName = convertScopeToVim(subPattern.name);
-              if (!subGroupName.empty()) {
-                containsList.push_back(subGroupName);
-              }
-            }
-          }
-          if (!containsList.empty()) {
-            os << " contains=";
-            for (size_t i = 0; i < containsList.size(); ++i) {
-              if (i > 0)
-                os << ",";
-              os << containsList[i];
-            }
-          }
-        }
-        os << "\n";
+void TmLanguage2VimSyntax::generateClusters(
+    std::vector<SyntaxItem> &items) const {
+  // One flattened cluster per included rule, so regions can contain it
+  // without repeating its groups
+  const uint32_t nodes = includes_.selfNode() + 1;
+  bool header = false;
+  for (uint32_t node = 0; node < nodes; ++node) {
+    // An embedded grammar is included by its top-level cluster or by any
+    // of its rules
+    if (!includes_.referenced(node) && !embedded_) {
+      continue;
+    }
+    std::vector<std::string> groups;
+    std::set<std::string> seen;
+    for (uint32_t index : includes_.members(node)) {
+      std::string group = syntaxGroupOf(Pattern(grammar_.store, index));
+      if (!group.empty() && seen.insert(group).second) {
+        groups.push_back(std::move(group));
+      }
+    }
+    for (uint32_t index : includes_.externals(node)) {
+      std::string cluster =
+          externalCluster(Pattern(grammar_.store, index).include());
+      if (!cluster.empty() && seen.insert(cluster).second) {
+        groups.push_back(std::move(cluster));
       }
     }
-    // Process nested patterns
-    if (!pattern.patterns.empty()) {
-      generateSyntaxRules(os, pattern.patterns,
-                          convertScopeToVim(pattern.name));
+    if (groups.empty()) {
+      continue; // Vim rejects a cluster without groups
+    }
+    if (!header) {
+      items.push_back(SyntaxItem::section("Clusters"));
+      header = true;
     }
+    SyntaxItem item{SyntaxItem::Kind::Cluster, clusterName(node)};
+    for (size_t i = 0; i < groups.size(); ++i) {
+      if (i > 0)
+        item.text += ",";
+      item.text += groups[i];
+    }
+    items.push_back(std::move(item));
   }
 }
 
-void TmLanguage2VimSyntax::generateRepositoryRules(std::ostream &os) const {
+void TmLanguage2VimSyntax::generateRule(std::vector<SyntaxItem> &items,
+                                        const RuleRecord &rule) const {
+  std::string_view name = grammar_.ruleName(rule);
+  items.push_back(
+      SyntaxItem::comment("Repository rule: " + std::string(name)));
+
+  // Special handling for package_name - add package keyword first
+  if (name == "package_name") {
+    items.push_back({SyntaxItem::Kind::Keyword,
+                     groupPrefix_ + "keyword_package_go", embedded_,
+                     "package"});
+  }
+
+  // Rules only included inside regions must not match on their own
+  uint32_t node =
+      static_cast<uint32_t>(&rule - grammar_.repository.rules.data());
+  bool contained = embedded_ || (includes_.referenced(node) &&
+                                 !includes_.reachableFromTop(node));
+  generateSyntaxRule(items, grammar_.rulePattern(rule), contained);
+}
+
+void TmLanguage2VimSyntax::generateRepositoryRules(
+    std::vector<SyntaxItem> &items) const {
   // Define priority order - specific patterns first, generic patterns last
   // Note: Later definitions have higher priority in Vim
-  std::vector<std::string> priorityOrder = {"keywords",
+  std::vector<std::string_view> priorityOrder = {"keywords",
                                             "package_name",
                                             "import",
                                             "imports",
@@ -772,106 +612,85 @@ void TmLanguage2VimSyntax::generateRepositoryRules(std::ostream &os) const {
                                             "language_constants",
                                             "comments"};
 
-  std::vector<std::string> lowPriorityOrder = {
+  std::vector<std::string_view> lowPriorityOrder = {
       "other_variables", "variable_assignment",
       "other_struct_interface_expressions"};
 
-  std::set<std::string> processed;
+  std::set<std::string_view> processed;
+  std::vector<const RuleRecord *> order;
+  order.reserve(grammar_.repository.rules.size());
 
   // Output high priority rules first
   for (const auto &name : priorityOrder) {
-    auto it = grammar_.repository.rules.find(name);
-    if (it != grammar_.repository.rules.end()) {
-      os << "\" Repository rule: " << name << "\n";
-
-      // Special handling for keywords - convert simple \b word \b patterns to
-      // syntax keyword
-      if (name == "keywords") {
-        // Extract keywords and use syntax keyword which has highest priority
-        std::set<std::string> handledPatterns;
-        for (const auto &pattern : it->second.patterns) {
-          if (!pattern.match.empty() && !pattern.name.empty()) {
-            std::string groupName = convertScopeToVim(pattern.name);
-            if (!groupName.empty()) {
-              bool handled = false;
-              // Check if it's a simple keyword pattern like
-              // \b(word1|word2|...)\b
-              std::string match = pattern.match;
-              if (match.find("\\b(") != std::string::npos &&
-                  match.find(")\\b") != std::string::npos &&
-                  match.find("|") != std::string::npos) {
-                // Extract keywords from pattern
-                size_t start = match.find("\\b(") + 3;
-                size_t end = match.find(")\\b");
-                if (start < end) {
-                  std::string keywords = match.substr(start, end - start);
-                  // Replace | with space for syntax keyword
-                  std::replace(keywords.begin(), keywords.end(), '|', ' ');
-                  os << "syntax keyword " << groupName << " " << keywords
-                     << "\n";
-                  handledPatterns.insert(pattern.name);
-                  handled = true;
-                }
-              }
-              // For single keyword patterns like \bfunc\b
-              if (!handled && match.find("\\b") == 0 &&
-                  match.rfind("\\b") == match.length() - 2) {
-                std::string keyword = match.substr(2, match.length() - 4);
-                if (keyword.find('\\') == std::string::npos &&
-                    keyword.find('(') == std::string::npos) {
-                  os << "syntax keyword " << groupName << " " << keyword
-                     << "\n";
-                  handledPatterns.insert(pattern.name);
-                  handled = true;
-                }
-              }
-            }
-          }
-        }
-        // Don't generate syntax match for patterns we've handled with syntax
-        // keyword Skip generateSyntaxRules for keywords
-        processed.insert(name);
-        // Note: syntax keyword doesn't count for isFirstRule since keywords are
-        // always top-level
-        continue;
-      }
-
-      // Special handling for package_name - add package keyword first
-      if (name == "package_name") {
-        os << "syntax keyword Go_keyword_package_go package\n";
-        // Note: syntax keyword doesn't count for isFirstRule
-      }
-
-      generateSyntaxRules(os, it->second.patterns);
+    const RuleRecord *rule = grammar_.findRule(name);
+    if (rule) {
+      order.push_back(rule);
       processed.insert(name);
     }
   }
 
   // Output medium priority rules (everything else except low priority)
-  for (const auto &[name, rule] : grammar_.repository.rules) {
+  for (const auto &rule : grammar_.repository.rules) {
+    std::string_view name = grammar_.ruleName(rule);
     if (processed.find(name) == processed.end() &&
         std::find(lowPriorityOrder.begin(), lowPriorityOrder.end(), name) ==
             lowPriorityOrder.end()) {
-      os << "\" Repository rule: " << name << "\n";
-      generateSyntaxRules(os, rule.patterns);
+      order.push_back(&rule);
       processed.insert(name);
     }
   }
 
   // Output low priority rules last
   for (const auto &name : lowPriorityOrder) {
-    auto it = grammar_.repository.rules.find(name);
-    if (it != grammar_.repository.rules.end()) {
-      os << "\" Repository rule: " << name << "\n";
-      generateSyntaxRules(os, it->second.patterns);
+    const RuleRecord *rule = grammar_.findRule(name);
+    if (rule) {
+      order.push_back(rule);
       processed.insert(name);
     }
   }
+
+  generateRules(items, order);
+}
+
+void TmLanguage2VimSyntax::generateRules(
+    std::vector<SyntaxItem> &items,
+    const std::vector<const RuleRecord *> &rules) const {
+  // Rules only read the grammar once its regexes are translated; translating
+  // on demand would share translator_
+  unsigned threads = resolveThreads(options_.threads);
+  if (threads == 1 || grammar_.store.translations.empty()) {
+    for (const RuleRecord *rule : rules) {
+      generateRule(items, *rule);
+    }
+    return;
+  }
+
+  std::vector<std::vector<SyntaxItem>> fragments(rules.size());
+  parallelFor(rules.size(), threads, 16,
+              [&](size_t first, size_t last, unsigned) {
+                for (size_t i = first; i < last; ++i) {
+                  generateRule(fragments[i], *rules[i]);
+                }
+              });
+  for (std::vector<SyntaxItem> &fragment : fragments) {
+    std::move(fragment.begin(), fragment.end(), std::back_inserter(items));
+  }
 }
 
 std::string TmLanguage2VimSyntax::generateVimSyntax() const {
   std::ostringstream os;
+  generateVimSyntax(os);
+  return os.str();
+}
+
+void TmLanguage2VimSyntax::generateVimSyntax(const SyntaxWriter &write) const {
+  WriterBuffer buffer(write);
+  std::ostream os(&buffer);
+  generateVimSyntax(os);
+  os.flush();
+}
 
+void TmLanguage2VimSyntax::generateVimSyntax(std::ostream &os) const {
   // Header
   os << "\" Vim syntax file generated from TextMate grammar\n";
   os << "\" Language: " << grammar_.name << "\n";
@@ -883,41 +702,196 @@ std::string TmLanguage2VimSyntax::generateVimSyntax() const {
   os << "endif\n\n";
 
   // Clear syntax
-  os << "syntax clear\n\n";
+  os << "syntax clear\n";
+  os << "syntax iskeyword " << kSyntaxIsKeyword << "\n\n";
+
+  ConversionStats *stats = collectedStats();
+  if (stats) {
+    // Only the parse is kept from an earlier generation
+    for (ConversionPhase phase :
+         {ConversionPhase::Generate, ConversionPhase::Passes,
+          ConversionPhase::Highlight, ConversionPhase::Write}) {
+      (*stats)[phase] = 0;
+    }
+  }
+
+  std::vector<SyntaxItem> items;
+  embeddings_.clear();
+  {
+    PhaseTimer timer(stats, ConversionPhase::Generate);
+    generateSyntaxItems(items);
+  }
+  {
+    PhaseTimer timer(stats, ConversionPhase::Passes);
+    passReports_ = runSyntaxPasses(items, options_.passes, options_.sync,
+                                   options_.passSizes);
+  }
+  {
+    PhaseTimer timer(stats, ConversionPhase::Write);
+    writeSyntaxItems(os, items);
+
+    // Grammars included by scope name, shared with other conversions
+    for (const auto &grammar : embeddings_) {
+      os << "\n\" Embedded " << grammar->scopeName << "\n" << grammar->syntax;
+    }
+  }
+  if (stats) {
+    stats->syntaxItems = items.size();
+  }
+
+  writeHighlightLinks(os);
+
+  // Footer
+  os << "\nlet b:current_syntax = \"" << grammar_.scopeName << "\"\n";
+}
+
+void TmLanguage2VimSyntax::setEmbedded(const std::string &prefix) {
+  groupPrefix_ = prefix;
+  embedded_ = true;
+}
 
-  // Generate top-level patterns
-  generateSyntaxRules(os, grammar_.patterns);
+void TmLanguage2VimSyntax::generateEmbeddedSyntax(std::ostream &os) const {
+  std::vector<SyntaxItem> items;
+  embeddedScopes_.clear();
+  generateSyntaxItems(items);
+  std::sort(embeddedScopes_.begin(), embeddedScopes_.end());
+  // The including file has the only sync setup
+  passReports_ = runSyntaxPasses(
+      items, options_.passes & ~syntaxPassBit(SyntaxPass::Sync), options_.sync);
+  writeSyntaxItems(os, items);
+  writeHighlightLinks(os);
+}
+
+void TmLanguage2VimSyntax::generateSyntaxItems(
+    std::vector<SyntaxItem> &items) const {
+  // About one item per pattern and a comment per rule, so the list is not
+  // copied while it grows
+  items.reserve(items.size() + grammar_.store.records.size() +
+                grammar_.repository.rules.size());
+
+  // Generate top-level patterns. Alternations are factored by a pass, so
+  // only the patterns it applies to are printed twice.
+  translator_.setFactorAlternations(false);
+  generateSyntaxRules(items, grammar_.topLevelPatterns(), embedded_);
 
   // Generate repository rules
   if (!grammar_.repository.rules.empty()) {
-    os << "\n\" Repository rules\n";
-    generateRepositoryRules(os);
+    items.push_back(SyntaxItem::section("Repository rules"));
+    generateRepositoryRules(items);
   }
 
-  // Collect all syntax groups
-  std::set<std::string> scopeNames;
-  collectSyntaxGroups(grammar_.patterns, scopeNames);
-  for (const auto &[name, rule] : grammar_.repository.rules) {
-    collectSyntaxGroups({rule}, scopeNames);
+  generateClusters(items);
+  translator_.setFactorAlternations(true);
+
+  // The grammars embedded grammars include in turn, and theirs
+  if (!embedded_ && options_.registry) {
+    for (size_t i = 0; i < embeddings_.size(); ++i) {
+      std::shared_ptr<const EmbeddedGrammar> embedding = embeddings_[i];
+      for (const std::string &scope : embedding->includes) {
+        std::shared_ptr<const EmbeddedGrammar> grammar =
+            options_.registry->find(scope, options_);
+        if (grammar && std::find(embeddings_.begin(), embeddings_.end(),
+                                 grammar) == embeddings_.end()) {
+          embeddings_.push_back(std::move(grammar));
+        }
+      }
+    }
   }
 
+  // Independent of the order rules were generated in
+  std::sort(embeddings_.begin(), embeddings_.end(),
+            [](const auto &a, const auto &b) {
+              return a->scopeName < b->scopeName;
+            });
+}
+
+void TmLanguage2VimSyntax::writeHighlightLinks(std::ostream &os) const {
+  ConversionStats *stats = collectedStats();
+  PhaseTimer timer(stats, ConversionPhase::Highlight);
+
+  // Collect all syntax groups
+  std::vector<std::string_view> scopeNames;
+  collectSyntaxGroups(scopeNames);
+
   // Generate highlight links
   os << "\n\" Highlight links\n";
+  size_t links = 0;
   for (const auto &scopeName : scopeNames) {
     std::string groupName = convertScopeToVim(scopeName);
-    std::string hlGroup = mapScopeToHighlightGroup(scopeName);
+    std::string_view hlGroup = mapScopeToHighlightGroup(scopeName);
     if (!groupName.empty() && !hlGroup.empty()) {
       os << "highlight default link " << groupName << " " << hlGroup << "\n";
+      links++;
     }
   }
+  if (stats) {
+    stats->highlightLinks = links;
+  }
+}
 
-  // Footer
-  os << "\nlet b:current_syntax = \"" << grammar_.scopeName << "\"\n";
+std::vector<RegexReport> TmLanguage2VimSyntax::analyzeRegexes() const {
+  std::vector<RegexReport> reports;
+  analyzePatterns(reports, grammar_.topLevelPatterns(), "patterns");
+  for (const auto &rule : grammar_.repository.rules) {
+    analyzePattern(reports, grammar_.rulePattern(rule),
+                   "repository." + std::string(grammar_.ruleName(rule)));
+  }
+  return reports;
+}
 
-  return os.str();
+void TmLanguage2VimSyntax::analyzePatterns(std::vector<RegexReport> &reports,
+                                           PatternList patterns,
+                                           const std::string &location) const {
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    analyzePattern(reports, patterns[i],
+                   location + "[" + std::to_string(i) + "]");
+  }
+}
+
+void TmLanguage2VimSyntax::analyzePattern(std::vector<RegexReport> &reports,
+                                          Pattern pattern,
+                                          const std::string &location) const {
+  const std::pair<const char *, std::string_view> regexes[] = {
+      {"match", pattern.match()},
+      {"begin", pattern.begin()},
+      {"end", pattern.end()}};
+  for (const auto &[field, regex] : regexes) {
+    if (regex.empty()) {
+      continue;
+    }
+    RegexReport report;
+    report.location = location;
+    report.field = field;
+    report.name = pattern.name();
+    if (std::string_view(field) == "end") {
+      // Back references in "end" refer to "begin" captures and are replaced
+      // with the captured text before compiling; check it with empty groups
+      std::string substituted;
+      for (size_t i = 0; i < regex.size(); ++i) {
+        if (regex[i] == '\\' && i + 1 < regex.size()) {
+          if (regex[i + 1] >= '1' && regex[i + 1] <= '9') {
+            substituted += "(?:)";
+          } else {
+            substituted.append(regex, i, 2);
+          }
+          ++i;
+        } else {
+          substituted += regex[i];
+        }
+      }
+      compileOniguruma(substituted, report.error);
+    } else {
+      compileOniguruma(regex, report.error);
+    }
+    report.pattern = translator_.translate(regex);
+    report.cost = analyzeRegexTree(translator_.tree());
+    reports.push_back(std::move(report));
+  }
+  analyzePatterns(reports, pattern.patterns(), location + "/patterns");
 }
 
 void TmLanguage2VimSyntax::initializeOniguruma() {
-  // Initialize Oniguruma regex engine (if needed for advanced features)
-  // onig_init(); // Uncomment when actually using Oniguruma features
+  // Regexes are only compiled by the analyzer, but the library is set up
+  // once per process either way
+  initializeOnigurumaOnce();
 }
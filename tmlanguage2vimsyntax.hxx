@@ -1,92 +1,477 @@
 #ifndef TMLANGUAGE2VIMSYNTAX_H
 #define TMLANGUAGE2VIMSYNTAX_H
 
+#include "alloc_stats.hxx"
+#include "conversion_stats.hxx"
+#include "include_graph.hxx"
+#include "regex_cache.hxx"
+#include "regex_analyzer.hxx"
+#include "scope_map.hxx"
+#include "syntax_passes.hxx"
+#include "syntax_sync.hxx"
+#include "vim_regex.hxx"
+#include <cstdint>
 #include <iostream>
+#include <functional>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 extern "C" {
 #include <oniguruma.h>
 }
 
-#include <nlohmann/json.hpp>
-
-// Structure representing a TextMate grammar pattern
-struct Pattern {
-  std::string name;              // Name of the pattern
-  std::string match;             // Regular expression for simple match
-  std::string begin;             // Begin pattern for regions
-  std::string end;               // End pattern for regions
-  std::vector<Pattern> patterns; // Nested patterns
-  std::map<std::string, std::string>
-      captures; // Capture groups for match patterns
-  std::map<std::string, std::string>
-      beginCaptures; // Capture groups for begin pattern
-  std::map<std::string, std::string>
-      endCaptures;     // Capture groups for end pattern
-  std::string include; // Include reference to other patterns
+// Span of characters in PatternStore::strings
+struct StringRef {
+  uint32_t offset = 0;
+  uint32_t length = 0;
 };
 
-// Repository containing named pattern rules
+// Range of elements in one of the PatternStore side arrays
+struct IndexRange {
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+// Capture tables of a pattern
+enum CaptureTable { kCaptures, kBeginCaptures, kEndCaptures, kCaptureTables };
+
+// Regular expressions of a pattern
+enum RegexField { kMatch, kBegin, kEnd, kRegexFields };
+
+// Stored form of a TextMate grammar pattern
+struct PatternRecord {
+  StringRef name;                        // Name of the pattern
+  StringRef match;                       // Regular expression for simple match
+  StringRef begin;                       // Begin pattern for regions
+  StringRef end;                         // End pattern for regions
+  StringRef include;                     // Include reference to other patterns
+  IndexRange children;                   // Nested patterns (in children)
+  IndexRange captures[kCaptureTables];   // Capture tables (in captures)
+  bool live = true; // Cleared when a duplicate repository rule replaced it
+};
+
+// Capture group name of a capture table entry
+struct CaptureRecord {
+  StringRef key;  // Capture group number
+  StringRef name; // Scope name
+};
+
+// Named repository rule
+struct RuleRecord {
+  StringRef name;   // Rule name
+  uint32_t pattern; // Index in records
+};
+
+// Vim translation of a regex of a pattern
+struct TranslatedRegex {
+  StringRef vim;         // Vim regex without the engine prefix
+  VimRegexEngine engine; // Engine chosen for it
+};
+
+// Flat storage of all patterns of a grammar. Patterns live in one array,
+// nested patterns and captures are index ranges into side arrays and every
+// string is a span of a single character arena. All of them allocate from
+// one memory resource.
+struct PatternStore {
+  explicit PatternStore(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : records(resource), children(resource), captures(resource),
+        translations(resource), strings(resource) {}
+
+  std::pmr::vector<PatternRecord> records;
+  std::pmr::vector<uint32_t> children; // Indices in records
+  std::pmr::vector<CaptureRecord> captures;
+  // kRegexFields translations per record, or empty to translate on demand
+  std::pmr::vector<TranslatedRegex> translations;
+  std::pmr::string strings;
+
+  // Remove everything, keeping the allocated capacity
+  void clear() {
+    records.clear();
+    children.clear();
+    captures.clear();
+    translations.clear();
+    strings.clear();
+  }
+
+  std::string_view str(StringRef ref) const {
+    return std::string_view(strings).substr(ref.offset, ref.length);
+  }
+
+  StringRef addString(std::string_view str) {
+    StringRef ref{static_cast<uint32_t>(strings.size()),
+                  static_cast<uint32_t>(str.size())};
+    strings.append(str);
+    return ref;
+  }
+};
+
+class PatternList;
+
+// Capture table of a pattern, sorted by capture group number
+class CaptureList {
+public:
+  CaptureList(const PatternStore &store, IndexRange range)
+      : store_(&store), range_(range) {}
+
+  bool empty() const { return range_.count == 0; }
+  size_t size() const { return range_.count; }
+
+  std::string_view key(size_t i) const {
+    return store_->str(store_->captures[range_.first + i].key);
+  }
+  std::string_view name(size_t i) const {
+    return store_->str(store_->captures[range_.first + i].name);
+  }
+
+  // Scope name of a capture group (empty if there is none)
+  std::string_view find(std::string_view key) const;
+
+private:
+  const PatternStore *store_;
+  IndexRange range_;
+};
+
+// View of a TextMate grammar pattern
+class Pattern {
+public:
+  Pattern(const PatternStore &store, uint32_t index)
+      : store_(&store), index_(index) {}
+
+  uint32_t index() const { return index_; }
+  const PatternRecord &record() const { return store_->records[index_]; }
+
+  std::string_view name() const { return store_->str(record().name); }
+  std::string_view match() const { return store_->str(record().match); }
+  std::string_view begin() const { return store_->str(record().begin); }
+  std::string_view end() const { return store_->str(record().end); }
+  std::string_view include() const { return store_->str(record().include); }
+
+  std::string_view regex(RegexField field) const {
+    return field == kMatch ? match() : field == kBegin ? begin() : end();
+  }
+
+  // Nested patterns
+  PatternList patterns() const;
+
+  // Capture groups for match, begin and end patterns
+  CaptureList captures() const {
+    return {*store_, record().captures[kCaptures]};
+  }
+  CaptureList beginCaptures() const {
+    return {*store_, record().captures[kBeginCaptures]};
+  }
+  CaptureList endCaptures() const {
+    return {*store_, record().captures[kEndCaptures]};
+  }
+
+private:
+  const PatternStore *store_;
+  uint32_t index_;
+};
+
+// View of a list of patterns
+class PatternList {
+public:
+  class iterator {
+  public:
+    iterator(const PatternStore *store, const uint32_t *it)
+        : store_(store), it_(it) {}
+    Pattern operator*() const { return {*store_, *it_}; }
+    iterator &operator++() {
+      ++it_;
+      return *this;
+    }
+    bool operator!=(const iterator &other) const { return it_ != other.it_; }
+
+  private:
+    const PatternStore *store_;
+    const uint32_t *it_;
+  };
+
+  PatternList(const PatternStore &store, IndexRange range)
+      : store_(&store), range_(range) {}
+
+  bool empty() const { return range_.count == 0; }
+  size_t size() const { return range_.count; }
+  Pattern operator[](size_t i) const {
+    return {*store_, store_->children[range_.first + i]};
+  }
+  iterator begin() const {
+    return {store_, store_->children.data() + range_.first};
+  }
+  iterator end() const {
+    return {store_, store_->children.data() + range_.first + range_.count};
+  }
+
+private:
+  const PatternStore *store_;
+  IndexRange range_;
+};
+
+inline PatternList Pattern::patterns() const {
+  return {*store_, record().children};
+}
+
+// Repository containing named pattern rules, sorted by name
 struct Repository {
-  std::map<std::string, Pattern> rules;
+  std::pmr::vector<RuleRecord> rules;
 };
 
 // Complete TextMate grammar definition
 struct TextMateGrammar {
-  std::string name;              // Language name
-  std::string scopeName;         // Scope name (e.g., "source.go")
-  std::vector<Pattern> patterns; // Top-level patterns
-  Repository repository;         // Named pattern repository
+  explicit TextMateGrammar(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : repository{std::pmr::vector<RuleRecord>(resource)}, store(resource) {}
+
+  std::string name;      // Language name
+  std::string scopeName; // Scope name (e.g., "source.go")
+  IndexRange patterns;   // Top-level patterns (in store.children)
+  Repository repository; // Named pattern repository
+  PatternStore store;    // Storage of all patterns
+
+  PatternList topLevelPatterns() const { return {store, patterns}; }
+
+  std::string_view ruleName(const RuleRecord &rule) const {
+    return store.str(rule.name);
+  }
+  Pattern rulePattern(const RuleRecord &rule) const {
+    return {store, rule.pattern};
+  }
+
+  // Repository rule with the given name (nullptr if there is none)
+  const RuleRecord *findRule(std::string_view name) const;
+
+  // Remove every pattern, keeping the allocated capacity for the next grammar
+  void clear() {
+    name.clear();
+    scopeName.clear();
+    patterns = {};
+    repository.rules.clear();
+    store.clear();
+  }
 };
 
-// Main converter class from TextMate grammar to Vim syntax
+class GrammarRegistry;
+struct EmbeddedGrammar;
+
+// Repository rules left out because no include reaches them
+struct ReachabilityStats {
+  size_t rulesSkipped = 0;
+  size_t bytesSkipped = 0; // Text of the skipped rules (JSON grammars only)
+};
+
+// Settings shared by every conversion of a run
+struct ConversionOptions {
+  // Scope mappings overriding the built-in table (null = built-in only)
+  std::shared_ptr<const ScopeMap> scopeMap;
+  // Overrides of the ":syntax sync" setup derived from the regions
+  SyncOptions sync;
+  // Engine for every pattern (unset = chosen per pattern)
+  std::optional<VimRegexEngine> regexEngine;
+  // Parse and convert only the rules the top-level patterns reach
+  bool reachableOnly = false;
+  // Passes run over the syntax items before writing them
+  SyntaxPassSet passes = syntaxPassesForLevel(2);
+  // Measure the size of the items around each pass in passReports()
+  bool passSizes = false;
+  // Directory of the parsed grammar cache (empty = no cache)
+  std::string cacheDir;
+  // Translations shared by conversions, of one grammar in watch mode or of
+  // the grammars of a batch; safe to share between threads (null = none)
+  std::shared_ptr<RegexTranslationCache> regexCache;
+  // Grammars embedded where an include names their scope (null = such
+  // includes are dropped)
+  std::shared_ptr<GrammarRegistry> registry;
+  // Threads translating and generating the rules of one grammar (0 = one
+  // per hardware thread); the output does not depend on it
+  unsigned threads = 1;
+  // Time the phases of each conversion and count what they produce (see
+  // TmLanguage2VimSyntax::stats()); regexes are then translated up front,
+  // apart from the generation
+  bool stats = false;
+  // Allocations the calling thread has made so far, giving the allocation
+  // counts of the statistics (null = not counted; see alloc_stats.hxx)
+  AllocationStats (*allocationStats)() = nullptr;
+};
+
+// Receives the generated Vim syntax in consecutive chunks
+using SyntaxWriter = std::function<void(std::string_view)>;
+
+// Main converter class from TextMate grammar to Vim syntax. One instance can
+// convert any number of grammars in turn; the parsed grammar is allocated
+// from `resource`, and its memory is kept for the next parse.
 class TmLanguage2VimSyntax {
 public:
-  TmLanguage2VimSyntax();
+  explicit TmLanguage2VimSyntax(
+      const ConversionOptions &options = {},
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
   ~TmLanguage2VimSyntax();
 
-  // Parse TextMate grammar from JSON content
-  bool parseJson(const std::string &jsonContent);
+  // Parse a TextMate grammar, replacing the previous one. JSON, plist XML
+  // and YAML are read, told apart by their content.
+  bool parseGrammar(std::string_view content);
+
+  // Same as parseGrammar(), under its name from when only JSON was read
+  bool parseJson(std::string_view jsonContent) {
+    return parseGrammar(jsonContent);
+  }
+
+  // Drop the parsed grammar and the results of the last conversion
+  void reset();
 
   // Generate Vim syntax file content
   std::string generateVimSyntax() const;
 
+  // Write Vim syntax file content directly to a stream
+  void generateVimSyntax(std::ostream &os) const;
+
+  // Pass Vim syntax file content to a callback as it is generated
+  void generateVimSyntax(const SyntaxWriter &write) const;
+
+  // Name groups and clusters with `prefix` instead of "Go_" and make every
+  // item contained, for embedding the grammar in another one's file
+  void setEmbedded(const std::string &prefix);
+
+  // Write the syntax items and highlight links of an embedded grammar,
+  // without the file header, footer and sync setup
+  void generateEmbeddedSyntax(std::ostream &os) const;
+
+  // Scope names of the grammars the last generateEmbeddedSyntax() included
+  // in turn, sorted; they are referred to but not embedded
+  const std::vector<std::string> &embeddedScopes() const {
+    return embeddedScopes_;
+  }
+
+  // Error message of the last failed parse
+  const std::string &lastError() const { return lastError_; }
+
+  // Rules the last parse skipped with ConversionOptions::reachableOnly
+  const ReachabilityStats &reachability() const { return reachability_; }
+
+  // Whether the last parse was loaded from ConversionOptions::cacheDir
+  bool cacheHit() const { return cacheHit_; }
+
+  // What the passes of the last generateVimSyntax() did
+  const std::vector<SyntaxPassReport> &passReports() const {
+    return passReports_;
+  }
+
+  // Times and counts of the last parse and generation, with
+  // ConversionOptions::stats
+  const ConversionStats &stats() const { return stats_; }
+
+  // Compile every match/begin/end regex with Oniguruma and estimate the cost
+  // of its Vim translation, in grammar order
+  std::vector<RegexReport> analyzeRegexes() const;
+
 private:
+  ConversionOptions options_;
   TextMateGrammar grammar_;
+  IncludeGraph includes_; // Include references of grammar_
+  ReachabilityStats reachability_;
+  bool cacheHit_ = false;
+  std::string groupPrefix_ = "Go_";
+  bool embedded_ = false; // Set by setEmbedded()
+  std::string lastError_;
+  mutable VimRegexTranslator translator_; // Scratch state reused per pattern
+  mutable std::vector<SyntaxPassReport> passReports_;
+  mutable ConversionStats stats_;
+  // Grammars the last generation embedded, sorted by scope name when it
+  // is done; rules generated in parallel add to it under the mutex
+  mutable std::vector<std::shared_ptr<const EmbeddedGrammar>> embeddings_;
+  // What an embedded grammar includes instead, under the same mutex
+  mutable std::vector<std::string> embeddedScopes_;
+  mutable std::mutex embeddingsMutex_;
+
+  // Statistics to collect into, or null if they are not collected
+  ConversionStats *collectedStats() const {
+    return options_.stats ? &stats_ : nullptr;
+  }
+
+  // Count the rules, patterns and regexes of the parsed grammar
+  void countGrammar();
+
+  // Parse grammar text into the grammar structure
+  void parseGrammarText(std::string_view text);
 
-  // Parse JSON value into grammar structure
-  void parseJsonValue(const std::string &json);
+  // Load the grammar from the cache, or parse it and add it to the cache
+  void parseGrammarCached(std::string_view text);
 
-  // Parse individual pattern from JSON
-  Pattern parsePattern(const nlohmann::json &patternJson);
+  // Translate every regex of the grammar into PatternStore::translations
+  void translateRegexes();
+  void translateRegexesInParallel(unsigned threads);
 
   // Convert TextMate regex to Vim regex format
-  std::string convertRegexToVim(const std::string &regex) const;
+  std::string convertRegexToVim(std::string_view regex) const;
+
+  // Vim pattern of a regex of a pattern, with its engine prefix
+  SyntaxPattern translatePattern(Pattern pattern, RegexField field) const;
 
   // Convert TextMate scope to Vim syntax group name
-  std::string convertScopeToVim(const std::string &scope) const;
+  std::string convertScopeToVim(std::string_view scope) const;
+
+  // Generate syntax rules for patterns; nested patterns are contained
+  void generateSyntaxRules(std::vector<SyntaxItem> &items,
+                           PatternList patterns, bool contained = false) const;
+  void generateSyntaxRule(std::vector<SyntaxItem> &items, Pattern pattern,
+                          bool contained) const;
+
+  // Syntax group a match or region pattern is emitted as (empty if none)
+  std::string syntaxGroupOf(Pattern pattern) const;
+
+  // Cluster standing for an include graph node
+  std::string clusterName(uint32_t node) const;
+
+  // Cluster of another grammar an include names, embedding the grammar
+  // through the registry ("" if it is not available). An embedded grammar
+  // only records the scope, for the including file to embed.
+  std::string externalCluster(std::string_view include) const;
 
-  // Generate syntax rules for patterns
-  void generateSyntaxRules(std::ostream &os,
-                           const std::vector<Pattern> &patterns,
-                           const std::string &parentGroup = "") const;
+  // Items of a region's contains=, with includes as clusters
+  void collectContains(PatternList patterns,
+                       std::vector<std::string> &contains) const;
 
   // Generate repository rules
-  void generateRepositoryRules(std::ostream &os) const;
+  void generateRepositoryRules(std::vector<SyntaxItem> &items) const;
+  void generateRule(std::vector<SyntaxItem> &items,
+                    const RuleRecord &rule) const;
+
+  // Generate rules in the given order, on several threads if the options
+  // ask for it; their items are joined in that order
+  void generateRules(std::vector<SyntaxItem> &items,
+                     const std::vector<const RuleRecord *> &rules) const;
+
+  // Generate ":syntax cluster" for every included rule
+  void generateClusters(std::vector<SyntaxItem> &items) const;
+
+  // Generate the items of the whole grammar, before any pass
+  void generateSyntaxItems(std::vector<SyntaxItem> &items) const;
+
+  // Write "highlight default link" for every syntax group
+  void writeHighlightLinks(std::ostream &os) const;
 
   // Escape string for Vim syntax
   std::string escapeVimString(const std::string &str) const;
 
   // Map TextMate scope to Vim highlight group
-  std::string mapScopeToHighlightGroup(const std::string &scope) const;
+  std::string_view mapScopeToHighlightGroup(std::string_view scope) const;
+
+  // Collect the scope names of all syntax groups, sorted and unique
+  void collectSyntaxGroups(std::vector<std::string_view> &groups) const;
 
-  // Collect all syntax groups from patterns
-  void collectSyntaxGroups(const std::vector<Pattern> &patterns,
-                           std::set<std::string> &groups) const;
+  // Analyze the regexes of patterns and their nested patterns
+  void analyzePatterns(std::vector<RegexReport> &reports, PatternList patterns,
+                       const std::string &location) const;
+  void analyzePattern(std::vector<RegexReport> &reports, Pattern pattern,
+                      const std::string &location) const;
 
   // Initialize Oniguruma (if needed)
   void initializeOniguruma();
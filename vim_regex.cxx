@@ -0,0 +1,1226 @@
+#include "vim_regex.hxx"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+bool isWordChar(unsigned char c) {
+  return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+bool isHexDigit(char c) { return std::isxdigit(static_cast<unsigned char>(c)); }
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Range endpoints that only cover word characters ("a-z", "0-9", ...)
+bool isWordRange(char from, char to) {
+  return (isDigit(from) && isDigit(to)) ||
+         (std::islower(static_cast<unsigned char>(from)) &&
+          std::islower(static_cast<unsigned char>(to))) ||
+         (std::isupper(static_cast<unsigned char>(from)) &&
+          std::isupper(static_cast<unsigned char>(to)));
+}
+
+// Escapes standing for a set of characters, which cannot bound a range
+bool isClassShorthand(char c) {
+  return std::strchr("dDwWhHsS", c) != nullptr;
+}
+
+bool isWordPosixClass(std::string_view name) {
+  return name == "alnum" || name == "alpha" || name == "digit" ||
+         name == "lower" || name == "upper" || name == "xdigit" ||
+         name == "word";
+}
+
+// Characters that can be listed in a Vim collection as they are
+bool isPlainClassChar(char c) {
+  return c > ' ' && c < 0x7f && c != ']' && c != '^' && c != '-' &&
+         c != '\\' && c != '[';
+}
+
+constexpr uint32_t kNone = UINT32_MAX;
+
+} // namespace
+
+const RegexTree &VimRegexTranslator::parse(std::string_view regex) {
+  tree_.clear();
+  scratch_.clear();
+  groupNames_.clear();
+  groupNumbers_.clear();
+  src_ = regex;
+  pos_ = 0;
+  extended_ = false;
+  captureCount_ = 0;
+
+  tree_.root = parseAlternation(0);
+  return tree_;
+}
+
+const std::string &VimRegexTranslator::print() {
+  out_.clear();
+  if (tree_.truncated) {
+    out_.assign(src_);
+  } else {
+    printNode(tree_.root);
+  }
+  return out_;
+}
+
+const std::string &VimRegexTranslator::translate(std::string_view regex) {
+  parse(regex);
+  return print();
+}
+
+uint32_t VimRegexTranslator::addNode(RegexNodeKind kind) {
+  tree_.nodes.push_back(RegexNode{kind});
+  return static_cast<uint32_t>(tree_.nodes.size() - 1);
+}
+
+uint32_t VimRegexTranslator::addText(RegexNodeKind kind,
+                                     std::string_view text) {
+  uint32_t index = addNode(kind);
+  RegexNode &node = tree_.nodes[index];
+  node.text = static_cast<uint32_t>(tree_.text.size());
+  node.textLength = static_cast<uint32_t>(text.size());
+  tree_.text.append(text);
+  return index;
+}
+
+uint32_t VimRegexTranslator::addList(RegexNodeKind kind, size_t scratchStart) {
+  uint32_t first = static_cast<uint32_t>(tree_.children.size());
+  tree_.children.insert(tree_.children.end(), scratch_.begin() + scratchStart,
+                        scratch_.end());
+  scratch_.resize(scratchStart);
+
+  uint32_t index = addNode(kind);
+  tree_.nodes[index].first = first;
+  tree_.nodes[index].count =
+      static_cast<uint32_t>(tree_.children.size()) - first;
+  return index;
+}
+
+uint32_t VimRegexTranslator::parseAlternation(int depth) {
+  size_t start = scratch_.size();
+  scratch_.push_back(parseSequence(depth));
+  while (pos_ < src_.size() && src_[pos_] == '|') {
+    pos_++;
+    scratch_.push_back(parseSequence(depth));
+  }
+  if (scratch_.size() - start == 1) {
+    uint32_t only = scratch_.back();
+    scratch_.pop_back();
+    return only;
+  }
+  return addList(RegexNodeKind::Alternation, start);
+}
+
+uint32_t VimRegexTranslator::parseSequence(int depth) {
+  size_t start = scratch_.size();
+  for (;;) {
+    if (extended_) {
+      skipExtended();
+    }
+    if (pos_ >= src_.size() || src_[pos_] == '|' ||
+        (src_[pos_] == ')' && depth > 0)) {
+      break;
+    }
+    uint32_t atom = parseAtom(depth);
+    if (atom != kNone) {
+      scratch_.push_back(parseQuantifiers(atom));
+    }
+  }
+  return addList(RegexNodeKind::Sequence, start);
+}
+
+void VimRegexTranslator::skipExtended() {
+  while (pos_ < src_.size()) {
+    char c = src_[pos_];
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+        c == '\v') {
+      pos_++;
+    } else if (c == '#') {
+      while (pos_ < src_.size() && src_[pos_] != '\n') {
+        pos_++;
+      }
+    } else {
+      break;
+    }
+  }
+}
+
+uint32_t VimRegexTranslator::parseAtom(int depth) {
+  char c = src_[pos_];
+  switch (c) {
+  case '(':
+    return parseGroup(depth);
+  case '[':
+    return parseClass();
+  case '\\':
+    return parseEscape();
+  case '.':
+    pos_++;
+    return addNode(RegexNodeKind::Any);
+  case '^':
+    pos_++;
+    return addNode(RegexNodeKind::LineStart);
+  case '$':
+    pos_++;
+    return addNode(RegexNodeKind::LineEnd);
+  default: {
+    // Everything else, including a quantifier with nothing to repeat and an
+    // unmatched ")", is taken literally
+    pos_++;
+    uint32_t index = addNode(RegexNodeKind::Literal);
+    tree_.nodes[index].ch = c;
+    return index;
+  }
+  }
+}
+
+bool VimRegexTranslator::applyOptions(std::string_view options) {
+  bool on = true;
+  bool ignoreCase = false;
+  for (char c : options) {
+    if (c == '-') {
+      on = false;
+    } else if (c == 'x') {
+      extended_ = on;
+    } else if (c == 'i' && on) {
+      ignoreCase = true;
+    }
+  }
+  return ignoreCase;
+}
+
+uint32_t VimRegexTranslator::parseGroup(int depth) {
+  pos_++; // "("
+  if (depth >= kMaxDepth) {
+    // Stop descending; print() falls back to the source text
+    tree_.truncated = true;
+    uint32_t rest = addText(RegexNodeKind::Raw, src_.substr(pos_));
+    pos_ = src_.size();
+    return rest;
+  }
+
+  RegexGroupKind kind = RegexGroupKind::Capture;
+  std::string_view name;
+  bool ignoreCase = false;
+  bool savedExtended = extended_;
+
+  if (pos_ < src_.size() && src_[pos_] == '?') {
+    pos_++;
+    char c = pos_ < src_.size() ? src_[pos_] : '\0';
+    char d = pos_ + 1 < src_.size() ? src_[pos_ + 1] : '\0';
+    if (c == ':') {
+      kind = RegexGroupKind::NonCapture;
+      pos_++;
+    } else if (c == '=') {
+      kind = RegexGroupKind::Lookahead;
+      pos_++;
+    } else if (c == '!') {
+      kind = RegexGroupKind::NegativeLookahead;
+      pos_++;
+    } else if (c == '>') {
+      kind = RegexGroupKind::Atomic;
+      pos_++;
+    } else if (c == '<' && d == '=') {
+      kind = RegexGroupKind::Lookbehind;
+      pos_ += 2;
+    } else if (c == '<' && d == '!') {
+      kind = RegexGroupKind::NegativeLookbehind;
+      pos_ += 2;
+    } else if (c == '<' || c == '\'' || (c == 'P' && d == '<')) {
+      // Named group: (?<name>...), (?'name'...) or (?P<name>...)
+      pos_ += c == 'P' ? 2 : 1;
+      char close = c == '\'' ? '\'' : '>';
+      size_t end = src_.find(close, pos_);
+      if (end == std::string_view::npos) {
+        end = src_.size();
+      }
+      name = src_.substr(pos_, end - pos_);
+      pos_ = end < src_.size() ? end + 1 : end;
+    } else if (c == '#') {
+      // Comment group
+      size_t end = src_.find(')', pos_);
+      pos_ = end == std::string_view::npos ? src_.size() : end + 1;
+      return kNone;
+    } else {
+      // Inline options: (?imx-imx) for the rest of the enclosing group or
+      // (?imx-imx:...) for the group itself
+      size_t start = pos_;
+      while (pos_ < src_.size() &&
+             (std::isalpha(static_cast<unsigned char>(src_[pos_])) ||
+              src_[pos_] == '-')) {
+        pos_++;
+      }
+      std::string_view options = src_.substr(start, pos_ - start);
+      if (pos_ < src_.size() && src_[pos_] == ')') {
+        pos_++;
+        return applyOptions(options) ? addNode(RegexNodeKind::IgnoreCase)
+                                     : kNone;
+      }
+      if (pos_ < src_.size() && src_[pos_] == ':') {
+        pos_++;
+      }
+      ignoreCase = applyOptions(options);
+      kind = RegexGroupKind::NonCapture;
+    }
+  }
+
+  if (kind == RegexGroupKind::Capture) {
+    captureCount_++;
+    if (!name.empty()) {
+      groupNames_.push_back(name);
+      groupNumbers_.push_back(captureCount_);
+    }
+  }
+
+  uint32_t body = parseAlternation(depth + 1);
+  if (ignoreCase) {
+    size_t start = scratch_.size();
+    scratch_.push_back(addNode(RegexNodeKind::IgnoreCase));
+    scratch_.push_back(body);
+    body = addList(RegexNodeKind::Sequence, start);
+  }
+  if (pos_ < src_.size() && src_[pos_] == ')') {
+    pos_++;
+  }
+  extended_ = savedExtended;
+
+  uint32_t index = addNode(RegexNodeKind::Group);
+  tree_.nodes[index].group = kind;
+  tree_.nodes[index].first = body;
+  return index;
+}
+
+bool VimRegexTranslator::appendCodePoint(std::string &out, bool inClass) {
+  char c = src_[pos_];
+  size_t start = pos_ + 1;
+  size_t end = start;
+  unsigned long value = 0;
+  int base = 16;
+
+  if (c == 'x' && start < src_.size() && src_[start] == '{') {
+    end = src_.find('}', start);
+    // Oniguruma takes at most eight digits, which also keeps the value in
+    // 32 bits
+    if (end == std::string_view::npos || end == start + 1 ||
+        end - start - 1 > 8) {
+      return false;
+    }
+    for (size_t i = start + 1; i < end; ++i) {
+      if (!isHexDigit(src_[i])) {
+        return false;
+      }
+    }
+    std::from_chars(src_.data() + start + 1, src_.data() + end, value, 16);
+    end++;
+  } else {
+    size_t maxDigits = c == 'x' ? 2 : c == 'u' ? 4 : 2;
+    base = c == '0' ? 8 : 16;
+    while (end < src_.size() && end - start < maxDigits &&
+           (base == 16 ? isHexDigit(src_[end])
+                       : (src_[end] >= '0' && src_[end] <= '7'))) {
+      end++;
+    }
+    if (c == 'u' && end - start != 4) {
+      return false;
+    }
+    if (c == 'x' && end == start) {
+      return false;
+    }
+    if (end > start) {
+      std::from_chars(src_.data() + start, src_.data() + end, value, base);
+    }
+  }
+
+  char buffer[16];
+  if (value <= 0xff) {
+    std::snprintf(buffer, sizeof(buffer), inClass ? "\\x%02lx" : "\\%%x%02lx",
+                  value);
+  } else if (value <= 0xffff) {
+    std::snprintf(buffer, sizeof(buffer), inClass ? "\\u%04lx" : "\\%%u%04lx",
+                  value);
+  } else {
+    std::snprintf(buffer, sizeof(buffer), inClass ? "\\U%08lx" : "\\%%U%08lx",
+                  value);
+  }
+  out += buffer;
+  pos_ = end;
+  return true;
+}
+
+uint32_t VimRegexTranslator::parseEscape() {
+  pos_++; // "\"
+  if (pos_ >= src_.size()) {
+    uint32_t index = addNode(RegexNodeKind::Literal);
+    tree_.nodes[index].ch = '\\';
+    return index;
+  }
+
+  char c = src_[pos_];
+  switch (c) {
+  case 'b':
+    pos_++;
+    return addNode(RegexNodeKind::WordBoundary);
+  case 'B':
+    pos_++;
+    return addNode(RegexNodeKind::NotWordBoundary);
+  case 'A':
+    pos_++;
+    return addText(RegexNodeKind::Raw, "\\%^");
+  case 'z':
+  case 'Z':
+    pos_++;
+    return addText(RegexNodeKind::Raw, "\\%$");
+  case 'K':
+    pos_++;
+    return addText(RegexNodeKind::Raw, "\\zs");
+  case 'w':
+  case 'd': {
+    pos_++;
+    char text[] = {'\\', c, '\0'};
+    uint32_t index = addText(RegexNodeKind::Escape, text);
+    tree_.nodes[index].wordOnly = true;
+    return index;
+  }
+  case 'h': {
+    // Oniguruma \h is a hex digit, Vim's is \x
+    pos_++;
+    uint32_t index = addText(RegexNodeKind::Escape, "\\x");
+    tree_.nodes[index].wordOnly = true;
+    return index;
+  }
+  case 'H':
+    pos_++;
+    return addText(RegexNodeKind::Escape, "\\X");
+  case 'W':
+  case 's':
+  case 'S':
+  case 'D':
+  case 'n':
+  case 't':
+  case 'r':
+  case 'e': {
+    pos_++;
+    char text[] = {'\\', c, '\0'};
+    return addText(RegexNodeKind::Escape, text);
+  }
+  case 'f':
+    pos_++;
+    return addText(RegexNodeKind::Escape, "\\%x0c");
+  case 'v':
+    pos_++;
+    return addText(RegexNodeKind::Escape, "\\%x0b");
+  case 'a':
+    pos_++;
+    return addText(RegexNodeKind::Escape, "\\%x07");
+  case 'x':
+  case 'u':
+  case '0': {
+    std::string text;
+    if (appendCodePoint(text, false)) {
+      return addText(RegexNodeKind::Escape, text);
+    }
+    break;
+  }
+  case 'k': {
+    // Named back reference \k<name>
+    if (pos_ + 1 < src_.size() &&
+        (src_[pos_ + 1] == '<' || src_[pos_ + 1] == '\'')) {
+      char close = src_[pos_ + 1] == '<' ? '>' : '\'';
+      size_t end = src_.find(close, pos_ + 2);
+      if (end != std::string_view::npos) {
+        std::string_view name = src_.substr(pos_ + 2, end - pos_ - 2);
+        for (size_t i = groupNames_.size(); i-- > 0;) {
+          if (groupNames_[i] == name && groupNumbers_[i] <= 9) {
+            pos_ = end + 1;
+            char text[] = {'\\', static_cast<char>('0' + groupNumbers_[i]),
+                           '\0'};
+            return addText(RegexNodeKind::Backref, text);
+          }
+        }
+      }
+    }
+    break;
+  }
+  case 'p':
+  case 'P':
+    // Unicode properties have no Vim equivalent
+    if (pos_ + 1 < src_.size() && src_[pos_ + 1] == '{') {
+      size_t end = src_.find('}', pos_);
+      if (end != std::string_view::npos) {
+        size_t start = pos_ - 1;
+        pos_ = end + 1;
+        return addText(RegexNodeKind::Raw, src_.substr(start, pos_ - start));
+      }
+    }
+    break;
+  default:
+    if (c >= '1' && c <= '9') {
+      pos_++;
+      char text[] = {'\\', c, '\0'};
+      return addText(RegexNodeKind::Backref, text);
+    }
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      // Escaped punctuation is always a literal in Oniguruma
+      pos_++;
+      uint32_t index = addNode(RegexNodeKind::Literal);
+      tree_.nodes[index].ch = c;
+      return index;
+    }
+    break;
+  }
+
+  // Anything else is copied as is
+  pos_++;
+  char text[] = {'\\', c, '\0'};
+  return addText(RegexNodeKind::Raw, text);
+}
+
+bool VimRegexTranslator::appendClassEscape(std::string &out, bool &wordOnly) {
+  char c = src_[pos_];
+  switch (c) {
+  case 'd':
+    out += "0-9";
+    break;
+  case 'w':
+    out += "0-9A-Za-z_";
+    break;
+  case 'h':
+    out += "0-9A-Fa-f";
+    break;
+  case 's':
+    out += " \\t\\n\\r\\x0b\\x0c";
+    wordOnly = false;
+    break;
+  case 'n':
+  case 't':
+  case 'r':
+  case 'e':
+  case 'b':
+    out += '\\';
+    out += c;
+    wordOnly = false;
+    break;
+  case 'f':
+    out += "\\x0c";
+    wordOnly = false;
+    break;
+  case 'v':
+    out += "\\x0b";
+    wordOnly = false;
+    break;
+  case 'a':
+    out += "\\x07";
+    wordOnly = false;
+    break;
+  case 'x':
+  case 'u':
+  case '0':
+    wordOnly = false;
+    return appendCodePoint(out, true);
+  case ']':
+  case '^':
+  case '-':
+  case '\\':
+    out += '\\';
+    out += c;
+    wordOnly = false;
+    break;
+  default:
+    // Negated types (\D, \W, \S), properties and unknown letters cannot be
+    // expressed inside a Vim collection
+    if (std::isalnum(static_cast<unsigned char>(c))) {
+      return false;
+    }
+    out += c;
+    wordOnly = wordOnly && isWordChar(static_cast<unsigned char>(c));
+    break;
+  }
+  pos_++;
+  return true;
+}
+
+uint32_t VimRegexTranslator::parseClass() {
+  size_t start = pos_;
+  std::string collection;
+  bool wordOnly = true;
+  bool negated = false;
+  if (!parseClassBody(collection, wordOnly, negated)) {
+    if (pos_ >= src_.size()) {
+      // Unterminated: take the "[" literally
+      pos_ = start + 1;
+      uint32_t index = addNode(RegexNodeKind::Literal);
+      tree_.nodes[index].ch = '[';
+      return index;
+    }
+    // Untranslatable collections are copied as is
+    return addText(RegexNodeKind::Raw, src_.substr(start, pos_ - start));
+  }
+
+  uint32_t index = addText(RegexNodeKind::CharClass, collection);
+  tree_.nodes[index].wordOnly = wordOnly && !negated;
+  return index;
+}
+
+bool VimRegexTranslator::parseClassBody(std::string &out, bool &wordOnly,
+                                        bool &negated) {
+  pos_++; // "["
+  out += '[';
+  if (pos_ < src_.size() && src_[pos_] == '^') {
+    negated = true;
+    out += '^';
+    pos_++;
+  }
+
+  bool ok = true;
+  bool first = true;
+  // The previous item is a single character, which a "-" can make the start
+  // of a range; inRange is set while the escape ending a range is read
+  bool rangeStart = false;
+  bool inRange = false;
+  for (;;) {
+    if (pos_ >= src_.size()) {
+      return false;
+    }
+    char c = src_[pos_];
+    if (c == ']' && !first) {
+      pos_++;
+      break;
+    }
+    first = false;
+
+    if (c == '[' && pos_ + 1 < src_.size() && src_[pos_ + 1] == ':') {
+      // POSIX bracket, the same in Vim
+      size_t end = src_.find(":]", pos_ + 2);
+      if (end != std::string_view::npos) {
+        std::string_view name = src_.substr(pos_ + 2, end - pos_ - 2);
+        if (!name.empty() && name[0] == '^') {
+          ok = false;
+        }
+        wordOnly = wordOnly && isWordPosixClass(name);
+        out.append(src_.substr(pos_, end + 2 - pos_));
+        pos_ = end + 2;
+        rangeStart = false;
+        continue;
+      }
+    }
+    if (c == '[') {
+      // Nested set: a plain union can be flattened into this collection
+      std::string nested;
+      bool nestedNegated = false;
+      if (!parseClassBody(nested, wordOnly, nestedNegated)) {
+        if (pos_ >= src_.size()) {
+          return false;
+        }
+        ok = false;
+      } else if (nestedNegated) {
+        ok = false;
+      } else {
+        out.append(nested, 1, nested.size() - 2);
+      }
+      rangeStart = false;
+      continue;
+    }
+    if (c == '&' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '&') {
+      // Intersections do not exist in Vim
+      ok = false;
+      pos_ += 2;
+      rangeStart = false;
+      continue;
+    }
+    if (c == '\\') {
+      pos_++;
+      if (pos_ >= src_.size()) {
+        return false;
+      }
+      char escape = src_[pos_];
+      if (!appendClassEscape(out, wordOnly)) {
+        ok = false;
+        pos_++;
+      }
+      rangeStart = !inRange && !isClassShorthand(escape);
+      inRange = false;
+      continue;
+    }
+    if (c == '-' && rangeStart && pos_ + 1 < src_.size() &&
+        src_[pos_ + 1] != ']' && src_[pos_ + 1] != '[') {
+      if (src_[pos_ + 1] != '\\') {
+        // Range: same syntax in Vim
+        char from = out.back();
+        char to = src_[pos_ + 1];
+        wordOnly = wordOnly && isWordRange(from, to);
+        out += '-';
+        out += to;
+        pos_ += 2;
+        rangeStart = false;
+        continue;
+      }
+      if (pos_ + 2 < src_.size() && !isClassShorthand(src_[pos_ + 2])) {
+        // Range up to an escaped character, printed next
+        out += '-';
+        wordOnly = false;
+        pos_++;
+        inRange = true;
+        continue;
+      }
+    }
+    if (c == '-') {
+      // A literal "-", which only needs escaping between two items
+      bool edge = out.back() == '[' || (out.back() == '^' && negated &&
+                                        out.size() == 2) ||
+                  (pos_ + 1 < src_.size() && src_[pos_ + 1] == ']');
+      out += edge ? "-" : "\\-";
+    } else if (c == ']') {
+      out += "\\]";
+    } else {
+      out += c;
+    }
+    wordOnly = wordOnly && isWordChar(static_cast<unsigned char>(c));
+    rangeStart = c != '-';
+    pos_++;
+  }
+  out += ']';
+  return ok;
+}
+
+bool VimRegexTranslator::parseBraces(int32_t &min, int32_t &max) {
+  // {n}, {n,}, {,m} or {n,m}; anything else is a literal "{"
+  size_t i = pos_ + 1;
+  auto number = [&](int32_t &value) {
+    size_t start = i;
+    value = 0;
+    while (i < src_.size() && isDigit(src_[i]) && i - start < 6) {
+      value = value * 10 + (src_[i] - '0');
+      i++;
+    }
+    return i > start;
+  };
+
+  bool hasMin = number(min);
+  if (i < src_.size() && src_[i] == '}') {
+    if (!hasMin) {
+      return false;
+    }
+    max = min;
+  } else if (i < src_.size() && src_[i] == ',') {
+    i++;
+    bool hasMax = number(max);
+    if (!hasMin && !hasMax) {
+      return false;
+    }
+    if (!hasMin) {
+      min = 0;
+    }
+    if (!hasMax) {
+      max = -1;
+    }
+    if (i >= src_.size() || src_[i] != '}') {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  pos_ = i + 1;
+  return true;
+}
+
+uint32_t VimRegexTranslator::parseQuantifiers(uint32_t atom) {
+  for (;;) {
+    if (extended_) {
+      skipExtended();
+    }
+    if (pos_ >= src_.size()) {
+      break;
+    }
+
+    int32_t min = 0;
+    int32_t max = -1;
+    bool braces = false;
+    char c = src_[pos_];
+    if (c == '*') {
+      pos_++;
+    } else if (c == '+') {
+      min = 1;
+      pos_++;
+    } else if (c == '?') {
+      max = 1;
+      pos_++;
+    } else if (c == '{' && parseBraces(min, max)) {
+      braces = true;
+    } else {
+      break;
+    }
+
+    RegexRepeatMode mode = RegexRepeatMode::Greedy;
+    if (pos_ < src_.size() && src_[pos_] == '?') {
+      mode = RegexRepeatMode::Lazy;
+      pos_++;
+    } else if (pos_ < src_.size() && src_[pos_] == '+' && !braces) {
+      mode = RegexRepeatMode::Possessive;
+      pos_++;
+    }
+
+    uint32_t index = addNode(RegexNodeKind::Repeat);
+    RegexNode &node = tree_.nodes[index];
+    node.first = atom;
+    node.min = min;
+    node.max = max;
+    node.mode = mode;
+    atom = index;
+  }
+  return atom;
+}
+
+int VimRegexTranslator::wordEdge(uint32_t index, bool front) const {
+  const RegexNode &node = tree_.nodes[index];
+  switch (node.kind) {
+  case RegexNodeKind::Literal:
+    return isWordChar(static_cast<unsigned char>(node.ch)) ? 1 : 0;
+  case RegexNodeKind::CharClass:
+  case RegexNodeKind::Escape:
+    return node.wordOnly ? 1 : -1;
+  case RegexNodeKind::Group:
+    if (node.group == RegexGroupKind::Capture ||
+        node.group == RegexGroupKind::NonCapture ||
+        node.group == RegexGroupKind::Atomic) {
+      return wordEdge(node.first, front);
+    }
+    return -1;
+  case RegexNodeKind::Repeat:
+    return node.min >= 1 ? wordEdge(node.first, front) : -1;
+  case RegexNodeKind::Sequence:
+    if (node.count == 0) {
+      return -1;
+    }
+    return wordEdge(tree_.child(node, front ? 0 : node.count - 1), front);
+  case RegexNodeKind::Alternation: {
+    int edge = wordEdge(tree_.child(node, 0), front);
+    for (uint32_t i = 1; i < node.count && edge != -1; ++i) {
+      if (wordEdge(tree_.child(node, i), front) != edge) {
+        edge = -1;
+      }
+    }
+    return edge;
+  }
+  default:
+    return -1;
+  }
+}
+
+void VimRegexTranslator::printLiteral(char ch) {
+  switch (ch) {
+  case '\\':
+  case '.':
+  case '*':
+  case '[':
+  case '~':
+  case '^':
+  case '$':
+    out_ += '\\';
+    out_ += ch;
+    break;
+  case '|':
+    // Use [|] to avoid confusion with Vim's \| operator
+    out_ += "[|]";
+    break;
+  case '\n':
+    out_ += "\\n";
+    break;
+  case '\r':
+    out_ += "\\r";
+    break;
+  case '\t':
+    out_ += "\\t";
+    break;
+  default:
+    out_ += ch;
+    break;
+  }
+}
+
+void VimRegexTranslator::printSequence(const RegexNode &node) {
+  for (uint32_t i = 0; i < node.count; ++i) {
+    uint32_t index = tree_.child(node, i);
+    const RegexNode &child = tree_.nodes[index];
+
+    // Vim only treats ^ and $ as anchors at the start or end of a branch
+    if (child.kind == RegexNodeKind::LineStart && i == 0) {
+      out_ += '^';
+    } else if (child.kind == RegexNodeKind::LineEnd && i + 1 == node.count) {
+      out_ += '$';
+    } else if (child.kind == RegexNodeKind::WordBoundary) {
+      // Vim has no \b; pick the start or end of word from what is next to it
+      int next = i + 1 < node.count
+                     ? wordEdge(tree_.child(node, i + 1), true)
+                     : -1;
+      int previous = i > 0 ? wordEdge(tree_.child(node, i - 1), false) : -1;
+      if (next == 1) {
+        out_ += "\\<";
+      } else if (previous == 1) {
+        out_ += "\\>";
+      } else {
+        printNode(index);
+      }
+    } else {
+      printNode(index);
+    }
+  }
+}
+
+void VimRegexTranslator::printRepeat(const RegexNode &node) {
+  const RegexNode &child = tree_.nodes[node.first];
+  bool possessive = node.mode == RegexRepeatMode::Possessive;
+  if (possessive) {
+    out_ += "\\%(";
+  }
+
+  // Vim cannot repeat a multi directly
+  bool wrap = child.kind == RegexNodeKind::Repeat;
+  if (wrap) {
+    out_ += "\\%(";
+  }
+  printNode(node.first);
+  if (wrap) {
+    out_ += "\\)";
+  }
+
+  if (node.mode == RegexRepeatMode::Lazy) {
+    out_ += "\\{-";
+    if (node.min > 0) {
+      out_ += std::to_string(node.min);
+    }
+    if (node.max != node.min) {
+      out_ += ',';
+      if (node.max >= 0) {
+        out_ += std::to_string(node.max);
+      }
+    }
+    out_ += "\\}";
+  } else if (node.min == 0 && node.max == -1) {
+    out_ += '*';
+  } else if (node.min == 1 && node.max == -1) {
+    out_ += "\\+";
+  } else if (node.min == 0 && node.max == 1) {
+    out_ += "\\?";
+  } else {
+    out_ += "\\{";
+    out_ += std::to_string(node.min);
+    if (node.max != node.min) {
+      out_ += ',';
+      if (node.max >= 0) {
+        out_ += std::to_string(node.max);
+      }
+    }
+    out_ += "\\}";
+  }
+
+  if (possessive) {
+    out_ += "\\)\\@>";
+  }
+}
+
+bool VimRegexTranslator::printTrie(const RegexNode &node) {
+  if (!factorAlternations_ || node.count < kMinTrieBranches) {
+    return false;
+  }
+
+  // Only alternations of plain literal strings are factored
+  trie_.clear();
+  trie_.emplace_back();
+  for (uint32_t i = 0; i < node.count; ++i) {
+    const RegexNode &branch = tree_.nodes[tree_.child(node, i)];
+    if (branch.kind != RegexNodeKind::Sequence || branch.count == 0) {
+      return false;
+    }
+    uint32_t current = 0;
+    for (uint32_t j = 0; j < branch.count; ++j) {
+      const RegexNode &atom = tree_.nodes[tree_.child(branch, j)];
+      if (atom.kind != RegexNodeKind::Literal) {
+        return false;
+      }
+      trie_[current].first = std::min(trie_[current].first, i);
+      trie_[current].last = std::max(trie_[current].last, i);
+
+      uint32_t *link = &trie_[current].child;
+      while (*link != kNoTrieNode && trie_[*link].ch < atom.ch) {
+        link = &trie_[*link].sibling;
+      }
+      if (*link == kNoTrieNode || trie_[*link].ch != atom.ch) {
+        TrieNode created;
+        created.ch = atom.ch;
+        created.sibling = *link;
+        created.depth = j + 1;
+        *link = static_cast<uint32_t>(trie_.size());
+        trie_.push_back(created); // May move the node `link` points into
+        current = static_cast<uint32_t>(trie_.size() - 1);
+      } else {
+        current = *link;
+      }
+    }
+    trie_[current].branch = std::min(trie_[current].branch, i);
+  }
+
+  printTrieNode(node, 0);
+  return true;
+}
+
+void VimRegexTranslator::printTrieNode(const RegexNode &alternation,
+                                       uint32_t index) {
+  const TrieNode &node = trie_[index];
+  if (node.child == kNoTrieNode) {
+    return;
+  }
+
+  // Branches that start differently never match at the same place, so only
+  // a branch that is a prefix of others has to keep its priority: it must
+  // come before or after all of them in the original order. Otherwise the
+  // rest of this subtree stays a plain alternation.
+  bool optional = node.branch != kNoTrieNode;
+  if (optional && node.first < node.branch && node.branch < node.last) {
+    printTrieBranches(alternation, index);
+    return;
+  }
+
+  // Children that end their branches can share one collection
+  size_t leaves = 0;
+  size_t alternatives = 0;
+  for (uint32_t c = node.child; c != kNoTrieNode; c = trie_[c].sibling) {
+    if (trie_[c].child == kNoTrieNode && isPlainClassChar(trie_[c].ch)) {
+      leaves++;
+    } else {
+      alternatives++;
+    }
+  }
+  bool useClass = leaves >= 2;
+  alternatives += useClass ? 1 : leaves;
+
+  // A branch ending here is tried first (\%(\|...\)) or last (...\?)
+  bool optionalFirst = optional && node.branch < node.first;
+  bool singleAtom = alternatives == 1 &&
+                    (useClass || trie_[node.child].child == kNoTrieNode);
+  bool group = alternatives > 1 || (optional && (optionalFirst || !singleAtom));
+
+  if (group) {
+    out_ += optionalFirst ? "\\%(\\|" : "\\%(";
+  }
+  bool separator = false;
+  if (useClass) {
+    out_ += '[';
+    for (uint32_t c = node.child; c != kNoTrieNode; c = trie_[c].sibling) {
+      if (trie_[c].child == kNoTrieNode && isPlainClassChar(trie_[c].ch)) {
+        out_ += trie_[c].ch;
+      }
+    }
+    out_ += ']';
+    separator = true;
+  }
+  for (uint32_t c = node.child; c != kNoTrieNode; c = trie_[c].sibling) {
+    if (useClass && trie_[c].child == kNoTrieNode &&
+        isPlainClassChar(trie_[c].ch)) {
+      continue;
+    }
+    if (separator) {
+      out_ += "\\|";
+    }
+    printLiteral(trie_[c].ch);
+    printTrieNode(alternation, c);
+    separator = true;
+  }
+  if (group) {
+    out_ += "\\)";
+  }
+  if (optional && !optionalFirst) {
+    out_ += "\\?";
+  }
+}
+
+void VimRegexTranslator::printTrieBranches(const RegexNode &alternation,
+                                           uint32_t index) {
+  // Branches ending in the subtree, in their original order
+  std::vector<uint32_t> branches;
+  std::vector<uint32_t> pending{index};
+  while (!pending.empty()) {
+    const TrieNode &node = trie_[pending.back()];
+    pending.pop_back();
+    if (node.branch != kNoTrieNode) {
+      branches.push_back(node.branch);
+    }
+    for (uint32_t c = node.child; c != kNoTrieNode; c = trie_[c].sibling) {
+      pending.push_back(c);
+    }
+  }
+  std::sort(branches.begin(), branches.end());
+
+  out_ += "\\%(";
+  for (size_t i = 0; i < branches.size(); ++i) {
+    if (i > 0) {
+      out_ += "\\|";
+    }
+    const RegexNode &branch =
+        tree_.nodes[tree_.child(alternation, branches[i])];
+    for (uint32_t j = trie_[index].depth; j < branch.count; ++j) {
+      printLiteral(tree_.nodes[tree_.child(branch, j)].ch);
+    }
+  }
+  out_ += "\\)";
+}
+
+void VimRegexTranslator::printNode(uint32_t index) {
+  const RegexNode &node = tree_.nodes[index];
+  switch (node.kind) {
+  case RegexNodeKind::Sequence:
+    printSequence(node);
+    break;
+  case RegexNodeKind::Alternation:
+    if (printTrie(node)) {
+      break;
+    }
+    for (uint32_t i = 0; i < node.count; ++i) {
+      if (i > 0) {
+        out_ += "\\|";
+      }
+      printNode(tree_.child(node, i));
+    }
+    break;
+  case RegexNodeKind::Group:
+    // Only real capture groups use \(, so back references keep their numbers
+    out_ += node.group == RegexGroupKind::Capture ? "\\(" : "\\%(";
+    printNode(node.first);
+    out_ += "\\)";
+    switch (node.group) {
+    case RegexGroupKind::Lookahead:
+      out_ += "\\@=";
+      break;
+    case RegexGroupKind::NegativeLookahead:
+      out_ += "\\@!";
+      break;
+    case RegexGroupKind::Lookbehind:
+      out_ += "\\@<=";
+      break;
+    case RegexGroupKind::NegativeLookbehind:
+      out_ += "\\@<!";
+      break;
+    case RegexGroupKind::Atomic:
+      out_ += "\\@>";
+      break;
+    default:
+      break;
+    }
+    break;
+  case RegexNodeKind::Repeat:
+    printRepeat(node);
+    break;
+  case RegexNodeKind::Literal:
+    printLiteral(node.ch);
+    break;
+  case RegexNodeKind::Any:
+    out_ += '.';
+    break;
+  case RegexNodeKind::LineStart:
+    out_ += "\\_^";
+    break;
+  case RegexNodeKind::LineEnd:
+    out_ += "\\_$";
+    break;
+  case RegexNodeKind::WordBoundary:
+    out_ += "\\%(\\<\\|\\>\\)";
+    break;
+  case RegexNodeKind::NotWordBoundary:
+    out_ += "\\%(\\<\\|\\>\\)\\@!";
+    break;
+  case RegexNodeKind::IgnoreCase:
+    out_ += "\\c";
+    break;
+  case RegexNodeKind::CharClass:
+  case RegexNodeKind::Escape:
+  case RegexNodeKind::Backref:
+  case RegexNodeKind::Raw:
+    out_.append(tree_.nodeText(node));
+    break;
+  }
+}
+
+namespace {
+
+// Maximum of \z( groups in a region start
+constexpr int kMaxExternalGroups = 9;
+
+bool isBackrefDigit(char c) { return c >= '1' && c <= '9'; }
+
+} // namespace
+
+bool externalizeRegionGroups(std::string &start, std::string &end) {
+  // Vim patterns are scanned in backslash pairs, so "\\(" is not a group
+  std::string newStart;
+  newStart.reserve(start.size() + 8);
+  int groups = 0;
+  for (size_t i = 0; i < start.size(); ++i) {
+    if (start[i] != '\\' || i + 1 == start.size()) {
+      newStart += start[i];
+      continue;
+    }
+    char c = start[++i];
+    if (isBackrefDigit(c)) {
+      return false;
+    }
+    if (c == '(') {
+      newStart += "\\z(";
+      groups++;
+      continue;
+    }
+    newStart += '\\';
+    newStart += c;
+  }
+  if (groups > kMaxExternalGroups) {
+    return false;
+  }
+
+  std::string newEnd;
+  newEnd.reserve(end.size() + 4);
+  for (size_t i = 0; i < end.size(); ++i) {
+    if (end[i] != '\\' || i + 1 == end.size()) {
+      newEnd += end[i];
+      continue;
+    }
+    char c = end[++i];
+    if (isBackrefDigit(c)) {
+      if (c - '0' > groups) {
+        return false;
+      }
+      newEnd += "\\z";
+    } else {
+      newEnd += '\\';
+    }
+    newEnd += c;
+  }
+  start = std::move(newStart);
+  end = std::move(newEnd);
+  return true;
+}
+
+bool hasVimBackrefs(std::string_view pattern) {
+  for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+    if (pattern[i] == '\\' && isBackrefDigit(pattern[++i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool hasVimExternalGroups(std::string_view pattern) {
+  for (size_t i = 0; i + 2 < pattern.size(); ++i) {
+    if (pattern[i] != '\\') {
+      continue;
+    }
+    if (pattern[++i] == 'z' &&
+        (pattern[i + 1] == '(' || isBackrefDigit(pattern[i + 1]))) {
+      return true;
+    }
+  }
+  return false;
+}
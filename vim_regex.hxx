@@ -0,0 +1,185 @@
+#ifndef VIM_REGEX_H
+#define VIM_REGEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Kinds of nodes in a parsed Oniguruma regular expression
+enum class RegexNodeKind : uint8_t {
+  Sequence,        // Children matched one after another
+  Alternation,     // Children are alternatives
+  Group,           // Parenthesized child (see RegexGroupKind)
+  Repeat,          // Quantified child (see RegexRepeatMode)
+  Literal,         // Single literal character
+  CharClass,       // Bracket expression, text is the Vim collection
+  Escape,          // Character type or code escape, text is the Vim atom
+  Any,             // "."
+  LineStart,       // "^"
+  LineEnd,         // "$"
+  WordBoundary,    // "\b"
+  NotWordBoundary, // "\B"
+  Backref,         // "\1" .. "\9" or "\k<name>", text is the Vim atom
+  IgnoreCase,      // "(?i)"
+  Raw              // Construct without a Vim equivalent, copied as is
+};
+
+enum class RegexGroupKind : uint8_t {
+  Capture,
+  NonCapture,
+  Lookahead,
+  NegativeLookahead,
+  Lookbehind,
+  NegativeLookbehind,
+  Atomic
+};
+
+enum class RegexRepeatMode : uint8_t { Greedy, Lazy, Possessive };
+
+// Node of a RegexTree. Sequences and alternations own a range of
+// RegexTree::children; groups and repeats own the single node `first`.
+struct RegexNode {
+  RegexNodeKind kind;
+  RegexGroupKind group = RegexGroupKind::Capture;
+  RegexRepeatMode mode = RegexRepeatMode::Greedy;
+  bool wordOnly = false; // Escape/CharClass matches only word characters
+  char ch = 0;           // Literal character
+  uint32_t first = 0;    // First child (index in children, or node index)
+  uint32_t count = 0;    // Number of children of a sequence/alternation
+  uint32_t text = 0;     // Vim text of escapes/classes/raw (in text)
+  uint32_t textLength = 0;
+  int32_t min = 0;  // Repeat bounds
+  int32_t max = -1; // -1 means unbounded
+};
+
+// Parsed form of one regular expression
+struct RegexTree {
+  std::vector<RegexNode> nodes;
+  std::vector<uint32_t> children;
+  std::string text;
+  uint32_t root = 0;
+  bool truncated = false; // Nesting exceeded the parser limit
+
+  const RegexNode &node(uint32_t index) const { return nodes[index]; }
+  uint32_t child(const RegexNode &node, uint32_t i) const {
+    return children[node.first + i];
+  }
+  std::string_view nodeText(const RegexNode &node) const {
+    return std::string_view(text).substr(node.text, node.textLength);
+  }
+
+  void clear() {
+    nodes.clear();
+    children.clear();
+    text.clear();
+    root = 0;
+    truncated = false;
+  }
+};
+
+// Translates Oniguruma regular expressions (as used by TextMate grammars)
+// into Vim regular expressions in 'magic' mode. Each pattern is lexed and
+// parsed once into a RegexTree and printed from it, so translation is linear
+// in the pattern length regardless of nesting. The tree, scratch space and
+// output buffer are reused between calls; an instance is not thread-safe.
+class VimRegexTranslator {
+public:
+  // Parse a regex; the tree stays valid until the next call
+  const RegexTree &parse(std::string_view regex);
+
+  // Print the tree of the last parse as a Vim regex
+  const std::string &print();
+
+  // Parse and print in one step; the result stays valid until the next call
+  const std::string &translate(std::string_view regex);
+
+  // Tree of the last parse
+  const RegexTree &tree() const { return tree_; }
+
+  // Print large alternations of literal strings as a prefix trie
+  // (enabled by default)
+  void setFactorAlternations(bool enabled) { factorAlternations_ = enabled; }
+
+private:
+  // Patterns nested deeper than this are copied through untranslated
+  static constexpr int kMaxDepth = 1000;
+
+  // Literal alternations with fewer branches are printed as they are
+  static constexpr uint32_t kMinTrieBranches = 6;
+
+  static constexpr uint32_t kNoTrieNode = UINT32_MAX;
+
+  // Node of the prefix trie of a literal alternation
+  struct TrieNode {
+    char ch = 0;
+    uint32_t child = kNoTrieNode;   // First child; children sorted by ch
+    uint32_t sibling = kNoTrieNode; // Next child of the parent
+    uint32_t branch = kNoTrieNode;  // First branch ending here
+    uint32_t first = kNoTrieNode;   // First/last branch ending further down
+    uint32_t last = 0;
+    uint32_t depth = 0;             // Length of the prefix it stands for
+  };
+
+  // Parser
+  uint32_t parseAlternation(int depth);
+  uint32_t parseSequence(int depth);
+  uint32_t parseAtom(int depth);
+  uint32_t parseGroup(int depth);
+  uint32_t parseEscape();
+  uint32_t parseClass();
+  bool parseClassBody(std::string &out, bool &wordOnly, bool &negated);
+  uint32_t parseQuantifiers(uint32_t atom);
+  bool parseBraces(int32_t &min, int32_t &max);
+  void skipExtended();
+  bool applyOptions(std::string_view options);
+
+  // Escapes and collections
+  bool appendClassEscape(std::string &out, bool &wordOnly);
+  bool appendCodePoint(std::string &out, bool inClass);
+
+  // Tree construction
+  uint32_t addNode(RegexNodeKind kind);
+  uint32_t addText(RegexNodeKind kind, std::string_view text);
+  uint32_t addList(RegexNodeKind kind, size_t scratchStart);
+
+  // Printer
+  void printNode(uint32_t index);
+  void printSequence(const RegexNode &node);
+  void printRepeat(const RegexNode &node);
+  void printLiteral(char ch);
+  bool printTrie(const RegexNode &node);
+  void printTrieNode(const RegexNode &alternation, uint32_t index);
+  void printTrieBranches(const RegexNode &alternation, uint32_t index);
+
+  // Whether a node starts (or ends) with a word character: 1 = always,
+  // 0 = never, -1 = unknown
+  int wordEdge(uint32_t index, bool front) const;
+
+  RegexTree tree_;
+  std::string_view src_;
+  size_t pos_ = 0;
+  bool extended_ = false;
+  std::vector<uint32_t> scratch_;
+  std::vector<std::string_view> groupNames_; // Named groups in order
+  std::vector<int> groupNumbers_;            // Their capture numbers
+  int captureCount_ = 0;
+  std::string out_;
+  bool factorAlternations_ = true;
+  std::vector<TrieNode> trie_;
+};
+
+// A Vim region end cannot refer to the groups of its start with \1 .. \9;
+// they must be external groups: "\z(" in the start and "\z1" .. "\z9" in
+// the end. Rewrite the translated start and end of a region that way.
+// Returns false, leaving both alone, if the start refers to its own groups,
+// has more than nine of them or lacks a group the end refers to.
+bool externalizeRegionGroups(std::string &start, std::string &end);
+
+// Whether a translated Vim pattern refers to a capture group with \1 .. \9
+bool hasVimBackrefs(std::string_view pattern);
+
+// Whether a translated Vim pattern uses external groups ("\z(", "\z1" ..)
+bool hasVimExternalGroups(std::string_view pattern);
+
+#endif
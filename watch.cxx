@@ -0,0 +1,255 @@
+#include "watch.hxx"
+#include "batch.hxx"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Events of a saved file: written in place, or written elsewhere and renamed
+// over the old one as most editors do
+constexpr uint32_t kSaveEvents = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+// Quiet time that ends a burst of events, so that one save converts once
+constexpr int kSettleMilliseconds = 50;
+
+// Normalized form of a path, to compare the paths of events and jobs
+std::string pathKey(const fs::path &path) {
+  return path.lexically_normal().string();
+}
+
+// Directory holding a file ("." for a bare file name)
+fs::path directoryOf(const std::string &path) {
+  fs::path parent = fs::path(path).parent_path();
+  return parent.empty() ? fs::path(".") : parent;
+}
+
+class GrammarWatcher {
+public:
+  GrammarWatcher(const std::string &source, const std::string &output,
+                 bool batch, const ConversionOptions &options,
+                 Compression compression)
+      : source_(source), output_(output), batch_(batch), options_(options),
+        compression_(compression) {}
+  ~GrammarWatcher() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  GrammarWatcher(const GrammarWatcher &) = delete;
+  GrammarWatcher &operator=(const GrammarWatcher &) = delete;
+
+  // Convert every grammar, then the saved ones; only returns on error
+  bool run(std::string &error);
+
+private:
+  std::string source_;
+  std::string output_;
+  bool batch_;
+  ConversionOptions options_;
+  Compression compression_; // Of the files written into output_
+  int fd_ = -1;                           // inotify instance
+  std::map<int, fs::path> directories_;   // Watched directories by descriptor
+  std::set<std::string> watched_;         // Keys of the watched directories
+  std::vector<BatchJob> jobs_;
+  // Translations of each grammar by the key of its input
+  std::map<std::string, std::shared_ptr<RegexTranslationCache>> caches_;
+
+  // Collect the jobs of the source and watch the directories they are in
+  bool collect(std::string &error);
+  bool watchDirectory(const fs::path &dir, std::string &error);
+
+  // Block until files were saved and no event came for a while, adding the
+  // keys of the saved files to `changed`
+  bool waitForChanges(std::set<std::string> &changed, std::string &error);
+
+  // Convert a grammar with its kept translations and report how long it took
+  void convert(const BatchJob &job);
+};
+
+bool GrammarWatcher::run(std::string &error) {
+  fd_ = inotify_init1(IN_CLOEXEC);
+  if (fd_ < 0) {
+    error = std::string("Cannot watch files: ") + std::strerror(errno);
+    return false;
+  }
+  if (!collect(error)) {
+    return false;
+  }
+  for (const BatchJob &job : jobs_) {
+    convert(job);
+  }
+  std::cout << "Watching " << jobs_.size() << " grammar(s) for changes"
+            << std::endl;
+
+  for (;;) {
+    std::set<std::string> changed;
+    if (!waitForChanges(changed, error)) {
+      return false;
+    }
+
+    std::set<std::string> inputs;
+    for (const BatchJob &job : jobs_) {
+      inputs.insert(pathKey(job.input));
+    }
+    // A new grammar or an edited manifest changes the jobs
+    bool recollect = false;
+    for (const std::string &path : changed) {
+      recollect = recollect || (batch_ && inputs.count(path) == 0);
+    }
+    if (recollect) {
+      std::vector<BatchJob> previous = std::move(jobs_);
+      jobs_.clear();
+      std::string collectError;
+      if (!collect(collectError)) {
+        std::cerr << "Error: " << collectError << std::endl;
+        jobs_ = std::move(previous);
+      }
+    }
+
+    std::set<std::string> current;
+    for (const BatchJob &job : jobs_) {
+      std::string key = pathKey(job.input);
+      current.insert(key);
+      if (changed.count(key) || inputs.count(key) == 0) {
+        convert(job);
+      }
+    }
+    for (auto it = caches_.begin(); it != caches_.end();) {
+      it = current.count(it->first) ? std::next(it) : caches_.erase(it);
+    }
+  }
+}
+
+bool GrammarWatcher::collect(std::string &error) {
+  if (!batch_) {
+    jobs_.push_back({source_, output_});
+  } else if (!collectBatchJobs(source_, output_, jobs_, error, compression_)) {
+    return false;
+  }
+
+  std::error_code ec;
+  if (batch_ && fs::is_directory(source_, ec)) {
+    // New grammars show up in the directory
+    if (!watchDirectory(source_, error)) {
+      return false;
+    }
+  } else if (batch_ && !watchDirectory(directoryOf(source_), error)) {
+    return false;
+  }
+  for (const BatchJob &job : jobs_) {
+    if (!watchDirectory(directoryOf(job.input), error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GrammarWatcher::watchDirectory(const fs::path &dir, std::string &error) {
+  std::string key = pathKey(dir);
+  if (watched_.count(key)) {
+    return true;
+  }
+  // Watch the directory rather than the file, whose inode changes whenever
+  // an editor saves by renaming
+  int wd = inotify_add_watch(fd_, dir.c_str(), kSaveEvents | IN_ONLYDIR);
+  if (wd < 0) {
+    error = "Cannot watch " + dir.string() + ": " + std::strerror(errno);
+    return false;
+  }
+  directories_[wd] = dir;
+  watched_.insert(key);
+  return true;
+}
+
+bool GrammarWatcher::waitForChanges(std::set<std::string> &changed,
+                                    std::string &error) {
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    pollfd pfd{fd_, POLLIN, 0};
+    int ready = poll(&pfd, 1, changed.empty() ? -1 : kSettleMilliseconds);
+    if (ready < 0 && errno != EINTR) {
+      error = std::string("Cannot wait for changes: ") + std::strerror(errno);
+      return false;
+    }
+    if (ready == 0) {
+      return true;
+    }
+    ssize_t length = ready < 0 ? 0 : read(fd_, buffer, sizeof(buffer));
+    if (length < 0 && errno != EINTR && errno != EAGAIN) {
+      error = std::string("Cannot read changes: ") + std::strerror(errno);
+      return false;
+    }
+    for (ssize_t offset = 0; offset < length;) {
+      const auto *event =
+          reinterpret_cast<const inotify_event *>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost; treat every grammar as saved
+        for (const BatchJob &job : jobs_) {
+          changed.insert(pathKey(job.input));
+        }
+        continue;
+      }
+      auto dir = directories_.find(event->wd);
+      if ((event->mask & kSaveEvents) && event->len > 0 &&
+          dir != directories_.end()) {
+        changed.insert(pathKey(dir->second / event->name));
+      }
+    }
+  }
+}
+
+void GrammarWatcher::convert(const BatchJob &job) {
+  std::shared_ptr<RegexTranslationCache> &cache = caches_[pathKey(job.input)];
+  if (!cache) {
+    cache = std::make_shared<RegexTranslationCache>();
+  }
+  ConversionOptions options = options_;
+  options.regexCache = cache;
+
+  auto start = std::chrono::steady_clock::now();
+  std::string error;
+  bool converted = convertFile(job.input, job.output, error, options);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t lookups = cache->lookups();
+  size_t misses = cache->misses();
+  // A grammar that fails to parse translates nothing and keeps the cache
+  if (lookups > 0) {
+    cache->prune();
+  }
+  if (!converted) {
+    std::cerr << "Error: " << job.input << ": " << error << std::endl;
+    return;
+  }
+  std::cout << "Wrote " << job.output << " in " << std::fixed
+            << std::setprecision(1) << elapsed.count() << " ms";
+  if (lookups > 0) {
+    std::cout << ", translated " << misses << " of " << lookups << " regexes";
+  }
+  std::cout << std::endl;
+}
+
+} // namespace
+
+bool watchGrammars(const std::string &source, const std::string &output,
+                   bool batch, const ConversionOptions &options,
+                   std::string &error, Compression compression) {
+  GrammarWatcher watcher(source, output, batch, options, compression);
+  return watcher.run(error);
+}
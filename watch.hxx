@@ -0,0 +1,21 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "compression.hxx"
+#include "tmlanguage2vimsyntax.hxx"
+#include <string>
+
+// Convert the grammars of a source, then convert a grammar again every time
+// its file is saved, until the process is interrupted. Without `batch` the
+// source is a grammar file converted to `output`; with it, a directory or
+// manifest as for --batch with `output` as the output directory and
+// `compression` for the files written there, whose grammars are collected
+// again when it changes. Each grammar keeps the translations of its regexes,
+// so a conversion after an edit only translates the regexes the edit
+// changed. Returns false with `error` set if the inputs cannot be watched.
+bool watchGrammars(const std::string &source, const std::string &output,
+                   bool batch, const ConversionOptions &options,
+                   std::string &error,
+                   Compression compression = Compression::None);
+
+#endif
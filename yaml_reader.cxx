@@ -0,0 +1,927 @@
+#include "yaml_reader.hxx"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+
+// Collections nested deeper than this are rejected rather than risk the
+// stack of the recursive descent
+constexpr int kMaxDepth = 1000;
+
+constexpr size_t kUnknownSize = static_cast<size_t>(-1);
+
+bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+bool isBreak(char c) { return c == '\n' || c == '\r'; }
+
+bool isFlowIndicator(char c) {
+  return c == ',' || c == '[' || c == ']' || c == '{' || c == '}';
+}
+
+bool isDigits(std::string_view s, const char *digits) {
+  return !s.empty() && s.find_first_not_of(digits) == std::string_view::npos;
+}
+
+// Integer of the YAML core schema: 12, -3, 0o14, 0xC
+bool isCoreInteger(std::string_view s) {
+  if (s.size() > 2 && s[0] == '0' && (s[1] == 'o' || s[1] == 'x')) {
+    return isDigits(s.substr(2),
+                    s[1] == 'o' ? "01234567" : "0123456789abcdefABCDEF");
+  }
+  if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+    s.remove_prefix(1);
+  }
+  return isDigits(s, "0123456789");
+}
+
+// Float of the YAML core schema: 1.5, -.5, 2e3, .inf, -.Inf, .nan
+bool isCoreFloat(std::string_view s) {
+  if (s == ".nan" || s == ".NaN" || s == ".NAN") {
+    return true;
+  }
+  if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+    s.remove_prefix(1);
+  }
+  if (s == ".inf" || s == ".Inf" || s == ".INF") {
+    return true;
+  }
+  size_t exponent = s.find_first_of("eE");
+  std::string_view mantissa = s.substr(0, exponent);
+  if (exponent != std::string_view::npos) {
+    std::string_view power = s.substr(exponent + 1);
+    if (!power.empty() && (power[0] == '-' || power[0] == '+')) {
+      power.remove_prefix(1);
+    }
+    if (!isDigits(power, "0123456789")) {
+      return false;
+    }
+  }
+  size_t dot = mantissa.find('.');
+  std::string_view whole = mantissa.substr(0, dot);
+  std::string_view fraction =
+      dot == std::string_view::npos ? "" : mantissa.substr(dot + 1);
+  bool wholeOk = whole.empty() || isDigits(whole, "0123456789");
+  bool fractionOk = fraction.empty() || isDigits(fraction, "0123456789");
+  return wholeOk && fractionOk && (!whole.empty() || !fraction.empty());
+}
+
+class YamlReader {
+public:
+  YamlReader(std::string_view yaml, GrammarSax &sax, std::string &error)
+      : yaml_(yaml), sax_(sax), error_(error) {}
+
+  bool read();
+
+private:
+  // Where a node starts
+  enum class Start {
+    OwnLine,  // On a line of its own, or at the start of the document
+    AfterKey, // After "key:" on the same line
+    AfterDash // After "- " on the same line
+  };
+
+  std::string_view yaml_;
+  size_t pos_ = 0;
+  size_t lineStart_ = 0;       // Offset of the line pos_ is on
+  bool documentEnded_ = false; // A "---" or "..." line ended the document
+  int depth_ = 0;              // Open collections
+  GrammarSax &sax_;
+  std::string &error_;
+  std::string scalar_; // Text of the last scalar or key
+
+  char peek(size_t ahead = 0) const {
+    return pos_ + ahead < yaml_.size() ? yaml_[pos_ + ahead] : '\0';
+  }
+
+  // Whether yaml_[at] is white space, a line break or past the end
+  bool spaceAt(size_t at) const {
+    return at >= yaml_.size() || isBlank(yaml_[at]) || isBreak(yaml_[at]);
+  }
+
+  bool atLineEnd() const {
+    return pos_ >= yaml_.size() || isBreak(yaml_[pos_]);
+  }
+
+  int column() const { return static_cast<int>(pos_ - lineStart_); }
+
+  bool isSequenceEntry() const { return peek() == '-' && spaceAt(pos_ + 1); }
+
+  // "---" or "..." at the start of a line
+  bool atDocumentMarker() const {
+    return pos_ == lineStart_ &&
+           (yaml_.compare(pos_, 3, "---") == 0 ||
+            yaml_.compare(pos_, 3, "...") == 0) &&
+           spaceAt(pos_ + 3);
+  }
+
+  bool fail(const std::string &message);
+
+  void skipBlanks() {
+    while (isBlank(peek())) {
+      pos_++;
+    }
+  }
+
+  void skipComment() {
+    if (peek() == '#') {
+      while (!atLineEnd()) {
+        pos_++;
+      }
+    }
+  }
+
+  // Move past the line break at pos_
+  void nextLine() {
+    if (peek() == '\r') {
+      pos_++;
+    }
+    if (peek() == '\n') {
+      pos_++;
+    }
+    lineStart_ = pos_;
+  }
+
+  // Move to the next token past white space, comments and line breaks;
+  // false at the end of the document
+  bool skipToContent();
+
+  // Whether a block mapping key ("key:", "'key':") starts at pos_
+  bool atMappingKey() const;
+
+  // Node at pos_, whose scalar lines must be indented more than `indent`
+  bool parseNode(int indent, Start start);
+
+  // Node on the lines below a key or dash with nothing after it
+  bool parseNodeBelow(int indent, bool sameIndentSequence);
+
+  bool parseBlockMapping(int indent);
+  bool parseBlockSequence(int indent);
+  bool parseBlockScalar(int indent);
+  bool parseFlowNode();
+  bool parseFlowSequence();
+  bool parseFlowMapping();
+  bool skipFlowSpace();
+
+  // Skip tags and anchors before a node
+  bool skipProperties();
+
+  // Read a scalar into scalar_
+  bool readBlockKey();
+  bool readQuoted();
+  bool readEscape();
+  bool readHex(int digits, uint32_t &value);
+  void readPlain(int indent, bool flow);
+
+  // Report scalar_ as a plain scalar, resolving its type
+  bool plainScalar();
+
+  // Only white space or a comment may follow a node on its line
+  bool endOfLine();
+
+  bool enter() {
+    return ++depth_ <= kMaxDepth || fail("collections are nested too deeply");
+  }
+};
+
+bool YamlReader::read() {
+  if (yaml_.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+    pos_ = lineStart_ = 3;
+  }
+
+  // Directives and the "---" that starts the document
+  for (;;) {
+    skipBlanks();
+    skipComment();
+    if (pos_ >= yaml_.size()) {
+      return fail("no document");
+    }
+    if (isBreak(peek())) {
+      nextLine();
+    } else if (column() == 0 && peek() == '%') {
+      while (!atLineEnd()) {
+        pos_++;
+      }
+    } else if (atDocumentMarker()) {
+      pos_ += 3;
+      skipBlanks();
+      skipComment();
+      if (!atLineEnd()) {
+        break;
+      }
+    } else {
+      break;
+    }
+  }
+
+  if (!parseNode(-1, Start::OwnLine)) {
+    return false;
+  }
+  if (skipToContent()) {
+    return fail("unexpected content after the document");
+  }
+  return true;
+}
+
+bool YamlReader::fail(const std::string &message) {
+  size_t at = std::min(pos_, yaml_.size());
+  size_t line = 1 + std::count(yaml_.begin(), yaml_.begin() + at, '\n');
+  size_t lineBegin = yaml_.rfind('\n', at == 0 ? 0 : at - 1);
+  size_t column =
+      lineBegin == std::string_view::npos || at == 0 ? at + 1 : at - lineBegin;
+  error_ = "YAML parse error at line " + std::to_string(line) + ", column " +
+           std::to_string(column) + ": " + message;
+  return false;
+}
+
+bool YamlReader::skipToContent() {
+  if (documentEnded_) {
+    return false;
+  }
+  for (;;) {
+    skipBlanks();
+    skipComment();
+    if (pos_ >= yaml_.size()) {
+      return false;
+    }
+    if (!isBreak(peek())) {
+      return true;
+    }
+    nextLine();
+    if (atDocumentMarker()) {
+      documentEnded_ = true;
+      return false;
+    }
+  }
+}
+
+bool YamlReader::atMappingKey() const {
+  char c = peek();
+  size_t i = pos_;
+  if (c == '"' || c == '\'') {
+    // Quoted keys have to fit on one line
+    for (i++; i < yaml_.size() && !isBreak(yaml_[i]); i++) {
+      if (c == '"' && yaml_[i] == '\\') {
+        i++;
+      } else if (yaml_[i] == c) {
+        if (c == '\'' && i + 1 < yaml_.size() && yaml_[i + 1] == '\'') {
+          i++;
+        } else {
+          break;
+        }
+      }
+    }
+    if (i >= yaml_.size() || isBreak(yaml_[i])) {
+      return false;
+    }
+    for (i++; i < yaml_.size() && isBlank(yaml_[i]); i++) {
+    }
+    return i < yaml_.size() && yaml_[i] == ':' && spaceAt(i + 1);
+  }
+
+  // Indicators that cannot start a plain scalar
+  if (std::string_view("[]{},#&*!|>%@`").find(c) != std::string_view::npos ||
+      ((c == '-' || c == '?' || c == ':') && spaceAt(pos_ + 1))) {
+    return false;
+  }
+  for (; i < yaml_.size() && !isBreak(yaml_[i]); i++) {
+    if (yaml_[i] == ':' && spaceAt(i + 1)) {
+      return true;
+    }
+    if (yaml_[i] == '#' && i > pos_ && isBlank(yaml_[i - 1])) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool YamlReader::parseNode(int indent, Start start) {
+  if (!skipProperties()) {
+    return false;
+  }
+  if (atLineEnd() || peek() == '#') {
+    // Only a tag or anchor on this line; the node is below
+    return parseNodeBelow(indent, start == Start::AfterKey);
+  }
+
+  char c = peek();
+  if (isSequenceEntry()) {
+    if (start == Start::AfterKey) {
+      return fail("a sequence cannot start on the line of its key");
+    }
+    return parseBlockSequence(column());
+  }
+  if (c == '?' && spaceAt(pos_ + 1)) {
+    return fail("complex keys are not supported");
+  }
+  if (c == '[' || c == '{') {
+    return parseFlowNode() && endOfLine();
+  }
+  if (c == '|' || c == '>') {
+    return parseBlockScalar(indent);
+  }
+  if (start != Start::AfterKey && atMappingKey()) {
+    return parseBlockMapping(column());
+  }
+  if (c == '"' || c == '\'') {
+    return readQuoted() && sax_.string(scalar_) && endOfLine();
+  }
+  readPlain(indent, false);
+  if (peek() == ':') {
+    return fail("a mapping cannot start on the line of its key");
+  }
+  return plainScalar();
+}
+
+bool YamlReader::parseNodeBelow(int indent, bool sameIndentSequence) {
+  skipComment();
+  if (!skipToContent()) {
+    return sax_.null();
+  }
+  if (column() > indent) {
+    return parseNode(indent, Start::OwnLine);
+  }
+  // "key:" followed by "- item" lines at its own indentation
+  if (sameIndentSequence && column() == indent && isSequenceEntry()) {
+    return parseBlockSequence(indent);
+  }
+  return sax_.null();
+}
+
+bool YamlReader::parseBlockMapping(int indent) {
+  if (!enter() || !sax_.start_object(kUnknownSize)) {
+    return false;
+  }
+  for (;;) {
+    if (!readBlockKey() || !sax_.key(scalar_)) {
+      return false;
+    }
+    skipBlanks();
+    bool parsed = atLineEnd() || peek() == '#'
+                      ? parseNodeBelow(indent, true)
+                      : parseNode(indent, Start::AfterKey);
+    if (!parsed) {
+      return false;
+    }
+
+    if (!skipToContent() || column() < indent) {
+      break;
+    }
+    if (column() > indent) {
+      return fail("bad indentation of a mapping entry");
+    }
+    if (!atMappingKey()) {
+      return fail("expected a mapping key");
+    }
+  }
+  depth_--;
+  return sax_.end_object();
+}
+
+bool YamlReader::parseBlockSequence(int indent) {
+  if (!enter() || !sax_.start_array(kUnknownSize)) {
+    return false;
+  }
+  for (;;) {
+    pos_++; // '-'
+    skipBlanks();
+    bool parsed = atLineEnd() || peek() == '#'
+                      ? parseNodeBelow(indent, false)
+                      : parseNode(indent, Start::AfterDash);
+    if (!parsed) {
+      return false;
+    }
+
+    if (!skipToContent() || column() < indent ||
+        (column() == indent && !isSequenceEntry())) {
+      break;
+    }
+    if (column() > indent) {
+      return fail("bad indentation of a sequence entry");
+    }
+  }
+  depth_--;
+  return sax_.end_array();
+}
+
+bool YamlReader::parseBlockScalar(int indent) {
+  bool literal = peek() == '|';
+  pos_++;
+
+  // Header: chomping ('-' strip, '+' keep) and indentation, in any order
+  int chomping = 0;
+  int explicitIndent = 0;
+  for (int i = 0; i < 2; ++i) {
+    char c = peek();
+    if ((c == '-' || c == '+') && chomping == 0) {
+      chomping = c == '+' ? 1 : -1;
+      pos_++;
+    } else if (c >= '1' && c <= '9' && explicitIndent == 0) {
+      explicitIndent = c - '0';
+      pos_++;
+    }
+  }
+  skipBlanks();
+  skipComment();
+  if (!atLineEnd()) {
+    return fail("unexpected text after a block scalar header");
+  }
+  nextLine();
+
+  // Content is indented as its first non-empty line unless the header says
+  int contentIndent = std::max(indent, 0) + explicitIndent;
+  if (explicitIndent == 0) {
+    size_t i = pos_;
+    for (;;) {
+      size_t lineBegin = i;
+      while (i < yaml_.size() && yaml_[i] == ' ') {
+        i++;
+      }
+      if (i < yaml_.size() && isBreak(yaml_[i])) {
+        i += yaml_.compare(i, 2, "\r\n") == 0 ? 2 : 1;
+        continue;
+      }
+      contentIndent = std::max(static_cast<int>(i - lineBegin), indent + 1);
+      break;
+    }
+  }
+
+  scalar_.clear();
+  size_t breaks = 0;     // Empty lines since the last text line
+  bool hasText = false;  // A text line has been read
+  bool indented = false; // The last text line was more indented
+  while (pos_ < yaml_.size() && !atDocumentMarker()) {
+    size_t lineBegin = pos_;
+    int spaces = 0;
+    while (spaces < contentIndent && peek() == ' ') {
+      pos_++;
+      spaces++;
+    }
+    if (spaces < contentIndent) {
+      skipBlanks();
+      if (!atLineEnd()) {
+        // Less indented: the scalar ends before this line
+        pos_ = lineBegin;
+        break;
+      }
+    }
+    if (atLineEnd()) {
+      if (pos_ >= yaml_.size()) {
+        break;
+      }
+      breaks++;
+      nextLine();
+      continue;
+    }
+
+    size_t textBegin = pos_;
+    while (!atLineEnd()) {
+      pos_++;
+    }
+    std::string_view text = yaml_.substr(textBegin, pos_ - textBegin);
+    bool moreIndented = isBlank(text[0]);
+    if (literal || !hasText) {
+      scalar_.append(breaks + (hasText ? 1 : 0), '\n');
+    } else if (moreIndented || indented) {
+      // Line breaks around more indented lines are kept
+      scalar_.append(breaks + 1, '\n');
+    } else if (breaks == 0) {
+      // A single line break folds into a space
+      scalar_ += ' ';
+    } else {
+      scalar_.append(breaks, '\n');
+    }
+    scalar_ += text;
+    hasText = true;
+    indented = moreIndented;
+    breaks = 0;
+    nextLine();
+  }
+
+  if (chomping > 0) {
+    scalar_.append(breaks + (hasText ? 1 : 0), '\n');
+  } else if (chomping == 0 && hasText) {
+    scalar_ += '\n';
+  }
+  return sax_.string(scalar_);
+}
+
+bool YamlReader::parseFlowNode() {
+  if (!skipProperties()) {
+    return false;
+  }
+  char c = peek();
+  if (c == '[') {
+    return parseFlowSequence();
+  }
+  if (c == '{') {
+    return parseFlowMapping();
+  }
+  if (c == '"' || c == '\'') {
+    return readQuoted() && sax_.string(scalar_);
+  }
+  readPlain(-1, true);
+  return plainScalar();
+}
+
+bool YamlReader::parseFlowSequence() {
+  if (!enter() || !sax_.start_array(kUnknownSize)) {
+    return false;
+  }
+  pos_++; // '['
+  for (;;) {
+    if (!skipFlowSpace()) {
+      return false;
+    }
+    if (peek() == ']') {
+      break;
+    }
+    if (!parseFlowNode() || !skipFlowSpace()) {
+      return false;
+    }
+    if (peek() == ',') {
+      pos_++;
+    } else if (peek() == ':') {
+      return fail("mappings inside flow sequences are not supported");
+    } else if (peek() != ']') {
+      return fail("expected ',' or ']'");
+    }
+  }
+  pos_++;
+  depth_--;
+  return sax_.end_array();
+}
+
+bool YamlReader::parseFlowMapping() {
+  if (!enter() || !sax_.start_object(kUnknownSize)) {
+    return false;
+  }
+  pos_++; // '{'
+  for (;;) {
+    if (!skipFlowSpace()) {
+      return false;
+    }
+    if (peek() == '}') {
+      break;
+    }
+    if (peek() == '?' && spaceAt(pos_ + 1)) {
+      return fail("complex keys are not supported");
+    }
+    if (peek() == '"' || peek() == '\'') {
+      if (!readQuoted()) {
+        return false;
+      }
+    } else {
+      readPlain(-1, true);
+    }
+    if (!sax_.key(scalar_) || !skipFlowSpace()) {
+      return false;
+    }
+
+    // A key without ':' has a null value
+    bool parsed = true;
+    if (peek() != ':') {
+      parsed = sax_.null();
+    } else {
+      pos_++;
+      if (!skipFlowSpace()) {
+        return false;
+      }
+      parsed = peek() == ',' || peek() == '}' ? sax_.null() : parseFlowNode();
+    }
+    if (!parsed || !skipFlowSpace()) {
+      return false;
+    }
+    if (peek() == ',') {
+      pos_++;
+    } else if (peek() != '}') {
+      return fail("expected ',' or '}'");
+    }
+  }
+  pos_++;
+  depth_--;
+  return sax_.end_object();
+}
+
+bool YamlReader::skipFlowSpace() {
+  for (;;) {
+    skipBlanks();
+    skipComment();
+    if (pos_ >= yaml_.size()) {
+      return fail("unterminated flow collection");
+    }
+    if (!isBreak(peek())) {
+      return true;
+    }
+    nextLine();
+  }
+}
+
+bool YamlReader::skipProperties() {
+  for (;;) {
+    char c = peek();
+    if (c == '*') {
+      return fail("aliases are not supported");
+    }
+    if (c != '!' && c != '&') {
+      return true;
+    }
+    while (!spaceAt(pos_)) {
+      pos_++;
+    }
+    skipBlanks();
+  }
+}
+
+bool YamlReader::readBlockKey() {
+  if (peek() == '"' || peek() == '\'') {
+    if (!readQuoted()) {
+      return false;
+    }
+    skipBlanks();
+  } else {
+    // atMappingKey() found the ':' on this line
+    size_t start = pos_;
+    while (pos_ < yaml_.size() && !(yaml_[pos_] == ':' && spaceAt(pos_ + 1))) {
+      pos_++;
+    }
+    size_t end = pos_;
+    while (end > start && isBlank(yaml_[end - 1])) {
+      end--;
+    }
+    scalar_.assign(yaml_.substr(start, end - start));
+  }
+  if (peek() != ':') {
+    return fail("expected ':' after a mapping key");
+  }
+  pos_++;
+  return true;
+}
+
+bool YamlReader::readQuoted() {
+  char quote = peek();
+  pos_++;
+  scalar_.clear();
+  for (;;) {
+    size_t start = pos_;
+    while (pos_ < yaml_.size() && yaml_[pos_] != quote &&
+           !isBreak(yaml_[pos_]) && (quote == '\'' || yaml_[pos_] != '\\')) {
+      pos_++;
+    }
+    scalar_ += yaml_.substr(start, pos_ - start);
+    if (pos_ >= yaml_.size()) {
+      return fail("unterminated quoted scalar");
+    }
+
+    char c = yaml_[pos_];
+    if (c == quote) {
+      if (quote == '\'' && peek(1) == '\'') {
+        scalar_ += '\'';
+        pos_ += 2;
+        continue;
+      }
+      pos_++;
+      return true;
+    }
+    if (c == '\\') {
+      if (!readEscape()) {
+        return false;
+      }
+      continue;
+    }
+
+    // A line break folds into a space, or into the empty lines after it
+    while (!scalar_.empty() && isBlank(scalar_.back())) {
+      scalar_.pop_back();
+    }
+    size_t breaks = 0;
+    while (pos_ < yaml_.size() && isBreak(yaml_[pos_])) {
+      nextLine();
+      skipBlanks();
+      breaks++;
+    }
+    if (breaks == 1) {
+      scalar_ += ' ';
+    } else {
+      scalar_.append(breaks - 1, '\n');
+    }
+  }
+}
+
+bool YamlReader::readEscape() {
+  pos_++; // '\\'
+  if (pos_ >= yaml_.size()) {
+    return fail("unterminated quoted scalar");
+  }
+  char c = yaml_[pos_++];
+  uint32_t codePoint;
+  switch (c) {
+  case '0':
+    scalar_ += '\0';
+    break;
+  case 'a':
+    scalar_ += '\a';
+    break;
+  case 'b':
+    scalar_ += '\b';
+    break;
+  case 't':
+  case '\t':
+    scalar_ += '\t';
+    break;
+  case 'n':
+    scalar_ += '\n';
+    break;
+  case 'v':
+    scalar_ += '\v';
+    break;
+  case 'f':
+    scalar_ += '\f';
+    break;
+  case 'r':
+    scalar_ += '\r';
+    break;
+  case 'e':
+    scalar_ += '\x1B';
+    break;
+  case ' ':
+  case '"':
+  case '/':
+  case '\\':
+    scalar_ += c;
+    break;
+  case 'N':
+    appendUtf8(scalar_, 0x85);
+    break;
+  case '_':
+    appendUtf8(scalar_, 0xA0);
+    break;
+  case 'L':
+    appendUtf8(scalar_, 0x2028);
+    break;
+  case 'P':
+    appendUtf8(scalar_, 0x2029);
+    break;
+  case 'x':
+  case 'u':
+  case 'U':
+    if (!readHex(c == 'x' ? 2 : c == 'u' ? 4 : 8, codePoint)) {
+      return false;
+    }
+    // A surrogate pair written as two escapes, as JSON does
+    if (codePoint >= 0xD800 && codePoint < 0xDC00 && peek() == '\\' &&
+        peek(1) == 'u') {
+      size_t pair = pos_;
+      uint32_t low;
+      pos_ += 2;
+      if (readHex(4, low) && low >= 0xDC00 && low < 0xE000) {
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+      } else {
+        pos_ = pair;
+      }
+    }
+    if (codePoint > 0x10FFFF) {
+      return fail("invalid escape");
+    }
+    appendUtf8(scalar_, codePoint);
+    break;
+  case '\r':
+  case '\n':
+    // An escaped line break joins the lines without a space
+    pos_--;
+    nextLine();
+    skipBlanks();
+    break;
+  default:
+    pos_--;
+    return fail(std::string("unknown escape \\") + c);
+  }
+  return true;
+}
+
+bool YamlReader::readHex(int digits, uint32_t &value) {
+  value = 0;
+  for (int i = 0; i < digits; ++i) {
+    char c = peek(i);
+    int digit = c >= '0' && c <= '9'   ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                       : -1;
+    if (digit < 0) {
+      return fail("invalid escape");
+    }
+    value = value * 16 + digit;
+  }
+  pos_ += digits;
+  return true;
+}
+
+void YamlReader::readPlain(int indent, bool flow) {
+  scalar_.clear();
+  for (;;) {
+    size_t start = pos_;
+    size_t end = pos_; // End of the text without trailing blanks
+    while (pos_ < yaml_.size()) {
+      char c = yaml_[pos_];
+      if (isBreak(c) || (flow && isFlowIndicator(c)) ||
+          (c == ':' &&
+           (spaceAt(pos_ + 1) || (flow && isFlowIndicator(peek(1))))) ||
+          (c == '#' && pos_ > start && isBlank(yaml_[pos_ - 1]))) {
+        break;
+      }
+      pos_++;
+      if (!isBlank(c)) {
+        end = pos_;
+      }
+    }
+    scalar_ += yaml_.substr(start, end - start);
+    if (!atLineEnd()) {
+      return;
+    }
+
+    // The scalar goes on if the next non-empty line is indented more than
+    // its parent and is not a comment
+    size_t lineEnd = pos_;
+    size_t lineStart = lineStart_;
+    size_t breaks = 0;
+    bool marker = false;
+    while (pos_ < yaml_.size() && isBreak(yaml_[pos_])) {
+      nextLine();
+      breaks++;
+      marker = atDocumentMarker();
+      if (marker) {
+        break;
+      }
+      skipBlanks();
+    }
+    char next = peek();
+    bool more = pos_ < yaml_.size() && !marker && next != '#' &&
+                (flow ? !isFlowIndicator(next) &&
+                            !(next == ':' && spaceAt(pos_ + 1))
+                      : column() > indent);
+    if (!more) {
+      pos_ = lineEnd;
+      lineStart_ = lineStart;
+      return;
+    }
+    if (breaks == 1) {
+      scalar_ += ' ';
+    } else {
+      scalar_.append(breaks - 1, '\n');
+    }
+  }
+}
+
+bool YamlReader::plainScalar() {
+  const std::string &s = scalar_;
+  if (s.empty() || s == "~" || s == "null" || s == "Null" || s == "NULL") {
+    return sax_.null();
+  }
+  if (s == "true" || s == "True" || s == "TRUE") {
+    return sax_.boolean(true);
+  }
+  if (s == "false" || s == "False" || s == "FALSE") {
+    return sax_.boolean(false);
+  }
+  if (isCoreInteger(s)) {
+    bool octal = s.size() > 2 && s[1] == 'o';
+    errno = 0;
+    long long value = std::strtoll(s.c_str() + (octal ? 2 : 0), nullptr,
+                                   octal ? 8 : s[1] == 'x' ? 16 : 10);
+    if (errno == 0) {
+      return sax_.number_integer(value);
+    }
+  }
+  if (isCoreFloat(s) || isCoreInteger(s)) {
+    double value;
+    if (s.find("nan") != std::string::npos ||
+        s.find("NaN") != std::string::npos ||
+        s.find("NAN") != std::string::npos) {
+      value = std::numeric_limits<double>::quiet_NaN();
+    } else if (s.find('.') != std::string::npos &&
+               (s.find("inf") != std::string::npos ||
+                s.find("Inf") != std::string::npos ||
+                s.find("INF") != std::string::npos)) {
+      value = s[0] == '-' ? -std::numeric_limits<double>::infinity()
+                          : std::numeric_limits<double>::infinity();
+    } else {
+      value = std::strtod(s.c_str(), nullptr);
+    }
+    return sax_.number_float(value, scalar_);
+  }
+  return sax_.string(scalar_);
+}
+
+bool YamlReader::endOfLine() {
+  skipBlanks();
+  skipComment();
+  return atLineEnd() || fail("unexpected text after a value");
+}
+
+} // namespace
+
+bool readYaml(std::string_view yaml, GrammarSax &sax, std::string &error) {
+  YamlReader reader(yaml, sax, error);
+  return reader.read();
+}
@@ -0,0 +1,18 @@
+#ifndef YAML_READER_H
+#define YAML_READER_H
+
+#include "grammar_formats.hxx"
+#include <string>
+#include <string_view>
+
+// Read the first document of a YAML stream, the format of .tmLanguage.yaml
+// and .YAML-tmLanguage files, reporting its values to `sax` as the events of
+// the equivalent JSON. Block and flow collections and plain, quoted and
+// block scalars are read in a single pass without building anything in
+// between; plain scalars resolve to nulls, booleans and numbers as in the
+// YAML core schema. Tags and anchors are ignored; aliases and complex keys
+// are rejected. Returns false if the handler stops reading, or with `error`
+// set if the input is not YAML this reader understands.
+bool readYaml(std::string_view yaml, GrammarSax &sax, std::string &error);
+
+#endif